@@ -0,0 +1,139 @@
+#!/bin/sh
+#
+# Copyright (C) 2004-2010  Heinz Mauelshagen, Red Hat GmbH. All rights reserved.
+#
+# See file LICENSE at the top of this source tree for license information.
+#
+# Replay synthetic RAID sets through dmraid's phases and report timings.
+#
+# For each format, mkfixture writes device images holding the requested
+# sets, which "dmraid --replay --stats" discovers, groups and displays
+# (-s) and activates against the device-mapper mock (--dm_mock -ay)
+# LOOPS times. Per phase average, minimum and maximum times get reported.
+#
+
+usage() {
+	cat <<EOF >&2
+Usage: $0 [-f FORMATS] [-l LEVEL] [-s SETS] [-m MEMBERS] [-S SECTORS]
+	[-n LOOPS] [-a] [-d DMRAID] [-g MKFIXTURE] [-o DIRECTORY]
+-f	comma separated formats (default: all mkfixture supports)
+-l	RAID level: linear, 0, 1, 5 or 10 (default: 0); formats lacking it
+	or the member count at it get skipped
+-s	sets per format (default: 1)
+-m	members per set (default: 2)
+-S	sectors per device (default: mkfixture's)
+-n	loops per phase (default: 5)
+-a	replay through a device archive instead of the image directory
+-d	dmraid binary (default: dmraid)
+-g	mkfixture binary (default: ./mkfixture)
+-o	keep fixtures in DIRECTORY instead of a removed temporary one
+EOF
+	exit 1
+}
+
+formats=
+level=0
+sets=1
+members=2
+sectors=
+loops=5
+archive=
+dmraid=dmraid
+mkfixture=./mkfixture
+out=
+
+while getopts f:l:s:m:S:n:ad:g:o:h opt; do
+	case $opt in
+	f) formats=$(echo "$OPTARG" | tr , ' ') ;;
+	l) level=$OPTARG ;;
+	s) sets=$OPTARG ;;
+	m) members=$OPTARG ;;
+	S) sectors="-S $OPTARG" ;;
+	n) loops=$OPTARG ;;
+	a) archive=1 ;;
+	d) dmraid=$OPTARG ;;
+	g) mkfixture=$OPTARG ;;
+	o) out=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+
+[ -z "$formats" ] && formats=$($mkfixture -L | cut -d' ' -f1)
+[ -z "$formats" ] && exit 1
+
+if [ -n "$out" ]; then
+	mkdir -p "$out" || exit 1
+else
+	out=$(mktemp -d "${TMPDIR:-/tmp}/dmraid-bench.XXXXXX") || exit 1
+	trap 'rm -rf "$out"' EXIT
+	trap 'exit 1' HUP INT TERM
+fi
+
+# Sum up "COMMAND PHASE: SECONDSs, ..." lines of dmraid --stats per phase.
+report() {
+	awk -v fmt="$1" '
+	/: [0-9.]+s, / {
+		phase = $0
+		sub(/: [0-9.]+s, .*/, "", phase)
+		t = $0
+		sub(/.*: /, "", t)
+		sub(/s, .*/, "", t)
+		if (!(phase in n)) {
+			order[phases++] = phase
+			min[phase] = t
+		}
+		n[phase]++
+		sum[phase] += t
+		if (t < min[phase])
+			min[phase] = t
+		if (t > max[phase])
+			max[phase] = t
+	}
+	END {
+		for (i = 0; i < phases; i++) {
+			p = order[i]
+			printf("%-8s %-26s %5d %12.6f %12.6f %12.6f\n", fmt, p,
+			       n[p], sum[p] / n[p], min[p], max[p])
+		}
+	}'
+}
+
+printf "%-8s %-26s %5s %12s %12s %12s\n" \
+       format phase loops "avg [s]" "min [s]" "max [s]"
+
+ret=0
+for fmt in $formats; do
+	dir="$out/$fmt"
+	rm -rf "$dir" "$dir.archive"
+	if ! $mkfixture -f $fmt -l $level -s $sets -m $members $sectors \
+			"$dir" 2>/dev/null; then
+		echo "$fmt: skipped (level $level with $members members" \
+		     "isn't supported)" >&2
+		continue
+	fi
+
+	src="$dir"
+	if [ -n "$archive" ]; then
+		src="$dir.archive"
+		if ! $dmraid --replay "$dir" -rD --dump_archive "$src" \
+				>/dev/null 2>&1; then
+			echo "$fmt: creating the device archive failed" >&2
+			ret=1
+			continue
+		fi
+	fi
+
+	# Tag phases with the command running them; failures go to fd 3.
+	i=0
+	while [ $i -lt $loops ]; do
+		{ $dmraid --replay "$src" --stats -s ||
+			echo "$fmt: displaying RAID sets failed" >&3; } 2>&1 |
+			sed 's/^/-s /'
+		{ $dmraid --replay "$src" --dm_mock --stats -ay ||
+			echo "$fmt: activating RAID sets failed" >&3; } 2>&1 |
+			sed 's/^/-ay /'
+		i=$((i + 1))
+	done 3>&2 | report $fmt
+done
+
+exit $ret
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2004-2010  Heinz Mauelshagen, Red Hat GmbH.
+ *                          All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * Metadata checksum check and benchmark.
+ *
+ * Compares the results of the runtime selected checksum implementation
+ * with the scalar ones on random buffers of random length and alignment
+ * and times both on metadata sized buffers.
+ */
+
+#include <getopt.h>
+#include <time.h>
+#include "internal.h"
+
+/* Largest buffer: the biggest metadata areas span 16 sectors. */
+#define	BUF_SIZE	(16 * 512)
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Compare implementations on @rounds random buffers. */
+static int
+check(uint8_t *buf, unsigned int rounds)
+{
+	unsigned int i, errors = 0;
+	size_t len, off;
+
+	for (i = 0; i < rounds; i++) {
+		for (len = 0; len < BUF_SIZE + 16; len++)
+			buf[len] = random();
+
+		/* Odd offsets test unaligned loads. */
+		off = random() % 16;
+		len = random() % (BUF_SIZE + 1);
+
+		if (csum_bytes(buf + off, len) !=
+		    csum_bytes_scalar(buf + off, len)) {
+			fprintf(stderr, "csum_bytes mismatch: offset %zu, "
+				"%zu bytes\n", off, len);
+			errors++;
+		}
+
+		if (csum16(buf + off, len / 2) !=
+		    csum16_scalar(buf + off, len / 2)) {
+			fprintf(stderr, "csum16 mismatch: offset %zu, "
+				"%zu words\n", off, len / 2);
+			errors++;
+		}
+
+		if (csum32(buf + off, len / 4) !=
+		    csum32_scalar(buf + off, len / 4)) {
+			fprintf(stderr, "csum32 mismatch: offset %zu, "
+				"%zu words\n", off, len / 4);
+			errors++;
+		}
+	}
+
+	printf("%u random buffers checked, %u mismatches\n", rounds, errors);
+	return !errors;
+}
+
+/* Calls per second of checksum function @f over @n units of @buf. */
+#define	TIME(f, buf, n, loops)						\
+({									\
+	unsigned int i_;						\
+	volatile uint32_t sink_ = 0;					\
+	double t_ = now();						\
+									\
+	for (i_ = 0; i_ < (loops); i_++)				\
+		sink_ += f((buf), (n));					\
+									\
+	(loops) / (now() - t_);						\
+})
+
+static void
+bench(uint8_t *buf, unsigned int loops)
+{
+	size_t size;
+	double simd, scalar;
+
+	printf("%-10s %6s %14s %16s %8s\n",
+	       "function", "bytes", "scalar [1/s]", "dispatched [1/s]",
+	       "speedup");
+	for (size = 128; size <= BUF_SIZE; size *= 4) {
+		scalar = TIME(csum_bytes_scalar, buf, size, loops);
+		simd = TIME(csum_bytes, buf, size, loops);
+		printf("%-10s %6zu %14.0f %16.0f %7.2fx\n",
+		       "csum_bytes", size, scalar, simd, simd / scalar);
+
+		scalar = TIME(csum16_scalar, buf, size / 2, loops);
+		simd = TIME(csum16, buf, size / 2, loops);
+		printf("%-10s %6zu %14.0f %16.0f %7.2fx\n",
+		       "csum16", size, scalar, simd, simd / scalar);
+
+		scalar = TIME(csum32_scalar, buf, size / 4, loops);
+		simd = TIME(csum32, buf, size / 4, loops);
+		printf("%-10s %6zu %14.0f %16.0f %7.2fx\n",
+		       "csum32", size, scalar, simd, simd / scalar);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	int c, ret;
+	unsigned int rounds = 10000, loops = 100000;
+	uint8_t *buf;
+
+	while ((c = getopt(argc, argv, "r:n:s:h")) != -1) {
+		switch (c) {
+		case 'r':
+			rounds = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'n':
+			loops = strtoul(optarg, NULL, 0);
+			break;
+
+		case 's':
+			srandom(strtoul(optarg, NULL, 0));
+			break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-r ROUNDS] [-n LOOPS] "
+				"[-s SEED]\n"
+				"Checks ROUNDS random buffers (default 10000) "
+				"and times LOOPS checksums (default 100000)\n"
+				"per function and size.\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (!(buf = malloc(BUF_SIZE + 16)))
+		return 1;
+
+	printf("checksum implementation: %s\n", csum_impl_name());
+	if ((ret = check(buf, rounds)) && loops)
+		bench(buf, loops);
+
+	free(buf);
+	return !ret;
+}
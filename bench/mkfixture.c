@@ -0,0 +1,894 @@
+/*
+ * Copyright (C) 2004-2010  Heinz Mauelshagen, Red Hat GmbH.
+ *                          All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * Synthetic RAID fixture generator.
+ *
+ * Writes sparse device image files plus their serial numbers carrying
+ * the metadata of RAID sets in a given format into a directory, which
+ * "dmraid --replay" discovers, groups and (with --dm_mock) activates
+ * like real disks. The on-disk layouts come from the format handler
+ * headers and the checksums get calculated with the library helpers,
+ * so the fixtures follow the handlers as they change.
+ *
+ * Partition tables (format "dos") are discovered on activated RAID sets
+ * only, which the device-mapper mock doesn't hold data for, hence
+ * there's no generator for them.
+ */
+
+#include <endian.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include "internal.h"
+
+#define	FORMAT_HANDLER
+#include "format/ataraid/asr.h"
+#define	FORMAT_HANDLER
+#include "format/ddf/ddf1.h"
+#define	FORMAT_HANDLER
+#include "format/ataraid/hpt37x.h"
+#define	FORMAT_HANDLER
+#include "format/ataraid/hpt45x.h"
+#define	FORMAT_HANDLER
+#include "format/ataraid/isw.h"
+#define	FORMAT_HANDLER
+#include "format/ataraid/jm.h"
+#define	FORMAT_HANDLER
+#include "format/ataraid/lsi.h"
+#define	FORMAT_HANDLER
+#include "format/ataraid/nv.h"
+#define	FORMAT_HANDLER
+#include "format/ataraid/pdc.h"
+#define	FORMAT_HANDLER
+#include "format/ataraid/sil.h"
+#define	FORMAT_HANDLER
+#include "format/ataraid/via.h"
+
+/* Sectors kept clear of data for the metadata at the end of devices. */
+#define	RESERVED	4096
+#define	STRIDE_SHIFT	7
+#define	STRIDE		(1 << STRIDE_SHIFT)
+
+/* Fixture default device size: 1GB. */
+#define	SECTORS		(2 * 1024 * 1024)
+
+enum level { L_LINEAR, L_RAID0, L_RAID1, L_RAID5, L_RAID10, L_NONE };
+static const char *levels[] = { "linear", "0", "1", "5", "10" };
+
+/* Members supported at a RAID level. */
+struct level_spec {
+	enum level level;
+	unsigned int min, max;
+};
+
+struct fixture;
+struct fixture_format {
+	const char *name;
+	int (*write)(struct fixture *f);
+	struct level_spec levels[L_NONE + 1];
+};
+
+struct fixture {
+	struct fixture_format *fmt;
+	enum level level;
+	unsigned int sets, members;
+	uint64_t sectors;	/* Device size. */
+	uint64_t usable;	/* Data sectors on each member. */
+
+	/* Device being written. */
+	unsigned int set, member;
+	int fd;
+};
+
+/* Identifier of the set being written, unique in the fixture. */
+static uint32_t
+set_id(struct fixture *f)
+{
+	return 0xd300 + f->set;
+}
+
+/* Identifier of disk @member of the set being written. */
+static uint32_t
+disk_id(struct fixture *f, unsigned int member)
+{
+	return (set_id(f) << 8 | member) << 4;
+}
+
+/* Size of the set being written. */
+static uint64_t
+set_sectors(struct fixture *f)
+{
+	switch (f->level) {
+	case L_RAID1:
+		return f->usable;
+
+	case L_RAID5:
+		return f->usable * (f->members - 1);
+
+	case L_RAID10:
+		return f->usable * (f->members / 2);
+
+	default:
+		return f->usable * f->members;
+	}
+}
+
+/* Write @size bytes of metadata to @sector of the device. */
+static int
+put(struct fixture *f, const void *buf, size_t size, uint64_t sector)
+{
+	if (pwrite(f->fd, buf, size, sector << 9) == (ssize_t) size)
+		return 1;
+
+	perror("writing metadata");
+	return 0;
+}
+
+/*
+ * Adaptec HostRAID: big endian reserved block in the last sector
+ * referencing the RAID table ahead of it, which holds the logical drive
+ * and its physical components.
+ */
+static int
+asr_fixture(struct fixture *f)
+{
+	unsigned int i;
+	uint8_t type = f->level == L_RAID1 ? ASR_RAID1 : ASR_RAID0;
+	uint64_t table = f->sectors - 1 - RTBLBLOCKS;
+	struct asr_reservedblock rb;
+	struct asr_raidtable rt;
+	struct asr_raid_configline *cl = rt.ent;
+
+	memset(&rb, 0, sizeof(rb));
+	rb.b0idcode = htobe32(B0RESRVD);
+	rb.smagic = htobe32(SVALID);
+	rb.resver = RBLOCK_VER;
+	rb.drivemagic = htobe32(disk_id(f, f->member));
+	rb.raidtbl = htobe32(table);
+
+	/* Version 2 tables aren't checksummed. */
+	memset(&rt, 0, sizeof(rt));
+	rt.ridcode = htobe32(RVALID2);
+	rt.rversion = htobe32(2);
+	rt.maxelm = htobe16(RCTBL_MAX_ENTRIES);
+	rt.elmcnt = htobe16(f->members + 1);
+	rt.elmsize = htobe16(sizeof(*rt.ent));
+
+	cl->raidcnt = htobe16(f->members);
+	cl->raidmagic = htobe32(set_id(f));
+	cl->raidlevel = FWL;
+	cl->raidtype = type;
+	cl->raidstate = LSU_COMPONENT_STATE_OPTIMAL;
+	cl->lcapcty = htobe32(set_sectors(f));
+	cl->strpsize = htobe16(STRIDE);
+	snprintf((char *) cl->name, ASR_NAMELEN, "Set%u", f->set);
+
+	for (i = 0; i < f->members; i++) {
+		cl = rt.ent + i + 1;
+		cl->raidcnt = htobe16(1);
+		cl->raidseq = htobe16(i);
+		cl->raidmagic = htobe32(disk_id(f, i));
+		cl->raidlevel = FWP;
+		cl->raidtype = type;
+		cl->raidstate = LSU_COMPONENT_STATE_OPTIMAL;
+		cl->raidid = htobe32(i);
+		cl->lcapcty = htobe32(f->usable);
+		cl->strpsize = htobe16(STRIDE);
+	}
+
+	return put(f, &rb, sizeof(rb), f->sectors - 1) &&
+	       put(f, &rt, sizeof(rt), table);
+}
+
+/* CRC32 as used by DDF1; callers set the CRC field to all ones. */
+static uint32_t
+ddf1_crc(void *buf, size_t size)
+{
+	unsigned int i;
+	uint8_t *p = buf;
+	uint32_t r = 0xFFFFFFFF;
+
+	while (size--) {
+		r ^= *p++;
+		for (i = 0; i < 8; i++)
+			r = (r >> 1) ^ (r & 1 ? 0xEDB88320 : 0);
+	}
+
+	return r ^ 0xFFFFFFFF;
+}
+
+/*
+ * SNIA DDF1: little endian anchor header in the last sector referencing
+ * the primary header, disk data, physical and virtual drive records and
+ * one VD configuration record ahead of it.
+ */
+#define	DDF1_DRIVES	8
+#define	DDF1_BLOCKS	8	/* Header, disk data, 2 PD, 2 VD, 2 CR */
+static void
+ddf1_guid(uint8_t *guid, const char *what, uint32_t id)
+{
+	char buf[DDF1_GUID_LENGTH + 1];
+
+	snprintf(buf, sizeof(buf), "DMRAID %-8s %08X", what, id);
+	memcpy(guid, buf, DDF1_GUID_LENGTH);
+}
+
+static int
+ddf1_fixture(struct fixture *f)
+{
+	unsigned int i;
+	uint64_t table = f->sectors - 1 - DDF1_BLOCKS;
+	uint64_t buf[DDF1_BLOCKS * DDF1_BLKSIZE / sizeof(uint64_t)];
+	uint8_t *b = (uint8_t *) buf;
+	struct ddf1_header anchor, *h = (void *) b;
+	struct ddf1_disk_data *dd = (void *) (b + DDF1_BLKSIZE);
+	struct ddf1_phys_drives *pdh = (void *) (b + 2 * DDF1_BLKSIZE);
+	struct ddf1_phys_drive *pd = (void *) (pdh + 1);
+	struct ddf1_virt_drives *vdh = (void *) (b + 4 * DDF1_BLKSIZE);
+	struct ddf1_virt_drive *vd = (void *) (vdh + 1);
+	struct ddf1_config_record *cr = (void *) (b + 6 * DDF1_BLKSIZE);
+	uint32_t *ids = (uint32_t *) (cr + 1);
+	uint64_t *offsets = (uint64_t *) (ids + DDF1_DRIVES);
+	static uint8_t raid_levels[] = {
+		DDF1_CONCAT, DDF1_RAID0, DDF1_RAID1, DDF1_RAID5,
+	};
+
+	memset(buf, 0, sizeof(buf));
+	h->signature = DDF1_HEADER;
+	ddf1_guid(h->guid, "HEADER", set_id(f));
+	memcpy(h->ddf_rev, DDF1_VER_STRING, DDF1_REV_LENGTH);
+	h->seqnum = 1;
+	h->primary_table_lba = table;
+	h->secondary_table_lba = ~0ULL;
+	h->max_phys_drives = DDF1_DRIVES;
+	h->max_virt_drives = DDF1_DRIVES;
+	h->max_partitions = 1;
+	h->vd_config_record_len = 2;
+	h->max_primary_elements = DDF1_DRIVES;
+	h->adapter_data_offset = DDF1_INVALID;
+	h->disk_data_offset = 1;
+	h->disk_data_len = 1;
+	h->phys_drive_offset = 2;
+	h->phys_drive_len = 2;
+	h->virt_drive_offset = 4;
+	h->virt_drive_len = 2;
+	h->config_record_offset = 6;
+	h->config_record_len = 2;
+	h->badblock_offset = DDF1_INVALID;
+	h->diag_offset = DDF1_INVALID;
+	h->vendor_offset = DDF1_INVALID;
+
+	dd->signature = DDF1_FORCED_PD_GUID;
+	ddf1_guid(dd->guid, "DISK", disk_id(f, f->member));
+	dd->reference = disk_id(f, f->member);
+
+	pdh->signature = DDF1_PHYS_DRIVE_REC;
+	pdh->num_drives = f->members;
+	pdh->max_drives = DDF1_DRIVES;
+	for (i = 0; i < f->members; i++, pd++) {
+		ddf1_guid(pd->guid, "DISK", disk_id(f, i));
+		pd->reference = disk_id(f, i);
+		pd->state = 0x01;	/* Online. */
+		pd->size = f->usable;
+	}
+
+	vdh->signature = DDF1_VIRT_DRIVE_REC;
+	vdh->num_drives = 1;
+	vdh->max_drives = DDF1_DRIVES;
+	ddf1_guid(vd->guid, "VD", set_id(f));
+	snprintf((char *) vd->name, sizeof(vd->name), "Set%u", f->set);
+
+	cr->signature = DDF1_VD_CONFIG_REC;
+	ddf1_guid(cr->guid, "VD", set_id(f));
+	cr->seqnum = 1;
+	cr->primary_element_count = f->members;
+	cr->stripe_size = STRIDE_SHIFT;
+	cr->raid_level = raid_levels[f->level];
+	cr->raid_qualifier = f->level == L_RAID5 ? DDF1_RAID5_LA : 0;
+	cr->secondary_element_count = 1;
+	cr->sectors = f->usable;
+	cr->size = set_sectors(f);
+	for (i = 0; i < DDF1_DRIVES; i++) {
+		ids[i] = i < f->members ? disk_id(f, i) : DDF1_INVALID;
+		offsets[i] = 0;
+	}
+
+	h->crc = DDF1_INVALID;
+	h->crc = ddf1_crc(h, sizeof(*h));
+	dd->crc = DDF1_INVALID;
+	dd->crc = ddf1_crc(dd, DDF1_BLKSIZE);
+	pdh->crc = DDF1_INVALID;
+	pdh->crc = ddf1_crc(pdh, 2 * DDF1_BLKSIZE);
+	vdh->crc = DDF1_INVALID;
+	vdh->crc = ddf1_crc(vdh, 2 * DDF1_BLKSIZE);
+	cr->crc = DDF1_INVALID;
+	cr->crc = ddf1_crc(cr, 2 * DDF1_BLKSIZE);
+
+	anchor = *h;
+	anchor.header_type = 0;
+	anchor.crc = DDF1_INVALID;
+	anchor.crc = ddf1_crc(&anchor, sizeof(anchor));
+
+	return put(f, buf, sizeof(buf), table) &&
+	       put(f, &anchor, sizeof(anchor), f->sectors - 1);
+}
+
+/* Highpoint 37x: metadata in sector 9. */
+static int
+hpt37x_fixture(struct fixture *f)
+{
+	struct hpt37x hpt;
+	static uint8_t types[] = {
+		HPT37X_T_SPAN, HPT37X_T_RAID0, HPT37X_T_RAID1,
+	};
+
+	memset(&hpt, 0, sizeof(hpt));
+	hpt.magic = HPT37X_MAGIC_OK;
+	hpt.magic_0 = hpt.magic_1 = set_id(f);
+	hpt.order = HPT_O_OK;
+	hpt.raid_disks = f->members;
+	hpt.raid0_shift = STRIDE_SHIFT;
+	hpt.type = types[f->level];
+	hpt.disk_number = f->member;
+	hpt.total_secs = set_sectors(f);
+
+	return put(f, &hpt, sizeof(hpt), 9);
+}
+
+/* Highpoint 45x: metadata 11 sectors off the end; RAID10 as 2 stripes. */
+static int
+hpt45x_fixture(struct fixture *f)
+{
+	struct hpt45x hpt;
+	unsigned int disks = f->level == L_RAID10 ?
+			     f->members / 2 : f->members;
+	static uint8_t types[] = {
+		HPT45X_T_SPAN, HPT45X_T_RAID0, HPT45X_T_RAID1,
+		0, HPT45X_T_RAID0,
+	};
+
+	memset(&hpt, 0, sizeof(hpt));
+	hpt.magic = HPT45X_MAGIC_OK;
+	hpt.magic_0 = hpt.magic_1 = set_id(f);
+	hpt.type = types[f->level];
+	hpt.raid_disks = disks;
+	hpt.disk_number = f->member % disks;
+	hpt.raid0_shift = STRIDE_SHIFT;
+	hpt.total_secs = f->level == L_RAID1 ?
+			 f->usable : f->usable * disks;
+	if (f->level == L_RAID10) {
+		hpt.raid1_type = HPT45X_T_RAID1;
+		hpt.raid1_raid_disks = 2;
+		hpt.raid1_disk_number = f->member / disks;
+		hpt.raid1_shift = STRIDE_SHIFT;
+	}
+
+	return put(f, &hpt, sizeof(hpt), f->sectors - 11);
+}
+
+/*
+ * Serial numbers identify Intel disks, so all fixture devices get them.
+ * Keep them at most MAX_RAID_SERIAL_LEN characters long.
+ */
+static void
+serial(struct fixture *f, unsigned int member, char *buf, size_t len)
+{
+	snprintf(buf, len, "DMFX%08X", disk_id(f, member));
+}
+
+/*
+ * Intel Software RAID: metadata in the second to last sector; the
+ * sectors beyond the first of larger ones precede it.
+ */
+static int
+isw_fixture(struct fixture *f)
+{
+	int ret;
+	unsigned int i;
+	size_t blocks, size;
+	struct isw *isw;
+	struct isw_dev *dev;
+	struct isw_map *map;
+	static uint8_t raid_levels[] = {
+		0, ISW_T_RAID0, ISW_T_RAID1, ISW_T_RAID5, ISW_T_RAID1,
+	};
+
+	size = struct_offset(isw, disk) +
+	       f->members * sizeof(struct isw_disk) +
+	       sizeof(*dev) + (f->members - 1) * sizeof(*map->disk_ord_tbl);
+	blocks = div_up(size, ISW_DISK_BLOCK_SIZE);
+	if (!(isw = calloc(blocks, ISW_DISK_BLOCK_SIZE)))
+		return 0;
+
+	memcpy(isw->sig, MPB_SIGNATURE, MPB_SIGNATURE_SIZE);
+	/* MPB_VERSION_RAID5 or MPB_VERSION_MUL_VOLS */
+	memcpy(isw->sig + MPB_SIGNATURE_SIZE,
+	       mpb_versions[f->level == L_RAID5 ? 5 : 3], MPB_VERSION_LENGTH);
+	isw->mpb_size = size;
+	isw->family_num = isw->orig_family_num = set_id(f);
+	isw->generation_num = 1;
+	isw->num_disks = f->members;
+	isw->num_raid_devs = 1;
+
+	for (i = 0; i < f->members; i++) {
+		serial(f, i, (char *) isw->disk[i].serial,
+		       sizeof(isw->disk[i].serial));
+		isw->disk[i].totalBlocks = f->sectors;
+		isw->disk[i].scsiId = UNKNOWN_SCSI_ID;
+		isw->disk[i].status = CONFIG_ON_DISK | USABLE_DISK |
+				      CONFIGURED_DISK;
+		isw->disk[i].owner_cfg_num = set_id(f);
+	}
+
+	dev = (struct isw_dev *) (isw->disk + f->members);
+	snprintf((char *) dev->volume, sizeof(dev->volume), "Set%u", f->set);
+	dev->SizeLow = set_sectors(f);
+	dev->SizeHigh = set_sectors(f) >> 32;
+
+	map = dev->vol.map;
+	map->blocks_per_member = f->usable;
+	map->num_data_stripes = f->usable / STRIDE;
+	map->blocks_per_strip = STRIDE;
+	map->map_state = ISW_T_STATE_NORMAL;
+	map->raid_level = raid_levels[f->level];
+	map->num_members = f->members;
+	map->num_domains = map->raid_level == ISW_T_RAID1 ? 2 : 1;
+	map->failed_disk_num = ISW_DEV_NONE_FAILED;
+	map->ddf = 1;
+	for (i = 0; i < f->members; i++)
+		map->disk_ord_tbl[i] = i;
+
+	isw->check_sum = csum32(isw, size / sizeof(uint32_t));
+
+	ret = put(f, isw, ISW_DISK_BLOCK_SIZE, f->sectors - 2) &&
+	      (blocks < 2 ||
+	       put(f, (uint8_t *) isw + ISW_DISK_BLOCK_SIZE,
+		   (blocks - 1) * ISW_DISK_BLOCK_SIZE,
+		   f->sectors - 1 - blocks));
+	free(isw);
+	return ret;
+}
+
+/* JMicron: metadata in the last sector; 16 bit checksum sums up to 0. */
+static int
+jm_fixture(struct fixture *f)
+{
+	unsigned int i;
+	struct jm jm;
+	static uint8_t modes[] = { JM_T_JBOD, JM_T_RAID0, JM_T_RAID1, };
+
+	memset(&jm, 0, sizeof(jm));
+	memcpy(jm.signature, JM_SIGNATURE, JM_SIGNATURE_LEN);
+	jm.version = 1;
+	jm.identity = disk_id(f, f->member);
+	jm.segment.range = f->usable / (32 * 2048);
+	jm.segment.range2 = f->usable % (32 * 2048);
+	snprintf((char *) jm.name, JM_NAME_LEN, "Set%u", f->set);
+	jm.mode = modes[f->level];
+	jm.block = STRIDE_SHIFT - 1;
+	for (i = 0; i < f->members; i++)
+		jm.member[i] = disk_id(f, i);
+
+	jm.checksum = -csum16(&jm, 64);
+	return put(f, &jm, sizeof(jm), f->sectors - 1);
+}
+
+/* LSI Logic MegaRAID: metadata in the last sector. */
+static int
+lsi_fixture(struct fixture *f)
+{
+	unsigned int i;
+	struct lsi lsi;
+
+	memset(&lsi, 0, sizeof(lsi));
+	memcpy(lsi.magic_name, LSI_MAGIC_NAME, LSI_MAGIC_NAME_LEN);
+	lsi.type = f->level == L_RAID1 ? LSI_T_RAID1 : LSI_T_RAID0;
+	lsi.stride = STRIDE;
+	for (i = 0; i < f->members; i++) {
+		lsi.disks[i].magic_0 = set_id(f);
+		lsi.disks[i].magic_1 = i;
+		lsi.disks[i].disk_number = i;
+	}
+
+	lsi.disk_number = f->member;
+	lsi.set_id = set_id(f);
+
+	return put(f, &lsi, sizeof(lsi), f->sectors - 1);
+}
+
+/*
+ * NVidia MediaShield: metadata in the second to last sector;
+ * 32 bit checksum sums up to 0.
+ */
+static int
+nv_fixture(struct fixture *f)
+{
+	unsigned int width;
+	struct nv nv;
+	static uint32_t raid_levels[] = {
+		NV_LEVEL_JBOD, NV_LEVEL_0, NV_LEVEL_1,
+		NV_LEVEL_5_SYM, NV_LEVEL_1_0,
+	};
+
+	switch (f->level) {
+	case L_RAID1:
+		width = 1;
+		break;
+
+	case L_RAID5:
+		width = f->members - 1;
+		break;
+
+	case L_RAID10:
+		width = f->members / 2;
+		break;
+
+	default:
+		width = f->members;
+	}
+
+	memset(&nv, 0, sizeof(nv));
+	memcpy(nv.vendor, NV_ID_STRING, sizeof(NV_ID_STRING) - 1);
+	nv.size = sizeof(nv) / sizeof(uint32_t);
+	nv.version = NV_VERSION;
+	nv.unitNumber = f->member;
+	nv.capacity = set_sectors(f);
+	nv.sectorSize = NV_SECTOR_SIZE;
+	nv.array.version = 0x640000 + sizeof(nv.array);
+	nv.array.signature[0] = set_id(f);
+	nv.array.raidJobCode = NV_IDLE;
+	nv.array.stripeWidth = nv.array.originalWidth = width;
+	nv.array.totalVolumes = f->members;
+	nv.array.raidLevel = nv.array.originalLevel = raid_levels[f->level];
+	nv.array.stripeBlockSize = STRIDE;
+	nv.array.stripeBlockByteSize = STRIDE << 9;
+	nv.array.stripeBlockPower = STRIDE_SHIFT;
+	nv.array.stripeMask = STRIDE - 1;
+	nv.array.stripeSize = STRIDE * width;
+	nv.array.stripeByteSize = nv.array.stripeSize << 9;
+	nv.array.originalCapacity = nv.capacity;
+
+	nv.chksum = -csum32(&nv, nv.size);
+	return put(f, &nv, sizeof(nv), f->sectors - 2);
+}
+
+/*
+ * Promise FastTrak: metadata 63 sectors off the end; 4 and 6 disk
+ * RAID1 sets are RAID10 ones striping the first and second half.
+ */
+static int
+pdc_fixture(struct fixture *f)
+{
+	unsigned int i;
+	struct pdc pdc;
+	static uint8_t types[] = {
+		PDC_T_SPAN, PDC_T_RAID0, PDC_T_RAID1, 0, PDC_T_RAID1,
+	};
+
+	memset(&pdc, 0, sizeof(pdc));
+	memcpy(pdc.promise_id, PDC_MAGIC, PDC_ID_LENGTH);
+	pdc.magic_0 = pdc.raid.magic_0 = set_id(f);
+	pdc.magic_1 = pdc.raid.magic_1 = set_id(f);
+	pdc.raid.disk_number = f->member;
+	pdc.raid.disk_secs = f->usable;
+	pdc.raid.type = types[f->level];
+	pdc.raid.total_disks = f->members;
+	pdc.raid.raid0_shift = STRIDE_SHIFT;
+	pdc.raid.raid0_disks = f->level == L_RAID10 ?
+			       f->members / 2 : f->members;
+	pdc.raid.array_number = f->set;
+	pdc.raid.total_secs = set_sectors(f);
+	for (i = 0; i < f->members; i++) {
+		pdc.raid.disk[i].magic_0 = set_id(f);
+		pdc.raid.disk[i].disk_number = i;
+	}
+
+	pdc.checksum = csum32(&pdc, 511);
+	return put(f, &pdc, sizeof(pdc), f->sectors - 63);
+}
+
+/*
+ * Silicon Image Medley: 4 metadata copies 512 sectors apart off the end;
+ * the creation time makes up the set name.
+ */
+static int
+sil_fixture(struct fixture *f)
+{
+	unsigned int i;
+	struct sil sil;
+	static uint8_t types[] = { SIL_T_JBOD, SIL_T_RAID0, SIL_T_RAID1, };
+
+	memset(&sil, 0, sizeof(sil));
+	sil.magic = SIL_MAGIC;
+	sil.major_ver = 2;
+	sil.array_sectors_low = set_sectors(f);
+	sil.array_sectors_high = set_sectors(f) >> 32;
+	sil.thisdisk_sectors = f->usable;
+	sil.year = 10;
+	sil.month = 1;
+	sil.day = 1;
+	sil.hour = f->set / 3600 % 24;
+	sil.minutes = f->set / 60 % 60;
+	sil.seconds = f->set % 60;
+	sil.raid0_stride = STRIDE;
+	sil.disk_number = f->member;
+	sil.type = types[f->level];
+	sil.drives_per_striped_set = f->members;
+	sil.drives_per_mirrored_set = f->members;
+	sil.mirrored_set_state = SIL_OK;
+
+	sil.checksum1 = -csum16(&sil, struct_offset(sil, checksum1) / 2);
+	for (i = 0; i < 4; i++) {
+		if (!put(f, &sil, sizeof(sil), f->sectors - 1 - i * 512))
+			return 0;
+	}
+
+	return 1;
+}
+
+/* VIA Software RAID: metadata in the last sector. */
+static int
+via_fixture(struct fixture *f)
+{
+	unsigned int i;
+	struct via via;
+	static uint8_t types[] = { VIA_T_SPAN, VIA_T_RAID0, VIA_T_RAID1, };
+
+	memset(&via, 0, sizeof(via));
+	via.signature = VIA_SIGNATURE;
+	via.version_number = 1;
+	via.array.disk.in_disk_array = 1;
+	via.array.disk.raid_type = types[f->level];
+	/* Index into stripes or 0 for the mirror source, 2 for its mirror. */
+	via.array.disk.raid_type_info = f->level == L_RAID1 ?
+					(f->member ? 2 : 0) : f->member;
+	/* Stride 8 << 4 sectors. */
+	via.array.disk_array_ex = (STRIDE_SHIFT - 3) << 4 | f->members;
+	via.array.capacity_low = set_sectors(f);
+	via.array.capacity_high = set_sectors(f) >> 32;
+	for (i = 0; i < f->members; i++)
+		via.serial_checksum[i] = disk_id(f, i);
+
+	via.checksum = csum_bytes(&via, 50);
+	return put(f, &via, sizeof(via), f->sectors - 1);
+}
+
+static struct fixture_format formats[] = {
+	{ "asr", asr_fixture,
+	  { { L_RAID0, 1, 8 }, { L_RAID1, 2, 2 }, { L_NONE } } },
+	{ "ddf1", ddf1_fixture,
+	  { { L_LINEAR, 1, 8 }, { L_RAID0, 1, 8 }, { L_RAID1, 2, 2 },
+	    { L_RAID5, 3, 8 }, { L_NONE } } },
+	{ "hpt37x", hpt37x_fixture,
+	  { { L_LINEAR, 1, 8 }, { L_RAID0, 1, 8 }, { L_RAID1, 2, 2 },
+	    { L_NONE } } },
+	{ "hpt45x", hpt45x_fixture,
+	  { { L_LINEAR, 1, 8 }, { L_RAID0, 1, 8 }, { L_RAID1, 2, 2 },
+	    { L_RAID10, 4, 8 }, { L_NONE } } },
+	{ "isw", isw_fixture,
+	  { { L_RAID0, 1, 8 }, { L_RAID1, 2, 2 }, { L_RAID5, 3, 8 },
+	    { L_RAID10, 4, 4 }, { L_NONE } } },
+	{ "jm", jm_fixture,
+	  { { L_LINEAR, 1, 8 }, { L_RAID0, 1, 8 }, { L_RAID1, 2, 2 },
+	    { L_NONE } } },
+	{ "lsi", lsi_fixture,
+	  { { L_RAID0, 2, 2 }, { L_RAID1, 2, 2 }, { L_NONE } } },
+	{ "nv", nv_fixture,
+	  { { L_LINEAR, 1, 8 }, { L_RAID0, 1, 8 }, { L_RAID1, 2, 2 },
+	    { L_RAID5, 3, 8 }, { L_RAID10, 4, 8 }, { L_NONE } } },
+	{ "pdc", pdc_fixture,
+	  { { L_LINEAR, 1, 7 }, { L_RAID0, 1, 7 }, { L_RAID1, 2, 2 },
+	    { L_RAID10, 4, 6 }, { L_NONE } } },
+	{ "sil", sil_fixture,
+	  { { L_LINEAR, 1, 8 }, { L_RAID0, 1, 8 }, { L_RAID1, 2, 2 },
+	    { L_NONE } } },
+	{ "via", via_fixture,
+	  { { L_LINEAR, 1, 7 }, { L_RAID0, 1, 7 }, { L_RAID1, 2, 2 },
+	    { L_NONE } } },
+};
+
+static struct fixture_format *
+find_format(const char *name)
+{
+	struct fixture_format *fmt;
+
+	for (fmt = formats; fmt < ARRAY_END(formats); fmt++) {
+		if (!strcmp(fmt->name, name))
+			return fmt;
+	}
+
+	return NULL;
+}
+
+static struct level_spec *
+find_level(struct fixture_format *fmt, enum level level)
+{
+	struct level_spec *l;
+
+	for (l = fmt->levels; l->level != L_NONE; l++) {
+		if (l->level == level)
+			return l;
+	}
+
+	return NULL;
+}
+
+/* List formats with their levels and member counts. */
+static void
+list_fixtures(void)
+{
+	struct fixture_format *fmt;
+	struct level_spec *l;
+
+	for (fmt = formats; fmt < ARRAY_END(formats); fmt++) {
+		printf("%s", fmt->name);
+		for (l = fmt->levels; l->level != L_NONE; l++)
+			printf(" %s:%u-%u", levels[l->level], l->min, l->max);
+
+		putchar('\n');
+	}
+}
+
+/* Name devices sda..sdz, sdaa.. like the kernel does. */
+static void
+dev_name(unsigned int n, char *buf, size_t len)
+{
+	char suffix[8], *p = suffix + sizeof(suffix);
+
+	*--p = 0;
+	do
+		*--p = 'a' + n % 26;
+	while ((n = n / 26) && n-- && p > suffix);
+
+	snprintf(buf, len, "sd%s", p);
+}
+
+/* Create device image @n with the metadata of the current member. */
+static int
+write_device(struct fixture *f, const char *dir, unsigned int n)
+{
+	int fd, ret = 0;
+	char name[16], path[PATH_MAX], buf[MAX_RAID_SERIAL_LEN + 2];
+
+	dev_name(n, name, sizeof(name));
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	if ((f->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+		perror(path);
+		return 0;
+	}
+
+	if (ftruncate(f->fd, f->sectors << 9))
+		perror(path);
+	else
+		ret = f->fmt->write(f);
+
+	close(f->fd);
+	if (!ret)
+		return 0;
+
+	snprintf(path, sizeof(path), "%s/%s.serial", dir, name);
+	serial(f, f->member, buf, sizeof(buf) - 1);
+	strcat(buf, "\n");
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0 ||
+	    write(fd, buf, strlen(buf)) != (ssize_t) strlen(buf)) {
+		perror(path);
+		ret = 0;
+	}
+
+	if (fd > -1)
+		close(fd);
+
+	return ret;
+}
+
+static void
+usage(const char *cmd)
+{
+	fprintf(stderr,
+		"Usage: %s -f FORMAT [-l LEVEL] [-s SETS] [-m MEMBERS] "
+		"[-S SECTORS] DIRECTORY\n"
+		"       %s -L\n"
+		"Writes device images holding SETS RAID sets of MEMBERS "
+		"devices each\n(defaults: 1 set, 2 members, RAID level 0, "
+		"%u sectors per device)\nin FORMAT for dmraid --replay "
+		"into DIRECTORY.\n"
+		"-L lists the formats with their levels and member counts.\n",
+		cmd, cmd, SECTORS);
+}
+
+int
+main(int argc, char **argv)
+{
+	int c;
+	unsigned int n = 0;
+	char *dir;
+	struct level_spec *l;
+	struct fixture f = {
+		.level = L_RAID0,
+		.sets = 1,
+		.members = 2,
+		.sectors = SECTORS,
+	};
+
+	while ((c = getopt(argc, argv, "f:l:s:m:S:Lh")) != -1) {
+		switch (c) {
+		case 'f':
+			if (!(f.fmt = find_format(optarg))) {
+				fprintf(stderr, "%s: unknown format \"%s\"\n",
+					argv[0], optarg);
+				return 1;
+			}
+			break;
+
+		case 'l':
+			for (f.level = 0; f.level < L_NONE; f.level++) {
+				if (!strcmp(optarg, levels[f.level]))
+					break;
+			}
+			break;
+
+		case 's':
+			f.sets = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'm':
+			f.members = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'S':
+			f.sectors = strtoull(optarg, NULL, 0);
+			break;
+
+		case 'L':
+			list_fixtures();
+			return 0;
+
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!f.fmt || optind != argc - 1 || !f.sets) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!(l = find_level(f.fmt, f.level)) ||
+	    f.members < l->min || f.members > l->max ||
+	    (f.level == L_RAID10 && f.members % 2)) {
+		fprintf(stderr, "%s: %s doesn't support %u members at "
+			"RAID level %s (see -L)\n", argv[0], f.fmt->name,
+			f.members, f.level < L_NONE ? levels[f.level] : "?");
+		return 1;
+	}
+
+	if (f.sectors < 4 * RESERVED) {
+		fprintf(stderr, "%s: devices need at least %u sectors\n",
+			argv[0], 4 * RESERVED);
+		return 1;
+	}
+
+	/* Stripe aligned, capped to what 32 bit metadata fields hold. */
+	f.usable = min(f.sectors - RESERVED, 0xFFFFFFFFULL / f.members);
+	f.usable -= f.usable % 2048;
+
+	dir = argv[optind];
+	if (mkdir(dir, 0755) && errno != EEXIST) {
+		perror(dir);
+		return 1;
+	}
+
+	for (f.set = 0; f.set < f.sets; f.set++) {
+		for (f.member = 0; f.member < f.members; f.member++) {
+			if (!write_device(&f, dir, n++))
+				return 1;
+		}
+	}
+
+	return 0;
+}
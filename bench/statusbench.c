@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2004-2010  Heinz Mauelshagen, Red Hat GmbH.
+ *                          All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * Device-mapper status parser fuzzer and benchmark.
+ *
+ * Feeds generated status lines of the striped, mirror, raid45 and raid
+ * targets (plus raid table lines) to dm_status_parse() and
+ * dm_status_raid_devs(): valid ones must parse into what was generated,
+ * randomly mutated and random ones must be rejected or parse into
+ * consistent results. Each line gets parsed in a buffer of its exact
+ * size, so memory checkers (eg, valgrind or -fsanitize=address) catch
+ * reads beyond it. Parsing valid lines gets timed afterwards.
+ */
+
+#include <getopt.h>
+#include <stdarg.h>
+#include <time.h>
+#include "internal.h"
+
+#define	LINE_SIZE	(DM_STATUS_MAX_DEVS * 24 + 128)
+
+/* A generated status line and the table line for raid targets. */
+struct line {
+	const char *target;
+	unsigned int devs;
+	char health[DM_STATUS_MAX_DEVS + 1];
+	char status[LINE_SIZE];
+	char table[LINE_SIZE];
+};
+
+static const char *target_types[] = { "striped", "mirror", "raid45", "raid" };
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Append a printf formatted string to @buf. */
+static void
+append(char *buf, const char *fmt, ...)
+{
+	size_t len = strlen(buf);
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(buf + len, LINE_SIZE - len, fmt, ap);
+	va_end(ap);
+}
+
+/* Generate a valid status line of a random target. */
+static void
+generate(struct line *l)
+{
+	unsigned int i;
+	uint64_t total = 1 + random() % 1000000, sync = random() % (total + 1);
+	static const char healths[] = "AD";
+
+	l->target = target_types[random() % ARRAY_SIZE(target_types)];
+	l->devs = 1 + random() % DM_STATUS_MAX_DEVS;
+	for (i = 0; i < l->devs; i++)
+		l->health[i] = healths[!(random() % 8)];
+
+	l->health[i] = 0;
+	*l->status = *l->table = 0;
+
+	if (!strcmp(l->target, "raid")) {
+		append(l->status, "raid5_ls %u %s %llu/%llu %s 0", l->devs,
+		       l->health, (unsigned long long) sync,
+		       (unsigned long long) total,
+		       sync < total ? "recover" : "idle");
+		append(l->table, "raid5_ls 1 128 %u", l->devs);
+		for (i = 0; i < l->devs; i++)
+			append(l->table, " - 253:%u", i);
+
+		return;
+	}
+
+	append(l->status, "%u", l->devs);
+	for (i = 0; i < l->devs; i++)
+		append(l->status, " 253:%u", i);
+
+	if (!strcmp(l->target, "mirror"))
+		append(l->status, " %llu/%llu 1 %s 3 disk 253:99 A",
+		       (unsigned long long) sync, (unsigned long long) total,
+		       l->health);
+	else
+		append(l->status, " 1 %s", l->health);
+}
+
+/* Randomly flip, delete, duplicate or truncate characters. */
+static void
+mutate(char *buf)
+{
+	unsigned int n = 1 + random() % 4;
+	size_t len, pos;
+	static const char chars[] = " /:-0123456789ADRSUa\t";
+
+	while (n--) {
+		if (!(len = strlen(buf)))
+			return;
+
+		pos = random() % len;
+		switch (random() % 5) {
+		case 0:
+			buf[pos] = chars[random() % (sizeof(chars) - 1)];
+			break;
+
+		case 1:
+			buf[pos] = 1 + random() % 255;
+			break;
+
+		case 2:
+			memmove(buf + pos, buf + pos + 1, len - pos);
+			break;
+
+		case 3:
+			if (len + 1 < LINE_SIZE) {
+				memmove(buf + pos + 1, buf + pos, len - pos + 1);
+				buf[pos] = chars[random() % (sizeof(chars) - 1)];
+			}
+			break;
+
+		default:
+			buf[pos] = 0;
+		}
+	}
+}
+
+/* Fill @buf with random printable characters. */
+static void
+random_line(char *buf)
+{
+	size_t i, len = random() % 256;
+
+	for (i = 0; i < len; i++)
+		buf[i] = ' ' + random() % 95;
+
+	buf[len] = 0;
+}
+
+/* Duplicate @s into a buffer of its exact size. */
+static char *
+dup_exact(const char *s)
+{
+	size_t len = strlen(s) + 1;
+	char *r = malloc(len);
+
+	if (r)
+		memcpy(r, s, len);
+
+	return r;
+}
+
+/* Check that parsed device names lie in @buf of @len bytes. */
+static int
+names_inside(struct dm_status *st, const char *buf, size_t len)
+{
+	unsigned int i;
+
+	if (st->num_devs > DM_STATUS_MAX_DEVS)
+		return 0;
+
+	for (i = 0; i < st->num_devs; i++) {
+		if (st->devs[i].name &&
+		    (st->devs[i].name < buf || st->devs[i].name >= buf + len))
+			return 0;
+	}
+
+	return 1;
+}
+
+struct counts {
+	unsigned long accepted, rejected, errors;
+};
+
+/*
+ * Parse @l with @status and @table (possibly mutated) in exact size
+ * buffers. @valid lines must reproduce @l.
+ */
+static void
+parse(struct line *l, const char *status, const char *table, int valid,
+      struct counts *c)
+{
+	int ok;
+	unsigned int i;
+	char *s = dup_exact(status), *t = dup_exact(table);
+	struct dm_status st;
+
+	if (!s || !t)
+		goto out;
+
+	ok = dm_status_parse(l->target, s, &st) &&
+	     (st.target != DM_STATUS_RAID || dm_status_raid_devs(t, &st));
+	if (!ok) {
+		c->rejected++;
+		if (valid) {
+			fprintf(stderr, "rejected valid %s status \"%s\"\n",
+				l->target, status);
+			c->errors++;
+		}
+
+		goto out;
+	}
+
+	c->accepted++;
+	if (!names_inside(&st, st.target == DM_STATUS_RAID ? t : s,
+			  strlen(st.target == DM_STATUS_RAID ?
+				 table : status) + 1)) {
+		fprintf(stderr, "inconsistent parse of %s status \"%s\"\n",
+			l->target, status);
+		c->errors++;
+		goto out;
+	}
+
+	if (!valid)
+		goto out;
+
+	if (st.num_devs != l->devs)
+		goto mismatch;
+
+	for (i = 0; i < l->devs; i++) {
+		if (!st.devs[i].name ||
+		    st.devs[i].health != (l->health[i] == 'A' ?
+					  DM_HEALTH_ALIVE : DM_HEALTH_DEAD))
+			goto mismatch;
+	}
+
+	goto out;
+
+   mismatch:
+	fprintf(stderr, "wrong parse of %s status \"%s\"\n",
+		l->target, status);
+	c->errors++;
+   out:
+	free(s);
+	free(t);
+}
+
+/* Fuzz the parser with @rounds lines of each kind. */
+static int
+fuzz(unsigned int rounds)
+{
+	unsigned int i;
+	char status[LINE_SIZE], table[LINE_SIZE];
+	struct line l;
+	struct counts valid = { 0 }, mutated = { 0 }, garbage = { 0 };
+
+	for (i = 0; i < rounds; i++) {
+		generate(&l);
+		parse(&l, l.status, l.table, 1, &valid);
+
+		strcpy(status, l.status);
+		strcpy(table, l.table);
+		if (random() % 2)
+			mutate(status);
+		else
+			mutate(table);
+
+		parse(&l, status, table, 0, &mutated);
+
+		random_line(status);
+		random_line(table);
+		parse(&l, status, table, 0, &garbage);
+	}
+
+	printf("%-8s %10s %10s %8s\n", "lines", "accepted", "rejected",
+	       "errors");
+	printf("%-8s %10lu %10lu %8lu\n", "valid",
+	       valid.accepted, valid.rejected, valid.errors);
+	printf("%-8s %10lu %10lu %8lu\n", "mutated",
+	       mutated.accepted, mutated.rejected, mutated.errors);
+	printf("%-8s %10lu %10lu %8lu\n", "random",
+	       garbage.accepted, garbage.rejected, garbage.errors);
+
+	return !(valid.errors + mutated.errors + garbage.errors);
+}
+
+/*
+ * Time parsing @loops valid lines per target. Parsing splits lines in
+ * place, so each gets copied first; copying is timed separately.
+ */
+static void
+bench(unsigned int loops)
+{
+	unsigned int i, t;
+	double copy, start, t_parse;
+	char buf[LINE_SIZE], tbuf[LINE_SIZE];
+	struct line l;
+	struct dm_status st;
+
+	printf("%-8s %5s %14s %10s\n", "target", "devs", "lines [1/s]",
+	       "ns/line");
+	for (t = 0; t < ARRAY_SIZE(target_types); t++) {
+		/* Typical set size. */
+		do
+			generate(&l);
+		while (strcmp(l.target, target_types[t]) || l.devs > 8);
+
+		start = now();
+		for (i = 0; i < loops; i++) {
+			strcpy(buf, l.status);
+			strcpy(tbuf, l.table);
+		}
+		copy = now() - start;
+
+		start = now();
+		for (i = 0; i < loops; i++) {
+			strcpy(buf, l.status);
+			strcpy(tbuf, l.table);
+			if (!dm_status_parse(l.target, buf, &st) ||
+			    (st.target == DM_STATUS_RAID &&
+			     !dm_status_raid_devs(tbuf, &st)))
+				break;
+		}
+
+		if ((t_parse = now() - start - copy) <= 0)
+			t_parse = 1e-9;
+
+		printf("%-8s %5u %14.0f %10.1f\n", l.target, l.devs,
+		       loops / t_parse, t_parse * 1e9 / loops);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	int c, ret;
+	unsigned int rounds = 100000, loops = 1000000;
+
+	while ((c = getopt(argc, argv, "r:n:s:h")) != -1) {
+		switch (c) {
+		case 'r':
+			rounds = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'n':
+			loops = strtoul(optarg, NULL, 0);
+			break;
+
+		case 's':
+			srandom(strtoul(optarg, NULL, 0));
+			break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-r ROUNDS] [-n LOOPS] "
+				"[-s SEED]\n"
+				"Parses ROUNDS valid, mutated and random status "
+				"lines each (default 100000)\n"
+				"and times LOOPS valid lines per target "
+				"(default 1000000).\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if ((ret = fuzz(rounds)) && loops)
+		bench(loops);
+
+	return !ret;
+}
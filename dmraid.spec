@@ -103,6 +103,7 @@ rm -rf $RPM_BUILD_ROOT
 /sbin/dmraid.static
 %{_libdir}/libdmraid.so*
 %{_libdir}/libdmraid-events-isw.so*
+%{_libdir}/libdmraid-events.so
 /var/lock/dmraid
 
 %files -n dmraid-devel
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2004-2010  Heinz Mauelshagen, Red Hat GmbH.
+ *                          All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * Device-mapper target status line parsing for the
+ * striped, mirror, raid45 and raid targets and
+ * rebuild progress derived from it.
+ */
+
+#ifndef _DM_STATUS_H_
+#define _DM_STATUS_H_
+
+#include <stdint.h>
+
+#define	DM_STATUS_MAX_DEVS	64
+
+enum dm_status_target {
+	DM_STATUS_STRIPED,
+	DM_STATUS_MIRROR,
+	DM_STATUS_RAID45,
+	DM_STATUS_RAID,
+};
+
+enum dm_status_health {
+	DM_HEALTH_ALIVE,	/* 'A' */
+	DM_HEALTH_DEAD,		/* 'D' */
+	DM_HEALTH_READ_ERROR,	/* 'R' (mirror) */
+	DM_HEALTH_NOSYNC,	/* 'S' (mirror), 'a' (raid) */
+	DM_HEALTH_UNKNOWN,	/* 'U' (mirror) or anything else */
+};
+
+struct dm_status_dev {
+	const char *name;	/* major:minor; NULL if not in status. */
+	enum dm_status_health health;
+};
+
+/*
+ * Parsed status line. Strings point into the parsed
+ * line, which gets split into words in place.
+ */
+struct dm_status {
+	enum dm_status_target target;
+	const char *raid_type;		/* raid target only. */
+	const char *sync_action;	/* raid target only; may be NULL. */
+	uint64_t sync, total;		/* Resync progress; total 0 if none. */
+
+	struct {
+		const char *type;	/* "core", "disk", ...; NULL if none. */
+		const char *dev;	/* NULL for core log. */
+		enum dm_status_health health;
+	} log;				/* mirror target only. */
+
+	unsigned int num_devs;
+	struct dm_status_dev devs[DM_STATUS_MAX_DEVS];
+};
+
+extern int dm_status_parse(const char *target_type, char *params,
+			   struct dm_status *st);
+extern int dm_status_raid_devs(char *params, struct dm_status *st);
+
+/* Resynchronization progress of a mapped RAID set. */
+struct rebuild_progress {
+	uint64_t sync;		/* Sectors in sync. */
+	uint64_t total;		/* Sectors mapped. */
+	uint64_t rate;		/* Sectors per second; 0 if unknown. */
+	int64_t eta;		/* Seconds to completion; -1 if unknown. */
+};
+
+struct lib_context;
+struct raid_set;
+extern int rebuild_progress(struct lib_context *lc, struct raid_set *rs,
+			    struct rebuild_progress *p);
+
+#endif
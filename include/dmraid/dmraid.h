@@ -23,6 +23,7 @@
 #include <dmraid/metadata.h>
 #include <dmraid/reconfig.h>
 #include <dmraid/dmreg.h>
+#include <dmraid/dm_status.h>
 
 /*
  * Retrieve version identifiers.
@@ -33,8 +33,9 @@ enum fmt_type {
 /* Event: I/O error */
 struct event_io {
 	struct raid_set *rs;	/* RAID set of I/O error. */
-	struct raid_dev *rd;	/* RAID device of I/O error. */
+	struct raid_dev *rd;	/* RAID device of I/O error (NULL if gone). */
 	uint64_t sector;	/* Sector of the I/O error. */
+	struct raid_dev *member;	/* Member whose metadata to update. */
 };
 
 /* Event: RAID device add/remove */
@@ -49,6 +50,20 @@ struct event_rd {
 	enum rd_action action;
 };
 
+/*
+ * List of event handlers.
+ */
+struct event_handlers {
+	/*
+	 * Handle I/O error, called for each member of the set;
+	 * return 1 if the member's metadata got changed.
+	 */
+	int (*io) (struct lib_context * lc, struct event_io * e_io);
+
+	/* Handle RAID device add/remove. */
+	int (*rd) (struct lib_context * lc, struct event_rd * e_rd);
+};
+
 /*
  * Hot-spare search types list: it can be searched locally/globally 
  */
@@ -69,6 +84,8 @@ enum handler_commands {
 	GET_STATUS,
 	GET_DEVICE_IDX,
 	GET_NUMBER_OF_DEVICES,
+	UPDATE_REBUILD_CHECKPOINT,	/* info->data.u64: sectors in sync. */
+	GET_REBUILD_CHECKPOINT,
 	/* ... */
 };
 
@@ -90,6 +107,15 @@ struct handler_info {
 	} data;
 };
 
+/*
+ * Device area of @sectors starting at @sector;
+ * negative sectors count back from the end of the device.
+ */
+struct probe_area {
+	int64_t sector;
+	uint64_t sectors;
+};
+
 /*
  * Virtual interface definition of a metadata format handler.
  */
@@ -137,6 +163,11 @@ struct dmraid_format {
 				 enum handler_commands command,
 				 struct handler_info * info, void *ptr);
 
+	/*
+	 * Event handler functions (eg, for the events DSO).
+	 */
+	struct event_handlers *events;
+
 	/* 
 	 * Hot-spare disk search scope 
 	 */
@@ -146,6 +177,12 @@ struct dmraid_format {
 	 * Display RAID disk metadata native.
 	 */
 	void (*log) (struct lib_context * lc, struct raid_dev * rd);
+
+	/*
+	 * Metadata areas read() probes first on any device (eg, to
+	 * prefetch them); terminated by an area without sectors.
+	 */
+	const struct probe_area *probe;
 };
 
 /* Chain of registered format handlers (needed for library context). */
@@ -213,7 +250,8 @@ extern void *alloc_meta_areas(struct lib_context *lc, struct raid_dev *rd,
 extern void *alloc_private(struct lib_context *lc, const char *who,
 			   size_t size);
 extern void *alloc_private_and_read(struct lib_context *lc, const char *who,
-				    size_t size, char *path, loff_t offset);
+				    size_t size, struct dev_info *di,
+				    loff_t offset);
 extern struct raid_set *join_superset(struct lib_context *lc,
 				      char *(*f_name) (struct lib_context * lc,
 						       struct raid_dev * rd,
@@ -231,6 +269,13 @@ extern int write_metadata(struct lib_context *lc, const char *handler,
 			  struct raid_dev *rd, int meta_index, int erase);
 extern int log_zero_sectors(struct lib_context *lc, char *path,
 			    const char *handler);
+extern uint32_t csum_bytes(const void *buf, size_t len);
+extern uint16_t csum16(const void *buf, size_t words);
+extern uint32_t csum32(const void *buf, size_t words);
+extern uint32_t csum_bytes_scalar(const void *buf, size_t len);
+extern uint16_t csum16_scalar(const void *buf, size_t words);
+extern uint32_t csum32_scalar(const void *buf, size_t words);
+extern const char *csum_impl_name(void);
 
 #define	to_disk	to_cpu
 
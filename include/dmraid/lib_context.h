@@ -48,6 +48,12 @@ enum lc_options {
 	LC_REBUILD_DISK,
 	LC_HOT_SPARE_SET,
 	LC_IGNOREMONITORING,	/* Add new options below this one ! */
+	LC_DIRECT_IO,		/* Metadata I/O bypassing the page cache. */
+	LC_REPLAY,		/* Replay recorded metadata. */
+	LC_DUMP_ARCHIVE,	/* Dump metadata into one archive. */
+	LC_STATS,		/* Report statistics per processing phase. */
+	LC_DM_MOCK,		/* Keep mapped devices in memory. */
+	LC_REBUILD_BANDWIDTH,	/* Recovery bandwidth share in percent. */
 	LC_OPTIONS_SIZE,	/* Must be the last enumerator. */
 };
 
@@ -57,16 +63,22 @@ enum lc_options {
 #define	OPT_CREATE(lc)		(lc_opt(lc, LC_CREATE))
 #define	OPT_DEBUG(lc)		(lc_opt(lc, LC_DEBUG))
 #define	OPT_DEVICES(lc)		(lc_opt(lc, LC_DEVICES))
+#define	OPT_DIRECT_IO(lc)	(lc_opt(lc, LC_DIRECT_IO))
+#define	OPT_DM_MOCK(lc)		(lc_opt(lc, LC_DM_MOCK))
 #define	OPT_DUMP(lc)		(lc_opt(lc, LC_DUMP))
+#define	OPT_DUMP_ARCHIVE(lc)	(lc_opt(lc, LC_DUMP_ARCHIVE))
 #define	OPT_FORMAT(lc)		(lc_opt(lc, LC_FORMAT))
 #define	OPT_GROUP(lc)		(lc_opt(lc, LC_GROUP))
 #define OPT_HOT_SPARE_SET(lc)	(lc_opt(lc, LC_HOT_SPARE_SET))
 #define	OPT_IGNORELOCKING(lc)	(lc_opt(lc, LC_IGNORELOCKING))
 #define OPT_IGNOREMONITORING(lc) (lc_opt(lc, LC_IGNOREMONITORING))
 #define	OPT_PARTCHAR(lc)	(lc_opt(lc, LC_PARTCHAR))
+#define	OPT_REBUILD_BANDWIDTH(lc)	(lc_opt(lc, LC_REBUILD_BANDWIDTH))
 #define OPT_REBUILD_DISK(lc)	(lc_opt(lc, LC_REBUILD_DISK))
+#define	OPT_REPLAY(lc)		(lc_opt(lc, LC_REPLAY))
 #define	OPT_SEPARATOR(lc)	(lc_opt(lc, LC_SEPARATOR))
 #define	OPT_SETS(lc)		(lc_opt(lc, LC_SETS))
+#define	OPT_STATS(lc)		(lc_opt(lc, LC_STATS))
 #define	OPT_TEST(lc)		(lc_opt(lc, LC_TEST))
 #define	OPT_VERBOSE(lc)		(lc_opt(lc, LC_VERBOSE))
 
@@ -78,6 +90,10 @@ enum lc_options {
 #define	OPT_STR_PARTCHAR(lc)	OPT_STR(lc, LC_PARTCHAR)
 #define OPT_STR_HOT_SPARE_SET(lc)	OPT_STR(lc, LC_HOT_SPARE_SET)
 #define OPT_STR_REBUILD_DISK(lc)	OPT_STR(lc, LC_REBUILD_DISK)
+#define	OPT_STR_REPLAY(lc)	OPT_STR(lc, LC_REPLAY)
+#define	OPT_STR_DUMP_ARCHIVE(lc)	OPT_STR(lc, LC_DUMP_ARCHIVE)
+#define	OPT_STR_DM_MOCK(lc)	OPT_STR(lc, LC_DM_MOCK)
+#define	OPT_STR_REBUILD_BANDWIDTH(lc)	OPT_STR(lc, LC_REBUILD_BANDWIDTH)
 
 struct lib_version {
 	const char *text;
@@ -99,6 +115,9 @@ struct lib_options {
 	} arg;
 };
 
+struct dev_io;
+struct dm_backend;
+
 struct lib_context {
 	struct lib_version version;
 	char *cmd;
@@ -124,6 +143,26 @@ struct lib_context {
 	struct {
 		const char *error;	/* For error mappings. */
 	} path;
+
+	struct {
+		char *mp;		/* Cached sysfs mount point. */
+		int mp_searched;	/* Mount point looked up already. */
+		int block_fd;		/* Directory fd of <mp>/block. */
+	} sysfs;
+
+	const struct dev_io *io;	/* Device I/O backend. */
+	void *io_data;			/* Backend private data. */
+
+	const struct dm_backend *dm;	/* Device-mapper backend. */
+	void *dm_data;			/* Backend private data. */
+
+	void *dump;		/* Metadata dump archive being written. */
+
+	struct {
+		unsigned long reads;	/* Device read requests. */
+		unsigned long writes;	/* Device write requests. */
+		uint64_t bytes;		/* Bytes transferred. */
+	} io_stats;
 };
 
 
@@ -120,6 +120,19 @@ struct dev_info {
 	char *path;		/* Actual device node path. */
 	char *serial;		/* ATA/SCSI serial number. */
 	uint64_t sectors;	/* Device size. */
+
+	int fd;			/* Device kept open for metadata I/O. */
+	int fd_flags;		/* Access mode fd got opened with. */
+	int dirty;		/* Buffered writes not flushed yet. */
+	unsigned int lbs;	/* Logical block size (O_DIRECT only). */
+	unsigned int pbs;	/* Physical block size (O_DIRECT only). */
+	void *io_data;		/* I/O backend private data. */
+};
+
+/* Reference counted metadata buffer shared between meta_areas. */
+struct meta_buf {
+	void *ptr;		/* Allocation freed with the last reference. */
+	unsigned int ref;	/* # of meta_areas referencing it. */
 };
 
 /* Metadata areas and size stored on a RAID device. */
@@ -127,6 +140,7 @@ struct meta_areas {
 	uint64_t offset;	/* on disk metadata offset in sectors. */
 	size_t size;		/* on disk metadata size in bytes. */
 	void *area;		/* pointer to format specific metadata. */
+	struct meta_buf *buf;	/* Shared buffer area points into or NULL. */
 };
 
 /*
@@ -225,6 +239,9 @@ extern struct dev_info *alloc_dev_info(struct lib_context *lc, char *path);
 extern void free_dev_info(struct lib_context *lc, struct dev_info *di);
 extern struct raid_dev *alloc_raid_dev(struct lib_context *lc, const char *who);
 extern void free_raid_dev(struct lib_context *lc, struct raid_dev **rd);
+extern int share_meta_area(struct lib_context *lc, struct meta_areas *dst,
+			   struct meta_areas *src, size_t offset);
+extern void put_meta_area(struct lib_context *lc, struct meta_areas *ma);
 extern void list_add_sorted(struct lib_context *lc,
 			    struct list_head *to, struct list_head *new,
 			    int (*sort) (struct list_head * pos,
@@ -262,11 +279,16 @@ extern void process_sets(struct lib_context *lc,
 			 int (*func) (struct lib_context * lc, void *rs,
 				      int arg), int arg, enum set_type type);
 extern int write_set(struct lib_context *lc, void *rs);
+extern int commit_set(struct lib_context *lc, struct raid_set *rs);
 extern int partitioned_set(struct lib_context *lc, void *rs);
 extern int base_partitioned_set(struct lib_context *lc, void *rs);
 extern void discover_raid_devices(struct lib_context *lc, char **devices);
 extern void discover_partitions(struct lib_context *lc);
 extern int dso_get_members(struct lib_context *lc, int arg);
+extern int dso_event_io(struct lib_context *lc, const char *rs_name,
+			const char *dev_name, uint64_t sector);
+extern int dso_rebuild_checkpoint(struct lib_context *lc, const char *rs_name,
+				  uint64_t sector);
 extern unsigned int count_devices(struct lib_context *lc, enum dev_type type);
 extern enum status rd_status(struct states *states, unsigned int status,
 			     enum compare cmp);
@@ -37,6 +37,19 @@ extern int read_file(struct lib_context *lc, const char *who, char *path,
 extern int write_file(struct lib_context *lc, const char *who, char *path,
 		      void *buffer, size_t size, loff_t offset);
 
+struct dev_info;
+extern int dev_fd(struct lib_context *lc, struct dev_info *di, int flags);
+extern void dev_close(struct lib_context *lc, struct dev_info *di);
+extern void dev_prefetch(struct lib_context *lc, struct dev_info *di,
+			 loff_t offset, size_t size);
+extern int dev_read(struct lib_context *lc, const char *who,
+		    struct dev_info *di, void *buffer, size_t size,
+		    loff_t offset);
+extern int dev_write(struct lib_context *lc, const char *who,
+		     struct dev_info *di, void *buffer, size_t size,
+		     loff_t offset);
+extern int dev_sync(struct lib_context *lc, struct dev_info *di, int wait);
+
 extern int yes_no_prompt(struct lib_context *lc, const char *prompt, ...);
 
 extern void free_string(struct lib_context *lc, char **string);
@@ -408,63 +408,75 @@ rs_need_sync(struct raid_set *rs)
 }
 
 
+/*
+ * Retrieve the rebuild checkpoint of @rs from the metadata format handler,
+ * rounded down to a multiple of @align and less than @sectors.
+ *
+ * Everything below the checkpoint got rebuilt before, so that the RAID
+ * set gets mapped in two segments: the one below the checkpoint in sync
+ * and the one above it resynchronizing, thus resuming the rebuild.
+ */
+static uint64_t
+rebuild_checkpoint(struct lib_context *lc, struct raid_set *rs,
+		   uint64_t sectors, uint64_t align)
+{
+	struct raid_dev *rd;
+	struct handler_info info;
+
+	/* Stacked sets (eg. RAID10) keep their devices in the subsets. */
+	while (list_empty(&rs->devs) && !list_empty(&rs->sets))
+		rs = RS_RS(rs);
+
+	if (list_empty(&rs->devs))
+		return 0;
+
+	rd = RD_RS(rs);
+	info.data.u64 = 0;
+	if (!rd->fmt->metadata_handler ||
+	    !rd->fmt->metadata_handler(lc, GET_REBUILD_CHECKPOINT, &info, rs))
+		return 0;
+
+	info.data.u64 = info.data.u64 / align * align;
+	if (info.data.u64 >= sectors)
+		return 0;
+
+	if (info.data.u64)
+		log_notice(lc, "resuming rebuild of \"%s\" at sector %llu",
+			   rs->name, (unsigned long long) info.data.u64);
+
+	return info.data.u64;
+}
+
 /* Push begin of line onto a RAID1 table. */
 /* FIXME: persistent dirty log. */
 static int
 _dm_raid1_bol(struct lib_context *lc, char **table,
-	      struct raid_set *rs,
-	      uint64_t sectors, unsigned int mirrors, int need_sync)
+	      uint64_t start, uint64_t sectors, unsigned int region_size,
+	      unsigned int mirrors, int need_sync)
 {
 	/*
 	 * Append the flag/feature required for dmraid1
 	 * event handling in the kernel driver here for RHEL5.
 	 * In mainline, dm-raid1 handles it, in RHEL5, it's dm-log.
 	 */
-	return (p_fmt(lc, table, "0 %U %s core 2 %u %s %u",
-		      sectors, get_dm_type(lc, t_raid1),
-		      calc_region_size(lc, sectors),
+	return (p_fmt(lc, table, "%U %U %s core 2 %u %s %u",
+		      start, sectors, get_dm_type(lc, t_raid1), region_size,
 		      (need_sync) ? "sync" : "nosync", mirrors));
 }
 
+/* Push a RAID1 table line mapping @sectors from @start. */
 static int
-dm_raid1(struct lib_context *lc, char **table, struct raid_set *rs)
+_dm_raid1(struct lib_context *lc, char **table, struct raid_set *rs,
+	  uint64_t start, uint64_t sectors, unsigned int region_size,
+	  unsigned int mirrors, int need_sync, int rebuild_drive)
 {
-	int need_sync;
-	struct handler_info rebuild_drive;
-	uint64_t sectors = 0;
-	unsigned int mirrors = get_dm_devs(rs, 1);
 	struct raid_set *r, *swap_rs;
 	struct raid_dev *rd, *swap_rd;
 
-	switch (mirrors) {
-	case 0:
-		return 0;
-
-	case 1:
-		/*
-		 * In case we only have one mirror left,
-		 * a linear mapping will do.
-		 */
-		log_err(lc, "creating degraded mirror mapping for \"%s\"",
-			rs->name);
-		return dm_linear(lc, table, rs);
-	}
-
-	if (!(sectors = _smallest(lc, rs, 0)))
-		LOG_ERR(lc, 0, "can't find smallest mirror!");
-
-	/*
-	 * Get drive for reordering - copy is made from first
-	 * drive (i.e. the master) to the other mirrors.
-	 */
-	need_sync = rs_need_sync(rs);
-	rebuild_drive.data.i32 = -1;
-	if (need_sync && !get_rebuild_drive(lc, rs, &rebuild_drive))
+	if (!_dm_raid1_bol(lc, table, start, sectors, region_size,
+			   mirrors, need_sync))
 		return 0;
 
-	if (!_dm_raid1_bol(lc, table, rs, sectors, mirrors, need_sync))
-		goto err;
-
 	/* Stacked mirror sets. */
 	swap_rs = NULL;
 	list_for_each_entry(r, &rs->sets, list) {
@@ -473,17 +485,18 @@ dm_raid1(struct lib_context *lc, char **table, struct raid_set *rs)
 			char *path;
 
 			if (!(path = mkdm_path(lc, r->name)))
-				goto err;
+				return 0;
 
-			if (!rebuild_drive.data.i32 && !swap_rs)
+			if (!rebuild_drive && !swap_rs)
 				swap_rs = r;
 			else
-				ret = _dm_path_offset(lc, table, 1, path, 0);
+				ret = _dm_path_offset(lc, table, 1, path,
+						      start);
 
 			dbg_free(path);
 
 			if (!ret)
-				goto err;
+				return 0;
 		}
 	}
 
@@ -493,42 +506,90 @@ dm_raid1(struct lib_context *lc, char **table, struct raid_set *rs)
 		char *path;
 
 		if (!(path = mkdm_path(lc, swap_rs->name)))
-			goto err;
+			return 0;
 
-		ret = _dm_path_offset(lc, table, 1, path, 0);
+		ret = _dm_path_offset(lc, table, 1, path, start);
 		dbg_free(path);
 
 		if (!ret)
-			goto err;
+			return 0;
 	}
 
 	/* Lowest level mirror devices. */
 	swap_rd = NULL;
 	list_for_each_entry(rd, &rs->devs, devs) {
 		if (valid_rd(rd)) {
-			if (!rebuild_drive.data.i32 && !swap_rd)
+			if (!rebuild_drive && !swap_rd)
 				swap_rd = rd;
-			else if (!_dm_path_offset(lc, table, 1,
-						  rd->di->path, rd->offset))
-				goto err;
+			else if (!_dm_path_offset(lc, table, 1, rd->di->path,
+						  rd->offset + start))
+				return 0;
 		}
 	}
 
 	/* Add rebuild target to the end of the list. */
 	if (swap_rd && valid_rd(swap_rd))
 		if (!_dm_path_offset(lc, table, valid_rd(swap_rd),
-				     swap_rd->di->path, swap_rd->offset))
-			goto err;
+				     swap_rd->di->path,
+				     swap_rd->offset + start))
+			return 0;
 
 	/*
 	 * Append the flag/feature required for dmraid1
 	 * event handling in the kernel driver.
 	 */
-	if (p_fmt(lc, table, " 1 handle_errors"))
-		return 1;
+	return p_fmt(lc, table, " 1 handle_errors");
+}
 
-err:
-	return log_alloc_err(lc, __func__);
+static int
+dm_raid1(struct lib_context *lc, char **table, struct raid_set *rs)
+{
+	int need_sync;
+	struct handler_info rebuild_drive;
+	uint64_t sectors = 0, checkpoint = 0;
+	unsigned int mirrors = get_dm_devs(rs, 1), region_size;
+
+	switch (mirrors) {
+	case 0:
+		return 0;
+
+	case 1:
+		/*
+		 * In case we only have one mirror left,
+		 * a linear mapping will do.
+		 */
+		log_err(lc, "creating degraded mirror mapping for \"%s\"",
+			rs->name);
+		return dm_linear(lc, table, rs);
+	}
+
+	if (!(sectors = _smallest(lc, rs, 0)))
+		LOG_ERR(lc, 0, "can't find smallest mirror!");
+
+	/*
+	 * Get drive for reordering - copy is made from first
+	 * drive (i.e. the master) to the other mirrors.
+	 */
+	need_sync = rs_need_sync(rs);
+	rebuild_drive.data.i32 = -1;
+	if (need_sync && !get_rebuild_drive(lc, rs, &rebuild_drive))
+		return 0;
+
+	/* Resume an interrupted rebuild at its last checkpoint. */
+	region_size = calc_region_size(lc, sectors);
+	if (need_sync)
+		checkpoint = rebuild_checkpoint(lc, rs, sectors, region_size);
+
+	if ((checkpoint &&
+	     (!_dm_raid1(lc, table, rs, 0, checkpoint, region_size, mirrors,
+			 0, rebuild_drive.data.i32) ||
+	      !p_fmt(lc, table, "\n"))) ||
+	    !_dm_raid1(lc, table, rs, checkpoint, sectors - checkpoint,
+		       region_size, mirrors, need_sync,
+		       rebuild_drive.data.i32))
+		return log_alloc_err(lc, __func__);
+
+	return 1;
 }
 
 /*
@@ -539,23 +600,70 @@ err:
 /* FIXME: persistent dirty log. */
 static int
 _dm_raid45_bol(struct lib_context *lc, char **table, struct raid_set *rs,
-	       uint64_t sectors, unsigned int members)
+	       uint64_t start, uint64_t sectors, unsigned int members,
+	       int need_sync, int rebuild_drive)
 {
-	int need_sync = rs_need_sync(rs);
-	struct handler_info rebuild_drive;
+	unsigned int bandwidth = rebuild_bandwidth(lc, rs);
+
+	if (!p_fmt(lc, table, "%U %U %s core 2 %u %s %s ",
+		   start, sectors, get_dm_type(lc, rs->type),
+		   calc_region_size(lc,
+				    total_sectors(lc, rs) /
+				    _dm_raid_devs(lc, rs, 0)),
+		   (need_sync) ? "sync" : "nosync", get_type(lc, rs->type)))
+		return 0;
 
-	/* Get drive as rebuild target. */
-	rebuild_drive.data.i32 = -1;
-	if (need_sync && !get_rebuild_drive(lc, rs, &rebuild_drive))
+	/*
+	 * Variable parameters: chunk size, #stripes, io size,
+	 * recovery io size and recovery bandwidth; -1 for default.
+	 */
+	if (bandwidth ?
+	    !p_fmt(lc, table, "5 %u -1 -1 -1 %u", rs->stride, bandwidth) :
+	    !p_fmt(lc, table, "1 %u", rs->stride))
+		return 0;
+
+	return p_fmt(lc, table, " %u %d", members, rebuild_drive);
+}
+
+/*
+ * Push a RAID5 table line mapping @sectors from @start,
+ * which is @offset sectors into each member.
+ */
+static int
+_dm_raid45(struct lib_context *lc, char **table, struct raid_set *rs,
+	   uint64_t start, uint64_t sectors, uint64_t offset,
+	   unsigned int members, int need_sync, int rebuild_drive)
+{
+	int ret;
+	struct raid_dev *rd;
+	struct raid_set *r;
+
+	if (!_dm_raid45_bol(lc, table, rs, start, sectors, members,
+			    need_sync, rebuild_drive))
 		return 0;
 
-	return p_fmt(lc, table, "0 %U %s core 2 %u %s %s 1 %u %u %d",
-		     sectors, get_dm_type(lc, rs->type),
-		     calc_region_size(lc,
-				      total_sectors(lc, rs) /
-				      _dm_raid_devs(lc, rs, 0)),
-		     (need_sync) ? "sync" : "nosync", get_type(lc, rs->type),
-		     rs->stride, members, rebuild_drive.data.i32);
+	/* Stacked RAID sets (for RAID50 etc.) */
+	list_for_each_entry(r, &rs->sets, list) {
+		char *path;
+
+		if (!(path = mkdm_path(lc, r->name)))
+			return 0;
+
+		ret = _dm_path_offset(lc, table, valid_rs(r), path, offset);
+		dbg_free(path);
+
+		if (!ret)
+			return 0;
+	}
+
+	/* Lowest level RAID devices. */
+	list_for_each_entry(rd, &rs->devs, devs) {
+		if (!_dm_path_offset(lc, table, valid_rd(rd), 
+				     rd->di->path, rd->offset + offset))
+			return 0;
+	}
+
+	return 1;
 }
 
 /* Create "error target" name based on raid set name. */
@@ -653,12 +761,9 @@ static struct raid_dev *add_rd_dummy(struct lib_context *lc,
 		rd->meta_areas->size = area_size;
 		rd->meta_areas->offset = rd_ref->meta_areas->offset;     
 
-		rd->meta_areas->area = 
-				alloc_private(lc, rd->fmt->name, area_size);
-		if (!rd->meta_areas->area)
+		/* The dummy only ever reads the reference metadata. */
+		if (!share_meta_area(lc, rd->meta_areas, rd_ref->meta_areas, 0))
 			goto err;
-	    
-		memcpy(rd->meta_areas->area, rd_ref->meta_areas->area, area_size);
 	
 		list_add_tail(&rd->devs, rd_list);
 	}
@@ -672,11 +777,11 @@ err:
 static int
 dm_raid45(struct lib_context *lc, char **table, struct raid_set *rs)
 {
-	int ret;
-	uint64_t sectors = 0;
+	int need_sync;
+	struct handler_info rebuild_drive;
+	uint64_t sectors = 0, checkpoint = 0;
 	unsigned int members = get_dm_devs(rs, 0);
 	struct raid_dev *rd;
-	struct raid_set *r;
 	char *err_targ_path = NULL;
     
 	/* If one disk is missing create error target to replace it. */
@@ -750,29 +855,29 @@ dm_raid45(struct lib_context *lc, char **table, struct raid_set *rs)
 	 */
 	sectors *= members - 1;
 
-	if (!_dm_raid45_bol(lc, table, rs, sectors, members))
+	/* Get drive as rebuild target. */
+	need_sync = rs_need_sync(rs);
+	rebuild_drive.data.i32 = -1;
+	if (need_sync && !get_rebuild_drive(lc, rs, &rebuild_drive))
 		goto err;
 
-	/* Stacked RAID sets (for RAID50 etc.) */
-	list_for_each_entry(r, &rs->sets, list) {
-		char *path;
-
-		if (!(path = mkdm_path(lc, r->name)))
-			goto err;
-
-		ret = _dm_path_offset(lc, table, valid_rs(r), path, 0);
-		dbg_free(path);
-
-		if (!ret)
-			goto err;
-	}
-
-	/* Lowest level RAID devices. */
-	list_for_each_entry(rd, &rs->devs, devs) {
-		if (!_dm_path_offset(lc, table, valid_rd(rd), 
-				     rd->di->path, rd->offset))
-			goto err;
-	}
+	/*
+	 * Resume an interrupted rebuild at its last checkpoint, which needs
+	 * to be on a boundary of whole parity rotations for the second
+	 * segment to keep the layout of the set.
+	 */
+	if (need_sync)
+		checkpoint = rebuild_checkpoint(lc, rs, sectors,
+						(uint64_t) rs->stride *
+						(members - 1) * members);
+
+	if ((checkpoint &&
+	     (!_dm_raid45(lc, table, rs, 0, checkpoint, 0, members, 0, -1) ||
+	      !p_fmt(lc, table, "\n"))) ||
+	    !_dm_raid45(lc, table, rs, checkpoint, sectors - checkpoint,
+			checkpoint / (members - 1), members, need_sync,
+			rebuild_drive.data.i32))
+		goto err;
 
 	if (err_targ_path)
 		dbg_free(err_targ_path);
@@ -870,16 +975,35 @@ do_device(struct lib_context *lc, struct raid_set *rs, int (*f) ())
 	if (OPT_TEST(lc))
 		return 1;
 
+	/*
+	 * Formats with a metadata handler have their own DSO,
+	 * any other gets the generic one driving its event handlers.
+	 */
 	fmt = get_format(rs);
 	if (fmt->name) {
-		snprintf(lib_name, sizeof(lib_name), "libdmraid-events-%s.so",
-			 fmt->name);
+		if (fmt->metadata_handler)
+			snprintf(lib_name, sizeof(lib_name),
+				 "libdmraid-events-%s.so", fmt->name);
+		else
+			snprintf(lib_name, sizeof(lib_name),
+				 "libdmraid-events.so");
+
 		ret = f(rs->name, lib_name);
         }
 
 	return ret;
 }
 
+/* Does RAID set @rs get monitored? */
+static int
+monitored(struct lib_context *lc, struct raid_set *rs)
+{
+	struct dmraid_format *fmt = get_format(rs);
+
+	return !OPT_IGNOREMONITORING(lc) &&
+	       (fmt->metadata_handler || fmt->events);
+}
+
 static int
 register_device(struct lib_context *lc, struct raid_set *rs)
 {
@@ -950,15 +1074,13 @@ activate_subset(struct lib_context *lc, struct raid_set *rs, enum dm_what what)
 {
 	int ret = 0;
 	char *table = NULL;
-	struct dmraid_format *fmt = get_format(rs);
 
 	if (T_GROUP(rs))
 		return 1;
 
 	if (what == DM_REGISTER)
 #ifdef	DMRAID_AUTOREGISTER
-		return (!OPT_IGNOREMONITORING(lc) && fmt->metadata_handler) ?
-		       register_device(lc, rs) : 1;
+		return monitored(lc, rs) ? register_device(lc, rs) : 1;
 #else
 		return 1;
 #endif
@@ -1045,12 +1167,10 @@ deactivate_superset(struct lib_context *lc, struct raid_set *rs,
 		    enum dm_what what)
 {
 	int ret = 1, status;
-	struct dmraid_format *fmt = get_format(rs);
 
 	if (what == DM_REGISTER) {
 #ifdef	DMRAID_AUTOREGISTER
-		return (!OPT_IGNOREMONITORING(lc) && fmt->metadata_handler) ?
-			unregister_device(lc, rs) : 1;
+		return monitored(lc, rs) ? unregister_device(lc, rs) : 1;
 #else
 		return 1;
 #endif
@@ -1119,8 +1239,12 @@ change_set(struct lib_context *lc, enum activate_type what, void *v)
 
 	default:
 		log_err(lc, "%s: invalid activate type!", __func__);
-		ret = 0;
+		return 0;
 	}
 
+	/* Keep any rebuild bandwidth requested for later reloads. */
+	if (ret && what != A_DEACTIVATE && OPT_REBUILD_BANDWIDTH(lc))
+		ret = set_rebuild_bandwidth(lc, rs);
+
 	return ret;
 }
@@ -22,4 +22,7 @@ extern char *libdmraid_make_table(struct lib_context *lc, struct raid_set *rs);
 int change_set(struct lib_context *lc, enum activate_type what, void *rs);
 void delete_error_target(struct lib_context *lc, struct raid_set *rs);
 
+unsigned int rebuild_bandwidth(struct lib_context *lc, struct raid_set *rs);
+int set_rebuild_bandwidth(struct lib_context *lc, struct raid_set *rs);
+
 #endif
@@ -67,43 +67,46 @@ _exit_dm(struct dm_task *dmt)
 }
 
 /*
- * Retrieve list of registered mapping targets.
+ * Check a target's name against the ones registered
+ * with the device-mapper core.
  *
- * dm-library must get inititalized by caller.
+ * If we don't get the list of target types registered
+ * -> carry on and potentially fail on target addition.
  */
-static struct dm_versions *
-get_target_list(void)
+static int
+kernel_has_target(struct lib_context *lc, const char *ttype)
 {
+	int ret = 1;
 	struct dm_task *dmt;
+	struct dm_versions *t, *last;
+
+	_init_dm();
+	if ((dmt = dm_task_create(DM_DEVICE_LIST_VERSIONS)) &&
+	    dm_task_run(dmt) && (t = dm_task_get_versions(dmt))) {
+		/* Walk registered mapping target name list. */
+		ret = 0;
+		do {
+			if (!strcmp(ttype, t->name)) {
+				ret = 1;
+				break;
+			}
+
+			last = t;
+			t = (void *) t + t->next;
+		} while (last != t);
+	}
 
-	return (dmt = dm_task_create(DM_DEVICE_LIST_VERSIONS)) &&
-		dm_task_run(dmt) ? dm_task_get_versions(dmt) : NULL;
+	_exit_dm(dmt);
+	return ret;
 }
 
-/* Check a target's name against registered ones. */
+/* Check a target's name against the ones the backend supports. */
 static int
-valid_ttype(struct lib_context *lc, char *ttype, struct dm_versions *targets)
+valid_ttype(struct lib_context *lc, char *ttype)
 {
-	struct dm_versions *t, *last;
-
-	/*
-	 * If we don't have the list of target types registered
-	 * with the device-mapper core -> carry on and potentially
-	 * fail on target addition.
-	 */
-	if (!targets)
+	if (lc->dm->has_target(lc, ttype))
 		return 1;
 
-	/* Walk registered mapping target name list. */
-	t = targets;
-	do {
-		if (!strcmp(ttype, t->name))
-			return 1;
-
-		last = t;
-		t = (void *) t + t->next;
-	} while (last != t);
-
 	LOG_ERR(lc, 0,
 		"device-mapper target type \"%s\" is not in the kernel", ttype);
 }
@@ -113,8 +116,7 @@ valid_ttype(struct lib_context *lc, char *ttype, struct dm_versions *targets)
  * check that a target type is registered with the device-mapper core.
  */
 static int
-handle_table(struct lib_context *lc, struct dm_task *dmt,
-	     char *table, struct dm_versions *targets)
+handle_table(struct lib_context *lc, struct dm_task *dmt, char *table)
 {
 	int line = 0, n, ret = 0;
 	uint64_t start, size;
@@ -133,7 +135,7 @@ handle_table(struct lib_context *lc, struct dm_task *dmt,
 			   &start, &size, ttype, &n) < 3)
 			LOG_ERR(lc, 0, "Invalid format in table line %d", line);
 
-		if (!(ret = valid_ttype(lc, ttype, targets)))
+		if (!dmt && !(ret = valid_ttype(lc, ttype)))
 			break;
 
 		nl = remove_delimiter((p += n), '\n');
@@ -150,14 +152,14 @@ handle_table(struct lib_context *lc, struct dm_task *dmt,
 static int
 parse_table(struct lib_context *lc, struct dm_task *dmt, char *table)
 {
-	return handle_table(lc, dmt, table, NULL);
+	return handle_table(lc, dmt, table);
 }
 
 /* Check if a target type is not registered with the kernel after a failure. */
 static int
 check_table(struct lib_context *lc, char *table)
 {
-	return handle_table(lc, NULL, table, get_target_list());
+	return handle_table(lc, NULL, table);
 }
 
 /* Build a UUID for a dmraid device 
@@ -178,15 +180,9 @@ dmraid_uuid(struct lib_context *lc, struct raid_set *rs,
 
 /* Create a task, set its name and run it. */
 static int
-run_task(struct lib_context *lc, struct raid_set *rs, char *table, int type, char *name)
+run_task(struct lib_context *lc, char *table, int type, char *name,
+	 char *uuid)
 {
-	/*
-	 * DM_UUID_LEN is defined in dm-ioctl.h as 129 characters;
-	 * though not all 129 must be used (md uses just 16 from 
-	 * a quick review of md.c. 
-	 * We will be using: (len vol grp name)
-	 */
-	char uuid[DM_UUID_LEN];
 	int ret;
 	struct dm_task *dmt;
 
@@ -195,26 +191,221 @@ run_task(struct lib_context *lc, struct raid_set *rs, char *table, int type, cha
 	if (ret && table)
 		ret = parse_table(lc, dmt, table);
 
-	if (ret) {
-		if (DM_DEVICE_CREATE == type) {
-			ret = dmraid_uuid(lc, rs, uuid, DM_UUID_LEN, name) &&
-				dm_task_set_uuid(dmt, uuid) && dm_task_run(dmt);
-		} else
-			ret = dm_task_run(dmt);
+	if (ret && uuid)
+		ret = dm_task_set_uuid(dmt, uuid);
+
+	if (ret)
+		ret = dm_task_run(dmt);
+
+	_exit_dm(dmt);
+	return ret;
+}
+
+static int
+kernel_create(struct lib_context *lc, char *name, char *uuid, char *table)
+{
+	return run_task(lc, table, DM_DEVICE_CREATE, name, uuid);
+}
+
+static int
+kernel_reload(struct lib_context *lc, char *name, char *table)
+{
+	return run_task(lc, table, DM_DEVICE_RELOAD, name, NULL);
+}
+
+static int
+kernel_suspend(struct lib_context *lc, char *name)
+{
+	return run_task(lc, NULL, DM_DEVICE_SUSPEND, name, NULL);
+}
+
+static int
+kernel_resume(struct lib_context *lc, char *name)
+{
+	return run_task(lc, NULL, DM_DEVICE_RESUME, name, NULL);
+}
+
+static int
+kernel_remove(struct lib_context *lc, char *name)
+{
+	return run_task(lc, NULL, DM_DEVICE_REMOVE, name, NULL);
+}
+
+static int
+kernel_status(struct lib_context *lc, char *name)
+{
+	int ret;
+	struct dm_task *dmt;
+	struct dm_info info;
+
+	_init_dm();
+
+	/* Status <dev_name>. */
+	ret = (dmt = dm_task_create(DM_DEVICE_STATUS)) &&
+	      dm_task_set_name(dmt, name) &&
+	      dm_task_run(dmt) && dm_task_get_info(dmt, &info) && info.exists;
+	_exit_dm(dmt);
+	return ret;
+}
+
+/*
+ * Sum up resynchronization progress of all targets in sectors.
+ * Targets not reporting any (eg. striped, raid45) count as in sync.
+ */
+static int
+kernel_sync(struct lib_context *lc, char *name,
+	    uint64_t *sync, uint64_t *total)
+{
+	int ret = 0;
+	void *next = NULL;
+	uint64_t start, length;
+	char *ttype, *params;
+	struct dm_task *dmt;
+	struct dm_status st;
+
+	_init_dm();
+	*sync = *total = 0;
+	if ((dmt = dm_task_create(DM_DEVICE_STATUS)) &&
+	    dm_task_set_name(dmt, name) && dm_task_run(dmt)) {
+		do {
+			ttype = params = NULL;
+			next = dm_get_next_target(dmt, next, &start, &length,
+						  &ttype, &params);
+			*total += length;
+
+			/* Mirror status counts regions, raid sectors. */
+			if (ttype && params &&
+			    dm_status_parse(ttype, params, &st) && st.total) {
+				*sync += st.sync < st.total ?
+					 st.sync * (length / st.total) : length;
+				ret = 1;
+			} else
+				*sync += length;
+		} while (next);
 	}
 
 	_exit_dm(dmt);
 	return ret;
 }
 
+/* Send @msg to all targets of type @ttype. */
+static int
+kernel_message(struct lib_context *lc, char *name,
+	       const char *ttype, const char *msg)
+{
+	int ret = 0;
+	void *next = NULL;
+	uint64_t start, length;
+	char *type, *params;
+	struct dm_task *dmt, *msgt;
+
+	_init_dm();
+	if ((dmt = dm_task_create(DM_DEVICE_TABLE)) &&
+	    dm_task_set_name(dmt, name) && dm_task_run(dmt)) {
+		ret = 1;
+		do {
+			type = params = NULL;
+			next = dm_get_next_target(dmt, next, &start, &length,
+						  &type, &params);
+			if (!type || strcmp(type, ttype))
+				continue;
+
+			ret = (msgt = dm_task_create(DM_DEVICE_TARGET_MSG)) &&
+			      dm_task_set_name(msgt, name) &&
+			      dm_task_set_sector(msgt, start) &&
+			      dm_task_set_message(msgt, msg) &&
+			      dm_task_run(msgt) && ret;
+			if (msgt)
+				dm_task_destroy(msgt);
+		} while (next);
+	}
+
+	_exit_dm(dmt);
+	return ret;
+}
+
+static int
+kernel_version(struct lib_context *lc, char *version, size_t size)
+{
+	int ret;
+	struct dm_task *dmt;
+
+	_init_dm();
+
+	ret = (dmt = dm_task_create(DM_DEVICE_VERSION)) &&
+		dm_task_run(dmt) &&
+		dm_task_get_driver_version(dmt, version, size);
+	_exit_dm(dmt);
+	return ret;
+}
+
+/* dm-mirror module parameter throttling resynchronization. */
+#define	RESYNC_THROTTLE	"/module/dm_mirror/parameters/raid1_resync_throttle"
+
+static int
+kernel_resync_throttle(struct lib_context *lc, unsigned int percent)
+{
+	int ret = 0;
+	char *path;
+	FILE *f;
+
+	if (!(path = mk_sysfs_path(lc, RESYNC_THROTTLE)))
+		return 0;
+
+	if ((f = fopen(path, "w"))) {
+		ret = fprintf(f, "%u\n", percent) > 0;
+		ret = !fclose(f) && ret;
+	}
+
+	if (!ret)
+		log_err(lc, "writing %s; kernel without mirror resync "
+			"throttling or dm-mirror not loaded?", path);
+
+	dbg_free(path);
+	return ret;
+}
+
+const struct dm_backend kernel_dm = {
+	.name = "kernel",
+	.create = kernel_create,
+	.reload = kernel_reload,
+	.suspend = kernel_suspend,
+	.resume = kernel_resume,
+	.remove = kernel_remove,
+	.status = kernel_status,
+	.sync = kernel_sync,
+	.message = kernel_message,
+	.version = kernel_version,
+	.resync_throttle = kernel_resync_throttle,
+	.has_target = kernel_has_target,
+};
+
+/* Select the backend on first use, when options are known. */
+static const struct dm_backend *
+backend(struct lib_context *lc)
+{
+	if (!lc->dm)
+		lc->dm = OPT_DM_MOCK(lc) ? &mock_dm : &kernel_dm;
+
+	return lc->dm;
+}
+
 /* Create a mapped device. */
 int
 dm_create(struct lib_context *lc, struct raid_set *rs, char *table, char *name)
 {
+	/*
+	 * DM_UUID_LEN is defined in dm-ioctl.h as 129 characters;
+	 * though not all 129 must be used (md uses just 16 from 
+	 * a quick review of md.c. 
+	 * We will be using: (len vol grp name)
+	 */
+	char uuid[DM_UUID_LEN];
 	int ret;
 
 	/* Create <dev_name> */
-	ret = run_task(lc, rs, table, DM_DEVICE_CREATE, name);
+	ret = dmraid_uuid(lc, rs, uuid, DM_UUID_LEN, name) &&
+	      backend(lc)->create(lc, name, uuid, table);
 
 	/*
 	 * In case device creation failed, check if target
@@ -231,7 +422,7 @@ int
 dm_suspend(struct lib_context *lc, struct raid_set *rs)
 {
 	/* Suspend <dev_name> */
-	return run_task(lc, rs, NULL, DM_DEVICE_SUSPEND, rs->name);
+	return backend(lc)->suspend(lc, rs->name);
 }
 
 /* Resume a mapped device. */
@@ -239,7 +430,7 @@ int
 dm_resume(struct lib_context *lc, struct raid_set *rs)
 {
 	/* Resume <dev_name> */
-	return run_task(lc, rs, NULL, DM_DEVICE_RESUME, rs->name);
+	return backend(lc)->resume(lc, rs->name);
 }
 
 /* Reload a mapped device. */
@@ -249,7 +440,7 @@ dm_reload(struct lib_context *lc, struct raid_set *rs, char *table)
 	int ret;
 
 	/* Create <dev_name> */
-	ret = run_task(lc, rs, table, DM_DEVICE_RELOAD, rs->name);
+	ret = backend(lc)->reload(lc, rs->name, table);
 
 	/*
 	 * In case device creation failed, check if target
@@ -266,7 +457,7 @@ int
 dm_remove(struct lib_context *lc, struct raid_set *rs, char *name)
 {
 	/* Remove <dev_name> */
-	return run_task(lc, rs, NULL, DM_DEVICE_REMOVE, name);
+	return backend(lc)->remove(lc, name);
 }
 
 /* Retrieve status of a mapped device. */
@@ -274,35 +465,55 @@ dm_remove(struct lib_context *lc, struct raid_set *rs, char *name)
 int
 dm_status(struct lib_context *lc, struct raid_set *rs)
 {
-	int ret;
-	struct dm_task *dmt;
-	struct dm_info info;
+	return backend(lc)->status(lc, rs->name);
+}
 
-	_init_dm();
+/*
+ * Retrieve resynchronization progress of a mapped device in sectors.
+ *
+ * Return 1 if any of its targets reports progress.
+ */
+int
+dm_sync(struct lib_context *lc, struct raid_set *rs,
+	uint64_t *sync, uint64_t *total)
+{
+	*sync = *total = 0;
+	return backend(lc)->sync && backend(lc)->sync(lc, rs->name,
+						      sync, total);
+}
 
-	/* Status <dev_name>. */
-	ret = (dmt = dm_task_create(DM_DEVICE_STATUS)) &&
-	      dm_task_set_name(dmt, rs->name) &&
-	      dm_task_run(dmt) && dm_task_get_info(dmt, &info) && info.exists;
-	_exit_dm(dmt);
-	return ret;
+/* Send @msg to all targets of type @ttype of a mapped device. */
+int
+dm_message(struct lib_context *lc, struct raid_set *rs,
+	   const char *ttype, const char *msg)
+{
+	return backend(lc)->message &&
+	       backend(lc)->message(lc, rs->name, ttype, msg);
 }
 
 /* Retrieve device-mapper driver version. */
 int
 dm_version(struct lib_context *lc, char *version, size_t size)
 {
-	int ret;
-	struct dm_task *dmt;
-
 	/* Be prepared for device-mapper not in kernel. */
 	strncpy(version, "unknown", size);
+	return backend(lc)->version(lc, version, size);
+}
 
-	_init_dm();
+/* Throttle mirror resynchronization to @percent of the time. */
+int
+dm_resync_throttle(struct lib_context *lc, unsigned int percent)
+{
+	return backend(lc)->resync_throttle &&
+	       backend(lc)->resync_throttle(lc, percent);
+}
 
-	ret = (dmt = dm_task_create(DM_DEVICE_VERSION)) &&
-		dm_task_run(dmt) &&
-		dm_task_get_driver_version(dmt, version, size);
-	_exit_dm(dmt);
-	return ret;
+/* Release backend resources. */
+void
+dm_exit(struct lib_context *lc)
+{
+	if (lc->dm && lc->dm->exit)
+		lc->dm->exit(lc);
+
+	lc->dm = NULL;
 }
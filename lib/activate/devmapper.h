@@ -6,15 +6,57 @@
  */
 
 #ifndef _DEVMAPPER_H_
-#define _DEVMAPPER_H
+#define _DEVMAPPER_H_
+
+/*
+ * Device-mapper backend.
+ *
+ * All functions but version(), resync_throttle() and exit() take a
+ * mapped device name and return 1 on success and 0 on error; status()
+ * returns 1 if the device exists and has_target() 1 if the target type
+ * is available. message() sends a message to all targets of a type.
+ * resync_throttle() sets the percentage of time the mirror target may
+ * spend on resynchronization, which applies to all mirrors.
+ */
+struct dm_backend {
+	const char *name;
+
+	int (*create) (struct lib_context *lc, char *name, char *uuid,
+		       char *table);
+	int (*reload) (struct lib_context *lc, char *name, char *table);
+	int (*suspend) (struct lib_context *lc, char *name);
+	int (*resume) (struct lib_context *lc, char *name);
+	int (*remove) (struct lib_context *lc, char *name);
+	int (*status) (struct lib_context *lc, char *name);
+	int (*sync) (struct lib_context *lc, char *name,
+		     uint64_t *sync, uint64_t *total);
+	int (*message) (struct lib_context *lc, char *name,
+			const char *ttype, const char *msg);
+	int (*version) (struct lib_context *lc, char *version, size_t size);
+	int (*resync_throttle) (struct lib_context *lc, unsigned int percent);
+	int (*has_target) (struct lib_context *lc, const char *ttype);
+	void (*exit) (struct lib_context *lc);
+};
+
+/* Kernel device-mapper through libdevmapper (devmapper.c). */
+extern const struct dm_backend kernel_dm;
+
+/* Mapped devices kept in memory (dm_mock.c). */
+extern const struct dm_backend mock_dm;
 
 char *mkdm_path(struct lib_context *lc, const char *name);
 int dm_create(struct lib_context *lc, struct raid_set *rs, char *table, char *name);
 int dm_remove(struct lib_context *lc, struct raid_set *rs, char *name);
 int dm_status(struct lib_context *lc, struct raid_set *rs);
+int dm_sync(struct lib_context *lc, struct raid_set *rs,
+	    uint64_t *sync, uint64_t *total);
+int dm_message(struct lib_context *lc, struct raid_set *rs,
+	       const char *ttype, const char *msg);
 int dm_version(struct lib_context *lc, char *version, size_t size);
+int dm_resync_throttle(struct lib_context *lc, unsigned int percent);
 int dm_suspend(struct lib_context *lc, struct raid_set *rs);
 int dm_resume(struct lib_context *lc, struct raid_set *rs);
 int dm_reload(struct lib_context *lc, struct raid_set *rs, char *table);
+void dm_exit(struct lib_context *lc);
 
 #endif
@@ -0,0 +1,468 @@
+/*
+ * Copyright (C) 2004-2010  Heinz Mauelshagen, Red Hat GmbH.
+ *                          All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * Device-mapper mock (--dm_mock).
+ *
+ * Mapped devices and their tables are kept in memory instead of being
+ * created in the kernel, so that activation, reload and status logic
+ * can run without root. Operations can be delayed and failed on request:
+ *
+ *	--dm_mock=delay=USECS,fail=OP[/N],...,targets=TYPE[:TYPE...],sync=PCT
+ *
+ * delay adds USECS of latency to every operation. fail makes every Nth
+ * (default: every) operation OP fail, OP being one of create, reload,
+ * suspend, resume, remove, status, message, version or throttle.
+ * targets replaces the list of mapping target types the mock claims to
+ * support. sync makes table segments being resynchronized report PCT
+ * percent progress.
+ */
+
+#include "internal.h"
+#include "devmapper.h"
+
+enum mock_op {
+	MOCK_CREATE,
+	MOCK_RELOAD,
+	MOCK_SUSPEND,
+	MOCK_RESUME,
+	MOCK_REMOVE,
+	MOCK_STATUS,
+	MOCK_MESSAGE,
+	MOCK_VERSION,
+	MOCK_THROTTLE,
+	MOCK_OPS,		/* Must be the last enumerator. */
+};
+
+static const char *op_names[] = {
+	"create",
+	"reload",
+	"suspend",
+	"resume",
+	"remove",
+	"status",
+	"message",
+	"version",
+	"throttle",
+};
+
+/* Mapped device. */
+struct mock_dev {
+	struct list_head list;
+	char *name;
+	char *uuid;
+	char *table;		/* Live table. */
+	char *inactive;		/* Table loaded but not resumed yet. */
+	int suspended;
+};
+
+struct mock_dm {
+	struct list_head devs;
+	unsigned long delay;	/* Microseconds per operation. */
+	char *targets;		/* Colon separated target types. */
+	int error;		/* Invalid arguments -> fail everything. */
+	int sync;		/* Resync percentage; -1: no progress. */
+
+	struct {
+		unsigned int every;	/* Fail every Nth operation. */
+		unsigned int count;
+	} fail[MOCK_OPS];
+};
+
+#define	MOCK(lc)	((struct mock_dm *) (lc)->dm_data)
+#define	MOCK_TARGETS	"linear:striped:mirror:error:zero:raid45:raid"
+
+/* Parse one SPEC item. */
+static int
+parse_item(struct lib_context *lc, struct mock_dm *m, char *item)
+{
+	unsigned int op, every = 1;
+	char *arg = strchr(item, '='), *n;
+
+	if (!arg)
+		goto bad;
+
+	*arg++ = 0;
+	if (!strcmp(item, "delay")) {
+		if (sscanf(arg, "%lu", &m->delay) != 1)
+			goto bad;
+
+		return 1;
+	}
+
+	if (!strcmp(item, "sync")) {
+		if (sscanf(arg, "%d", &m->sync) != 1 ||
+		    m->sync < 0 || m->sync > 100)
+			goto bad;
+
+		return 1;
+	}
+
+	if (!strcmp(item, "targets")) {
+		if (m->targets)
+			dbg_free(m->targets);
+
+		return (m->targets = dbg_strdup(arg)) ?
+		       1 : log_alloc_err(lc, __func__);
+	}
+
+	if (strcmp(item, "fail"))
+		goto bad;
+
+	if ((n = strchr(arg, '/'))) {
+		*n++ = 0;
+		if (sscanf(n, "%u", &every) != 1 || !every)
+			goto bad;
+	}
+
+	for (op = 0; op < MOCK_OPS; op++) {
+		if (!strcmp(arg, op_names[op])) {
+			m->fail[op].every = every;
+			return 1;
+		}
+	}
+
+   bad:
+	LOG_ERR(lc, 0, "invalid device-mapper mock argument \"%s\"", item);
+}
+
+/* Set up the mock on first use. */
+static struct mock_dm *
+mock(struct lib_context *lc)
+{
+	const char *arg = OPT_STR_DM_MOCK(lc);
+	char *spec, *item, *next;
+	struct mock_dm *m;
+
+	if (MOCK(lc))
+		return MOCK(lc);
+
+	if (!(m = lc->dm_data = dbg_malloc(sizeof(*m)))) {
+		log_alloc_err(lc, __func__);
+		return NULL;
+	}
+
+	INIT_LIST_HEAD(&m->devs);
+	m->sync = -1;
+	if (!(spec = dbg_strdup(arg ? arg : ""))) {
+		log_alloc_err(lc, __func__);
+		m->error = 1;
+		return m;
+	}
+
+	for (item = spec; !m->error && item && *item; item = next) {
+		if ((next = strchr(item, ',')))
+			*next++ = 0;
+
+		m->error = !parse_item(lc, m, item);
+	}
+
+	dbg_free(spec);
+	return m;
+}
+
+/* Apply any latency and failure configured for @op. */
+static int
+mock_op(struct lib_context *lc, enum mock_op op, const char *name)
+{
+	struct mock_dm *m = mock(lc);
+
+	if (!m || m->error)
+		return 0;
+
+	if (m->delay)
+		usleep(m->delay);
+
+	if (m->fail[op].every &&
+	    !(++m->fail[op].count % m->fail[op].every)) {
+		log_info(lc, "device-mapper mock: failing %s of \"%s\"",
+			 op_names[op], name);
+		return 0;
+	}
+
+	return 1;
+}
+
+static struct mock_dev *
+find_dev(struct lib_context *lc, const char *name)
+{
+	struct mock_dev *dev;
+
+	list_for_each_entry(dev, &MOCK(lc)->devs, list) {
+		if (!strcmp(dev->name, name))
+			return dev;
+	}
+
+	return NULL;
+}
+
+static void
+free_dev(struct mock_dev *dev)
+{
+	list_del(&dev->list);
+	if (dev->name)
+		dbg_free(dev->name);
+
+	if (dev->uuid)
+		dbg_free(dev->uuid);
+
+	if (dev->table)
+		dbg_free(dev->table);
+
+	if (dev->inactive)
+		dbg_free(dev->inactive);
+
+	dbg_free(dev);
+}
+
+static int
+mock_has_target(struct lib_context *lc, const char *ttype)
+{
+	size_t len = strlen(ttype);
+	const char *t = MOCK(lc) && MOCK(lc)->targets ?
+			MOCK(lc)->targets : MOCK_TARGETS;
+
+	for (; t; t = strchr(t, ':') ? strchr(t, ':') + 1 : NULL) {
+		if (!strncmp(t, ttype, len) && (!t[len] || t[len] == ':'))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Like the kernel, refuse tables with unknown target types. */
+static int
+valid_table(struct lib_context *lc, char *table)
+{
+	char *p, ttype[32];
+
+	for (p = table; p; p = strchr(p, '\n') ? strchr(p, '\n') + 1 : NULL) {
+		if (!*p)
+			break;
+
+		*ttype = 0;
+		if (sscanf(p, "%*u %*u %31s", ttype) != 1 ||
+		    !mock_has_target(lc, ttype))
+			return 0;
+	}
+
+	return 1;
+}
+
+static int
+mock_create(struct lib_context *lc, char *name, char *uuid, char *table)
+{
+	struct mock_dev *dev;
+
+	if (!mock_op(lc, MOCK_CREATE, name) ||
+	    find_dev(lc, name) || !valid_table(lc, table))
+		return 0;
+
+	if (!(dev = dbg_malloc(sizeof(*dev))))
+		return log_alloc_err(lc, __func__);
+
+	list_add_tail(&dev->list, &MOCK(lc)->devs);
+	if (!(dev->name = dbg_strdup(name)) ||
+	    !(dev->uuid = dbg_strdup(uuid)) ||
+	    !(dev->table = dbg_strdup(table))) {
+		free_dev(dev);
+		return log_alloc_err(lc, __func__);
+	}
+
+	log_info(lc, "device-mapper mock: created \"%s\"", name);
+	return 1;
+}
+
+static int
+mock_reload(struct lib_context *lc, char *name, char *table)
+{
+	struct mock_dev *dev;
+
+	if (!mock_op(lc, MOCK_RELOAD, name) ||
+	    !(dev = find_dev(lc, name)) || !valid_table(lc, table))
+		return 0;
+
+	if (dev->inactive)
+		dbg_free(dev->inactive);
+
+	if (!(dev->inactive = dbg_strdup(table)))
+		return log_alloc_err(lc, __func__);
+
+	log_info(lc, "device-mapper mock: reloaded \"%s\"", name);
+	return 1;
+}
+
+static int
+mock_suspend(struct lib_context *lc, char *name)
+{
+	struct mock_dev *dev;
+
+	if (!mock_op(lc, MOCK_SUSPEND, name) || !(dev = find_dev(lc, name)))
+		return 0;
+
+	dev->suspended = 1;
+	return 1;
+}
+
+/* Resuming makes any table reloaded live. */
+static int
+mock_resume(struct lib_context *lc, char *name)
+{
+	struct mock_dev *dev;
+
+	if (!mock_op(lc, MOCK_RESUME, name) || !(dev = find_dev(lc, name)))
+		return 0;
+
+	if (dev->inactive) {
+		dbg_free(dev->table);
+		dev->table = dev->inactive;
+		dev->inactive = NULL;
+	}
+
+	dev->suspended = 0;
+	return 1;
+}
+
+static int
+mock_remove(struct lib_context *lc, char *name)
+{
+	struct mock_dev *dev;
+
+	if (!mock_op(lc, MOCK_REMOVE, name) || !(dev = find_dev(lc, name)))
+		return 0;
+
+	free_dev(dev);
+	log_info(lc, "device-mapper mock: removed \"%s\"", name);
+	return 1;
+}
+
+static int
+mock_status(struct lib_context *lc, char *name)
+{
+	return mock_op(lc, MOCK_STATUS, name) && find_dev(lc, name);
+}
+
+/* Is the table line at @line resynchronizing? */
+static int
+resyncing(const char *line)
+{
+	const char *nl = strchr(line, '\n'), *s = strstr(line, " sync ");
+
+	return s && (!nl || s < nl);
+}
+
+static int
+mock_sync(struct lib_context *lc, char *name,
+	  uint64_t *sync, uint64_t *total)
+{
+	int ret = 0;
+	char *p;
+	uint64_t length;
+	struct mock_dev *dev;
+
+	if (!mock_op(lc, MOCK_STATUS, name) || !(dev = find_dev(lc, name)))
+		return 0;
+
+	for (p = dev->table; p && *p;
+	     p = strchr(p, '\n') ? strchr(p, '\n') + 1 : NULL) {
+		if (sscanf(p, "%*u %" SCNu64, &length) != 1)
+			return 0;
+
+		*total += length;
+		if (MOCK(lc)->sync > -1 && resyncing(p)) {
+			*sync += length * MOCK(lc)->sync / 100;
+			ret = 1;
+		} else
+			*sync += length;
+	}
+
+	return ret;
+}
+
+/* Log @msg for every target of type @ttype in the live table. */
+static int
+mock_message(struct lib_context *lc, char *name,
+	     const char *ttype, const char *msg)
+{
+	char *p, type[32];
+	uint64_t start;
+	struct mock_dev *dev;
+
+	if (!mock_op(lc, MOCK_MESSAGE, name) || !(dev = find_dev(lc, name)))
+		return 0;
+
+	for (p = dev->table; p && *p;
+	     p = strchr(p, '\n') ? strchr(p, '\n') + 1 : NULL) {
+		if (sscanf(p, "%" SCNu64 " %*u %31s", &start, type) != 2)
+			return 0;
+
+		if (!strcmp(type, ttype))
+			log_info(lc, "device-mapper mock: message \"%s\" to "
+				 "\"%s\" sector %" PRIu64, msg, name, start);
+	}
+
+	return 1;
+}
+
+static int
+mock_version(struct lib_context *lc, char *version, size_t size)
+{
+	if (!mock_op(lc, MOCK_VERSION, "-"))
+		return 0;
+
+	strncpy(version, "4.0.0-mock", size);
+	return 1;
+}
+
+static int
+mock_resync_throttle(struct lib_context *lc, unsigned int percent)
+{
+	if (!mock_op(lc, MOCK_THROTTLE, "mirror"))
+		return 0;
+
+	log_info(lc, "device-mapper mock: mirror resync throttled to %u%%",
+		 percent);
+	return 1;
+}
+
+/* Show what's left mapped and release the mock. */
+static void
+mock_exit(struct lib_context *lc)
+{
+	struct mock_dev *dev, *tmp;
+
+	if (!MOCK(lc))
+		return;
+
+	list_for_each_entry_safe(dev, tmp, &MOCK(lc)->devs, list) {
+		log_info(lc, "device-mapper mock: %s%s: %s", dev->name,
+			 dev->suspended ? " (suspended)" : "", dev->table);
+		free_dev(dev);
+	}
+
+	if (MOCK(lc)->targets)
+		dbg_free(MOCK(lc)->targets);
+
+	dbg_free(MOCK(lc));
+	lc->dm_data = NULL;
+}
+
+const struct dm_backend mock_dm = {
+	.name = "mock",
+	.create = mock_create,
+	.reload = mock_reload,
+	.suspend = mock_suspend,
+	.resume = mock_resume,
+	.remove = mock_remove,
+	.status = mock_status,
+	.sync = mock_sync,
+	.message = mock_message,
+	.version = mock_version,
+	.resync_throttle = mock_resync_throttle,
+	.has_target = mock_has_target,
+	.exit = mock_exit,
+};
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2004-2010  Heinz Mauelshagen, Red Hat GmbH.
+ *                          All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * Device-mapper target status parsing.
+ *
+ * Status lines get split into words in place and parsed into a
+ * caller provided struct dm_status without any memory allocation,
+ * because this runs on every event in the events DSO:
+ *
+ *	striped:	2 253:4 253:5 1 AA
+ *	mirror:		2 253:4 253:5 400/400 1 AA 3 disk 253:3 A
+ *	raid45:		3 253:4 253:5 253:6 1 AAA
+ *	raid:		raid5_ls 3 AAa 1024/2048 recover 0
+ */
+
+#include <stddef.h>
+#include "internal.h"
+
+/* Split off the next word of *@p in place. */
+static char *
+word(char **p)
+{
+	char *w = *p;
+
+	while (isspace((unsigned char) *w))
+		w++;
+
+	if (!*w)
+		return NULL;
+
+	for (*p = w; **p && !isspace((unsigned char) **p); (*p)++);
+	if (**p)
+		*(*p)++ = 0;
+
+	return w;
+}
+
+static int
+number(char **p, unsigned int *n)
+{
+	char *end, *w = word(p);
+	unsigned long v;
+
+	if (!w)
+		return 0;
+
+	v = strtoul(w, &end, 10);
+	if (*end || end == w || v > UINT_MAX)
+		return 0;
+
+	*n = v;
+	return 1;
+}
+
+/* Parse "sync/total" resync progress. */
+static int
+ratio(char **p, struct dm_status *st)
+{
+	char *end, *w = word(p);
+
+	if (!w)
+		return 0;
+
+	st->sync = strtoull(w, &end, 10);
+	if (end == w || *end != '/')
+		return 0;
+
+	w = end + 1;
+	st->total = strtoull(w, &end, 10);
+	return end != w && !*end;
+}
+
+static enum dm_status_health
+health(char c)
+{
+	switch (c) {
+	case 'A':
+		return DM_HEALTH_ALIVE;
+	case 'D':
+		return DM_HEALTH_DEAD;
+	case 'R':
+		return DM_HEALTH_READ_ERROR;
+	case 'S':
+	case 'a':
+		return DM_HEALTH_NOSYNC;
+	}
+
+	return DM_HEALTH_UNKNOWN;
+}
+
+/* Parse "N dev1 ... devN". */
+static int
+devices(char **p, struct dm_status *st)
+{
+	unsigned int i;
+
+	if (!number(p, &st->num_devs) ||
+	    !st->num_devs || st->num_devs > DM_STATUS_MAX_DEVS)
+		return 0;
+
+	for (i = 0; i < st->num_devs; i++) {
+		if (!(st->devs[i].name = word(p)))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Set device health from @w, one character per device. raid45 may
+ * follow each 'A' or 'D' by characters describing it further.
+ */
+static int
+health_chars(char *w, struct dm_status *st, int raid45)
+{
+	unsigned int i;
+
+	for (i = 0; i < st->num_devs; i++) {
+		if (!*w)
+			return 0;
+
+		st->devs[i].health = health(*w++);
+		if (raid45) {
+			while (*w && *w != 'A' && *w != 'D')
+				w++;
+		}
+	}
+
+	return !*w;
+}
+
+/* Parse "N health [...]", counted device status words. */
+static int
+dev_status(char **p, struct dm_status *st, int raid45)
+{
+	unsigned int n;
+	char *w;
+
+	if (!number(p, &n) || !n || !(w = word(p)) ||
+	    !health_chars(w, st, raid45))
+		return 0;
+
+	while (--n) {
+		if (!word(p))
+			return 0;
+	}
+
+	return 1;
+}
+
+static int
+parse_striped(char **p, struct dm_status *st)
+{
+	return devices(p, st) && dev_status(p, st, 0);
+}
+
+static int
+parse_mirror(char **p, struct dm_status *st)
+{
+	unsigned int i, n;
+	char *w;
+
+	if (!devices(p, st) || !ratio(p, st) || !dev_status(p, st, 0) ||
+	    !number(p, &n) || !n || !(st->log.type = word(p)))
+		return 0;
+
+	/* "1 core" or "3 disk|cluster dev health". */
+	for (i = 1; i < n; i++) {
+		if (!(w = word(p)))
+			return 0;
+
+		if (i == 1)
+			st->log.dev = w;
+		else if (i == 2)
+			st->log.health = health(*w);
+	}
+
+	return 1;
+}
+
+static int
+parse_raid45(char **p, struct dm_status *st)
+{
+	return devices(p, st) && dev_status(p, st, 1);
+}
+
+/* No device names in raid status; see dm_status_raid_devs(). */
+static int
+parse_raid(char **p, struct dm_status *st)
+{
+	unsigned int i;
+	char *w;
+
+	if (!(st->raid_type = word(p)) ||
+	    !number(p, &st->num_devs) ||
+	    !st->num_devs || st->num_devs > DM_STATUS_MAX_DEVS ||
+	    !(w = word(p)) || !health_chars(w, st, 0) || !ratio(p, st))
+		return 0;
+
+	for (i = 0; i < st->num_devs; i++)
+		st->devs[i].name = NULL;
+
+	st->sync_action = word(p);
+	return 1;
+}
+
+static const struct {
+	const char *name;
+	enum dm_status_target target;
+	int (*parse) (char **p, struct dm_status *st);
+} targets[] = {
+	{ "striped", DM_STATUS_STRIPED, parse_striped },
+	{ "mirror", DM_STATUS_MIRROR, parse_mirror },
+	{ "raid45", DM_STATUS_RAID45, parse_raid45 },
+	{ "raid", DM_STATUS_RAID, parse_raid },
+};
+
+/*
+ * Parse status @params of a @target_type target into @st.
+ * @params gets split into words in place.
+ *
+ * Return 1 for success and 0 for unknown targets or malformed status.
+ */
+int
+dm_status_parse(const char *target_type, char *params, struct dm_status *st)
+{
+	unsigned int i;
+
+	memset(st, 0, offsetof(struct dm_status, devs));
+	for (i = 0; i < ARRAY_SIZE(targets); i++) {
+		if (!strcmp(target_type, targets[i].name)) {
+			st->target = targets[i].target;
+			return params && targets[i].parse(&params, st);
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Set raid target device names in @st, parsed before with
+ * dm_status_parse(), from the table line @params:
+ *
+ *	raid5_ls 1 128 3 - 253:4 - 253:5 - 253:6
+ *
+ * Missing devices ("-") get a NULL name.
+ *
+ * Return 1 for success and 0 for a table not matching @st.
+ */
+int
+dm_status_raid_devs(char *params, struct dm_status *st)
+{
+	unsigned int i, n;
+	char *data;
+
+	if (st->target != DM_STATUS_RAID || !word(&params) ||
+	    !number(&params, &n))
+		return 0;
+
+	/* Skip raid parameters. */
+	while (n--) {
+		if (!word(&params))
+			return 0;
+	}
+
+	if (!number(&params, &n) || n != st->num_devs)
+		return 0;
+
+	for (i = 0; i < n; i++) {
+		/* Metadata device, data device. */
+		if (!word(&params) || !(data = word(&params)))
+			return 0;
+
+		st->devs[i].name = strcmp(data, "-") ? data : NULL;
+	}
+
+	return 1;
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2004-2010  Heinz Mauelshagen, Red Hat GmbH.
+ *                          All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * Rebuild progress and bandwidth.
+ *
+ * How far a RAID set is in sync gets read from the status of its mapped
+ * device. Throughput and time to completion get estimated from the
+ * previous sample, which is cached in PROGRESS_DIR between runs.
+ *
+ * The recovery bandwidth share requested for a RAID set gets stored in
+ * PROGRESS_DIR as well, because its mapping gets reloaded by dmraid and
+ * the events DSO when a rebuild starts or ends.
+ */
+
+#include <time.h>
+#include "internal.h"
+#include "devmapper.h"
+
+#define	PROGRESS_DIR	"/run/dmraid"
+#define	SAMPLE_MS	1000	/* Minimum interval between samples. */
+#define	BANDWIDTH	".bandwidth"
+
+struct sample {
+	uint64_t ms;		/* Monotonic time taken. */
+	uint64_t sync;		/* Sectors in sync. */
+	uint64_t rate;		/* Sectors per second up to this sample. */
+};
+
+static uint64_t
+now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Make up the path of a file in PROGRESS_DIR for RAID set @rs. */
+static char *
+state_path(struct lib_context *lc, struct raid_set *rs, const char *suffix)
+{
+	char *ret;
+
+	if ((ret = dbg_malloc(strlen(PROGRESS_DIR) + strlen(rs->name) +
+			      strlen(suffix) + 2)))
+		sprintf(ret, "%s/%s%s", PROGRESS_DIR, rs->name, suffix);
+	else
+		log_alloc_err(lc, __func__);
+
+	return ret;
+}
+
+static int
+read_sample(const char *path, struct sample *s)
+{
+	int ret;
+	FILE *f;
+
+	if (!(f = fopen(path, "r")))
+		return 0;
+
+	ret = fscanf(f, "%" SCNu64 " %" SCNu64 " %" SCNu64,
+		     &s->ms, &s->sync, &s->rate) == 3;
+	fclose(f);
+	return ret;
+}
+
+/* Caching is best effort: without it, there's just no estimate. */
+static void
+write_sample(struct lib_context *lc, const char *path, struct sample *s)
+{
+	FILE *f;
+
+	if (!mk_dir(lc, PROGRESS_DIR) || !(f = fopen(path, "w"))) {
+		log_dbg(lc, "can't cache rebuild progress in %s", path);
+		return;
+	}
+
+	fprintf(f, "%" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+		s->ms, s->sync, s->rate);
+	fclose(f);
+}
+
+/*
+ * Retrieve rebuild progress of the mapped RAID set @rs into @p.
+ *
+ * Return 1 if @rs reports resynchronization progress, 0 if it
+ * isn't mapped or none of its targets reports any.
+ */
+int
+rebuild_progress(struct lib_context *lc, struct raid_set *rs,
+		 struct rebuild_progress *p)
+{
+	char *path;
+	struct sample last, now;
+
+	memset(p, 0, sizeof(*p));
+	p->eta = -1;
+	if (!dm_sync(lc, rs, &p->sync, &p->total))
+		return 0;
+
+	if (!(path = state_path(lc, rs, "")))
+		return 1;
+
+	/* In sync: nothing to estimate. */
+	if (p->sync >= p->total) {
+		p->eta = 0;
+		unlink(path);
+		goto out;
+	}
+
+	now.ms = now_ms();
+	now.sync = p->sync;
+	now.rate = 0;
+	if (read_sample(path, &last) &&
+	    last.sync <= now.sync && last.ms < now.ms) {
+		/* Keep the last sample until enough time passed. */
+		if (now.ms - last.ms < SAMPLE_MS) {
+			p->rate = last.rate;
+			goto eta;
+		}
+
+		now.rate = (now.sync - last.sync) * 1000 / (now.ms - last.ms);
+	}
+
+	write_sample(lc, path, &now);
+	p->rate = now.rate;
+
+   eta:
+	if (p->rate)
+		p->eta = (p->total - p->sync) / p->rate;
+
+   out:
+	dbg_free(path);
+	return 1;
+}
+
+/*
+ * Return the recovery bandwidth share in percent of RAID set @rs,
+ * either requested with --rebuild_bandwidth or stored before;
+ * 0 if none, which leaves the kernel default in place.
+ */
+unsigned int
+rebuild_bandwidth(struct lib_context *lc, struct raid_set *rs)
+{
+	unsigned int ret = 0;
+	char *path;
+	FILE *f;
+
+	if (OPT_REBUILD_BANDWIDTH(lc))
+		return strtoul(OPT_STR_REBUILD_BANDWIDTH(lc), NULL, 10);
+
+	if (!(path = state_path(lc, rs, BANDWIDTH)))
+		return 0;
+
+	if ((f = fopen(path, "r"))) {
+		if (fscanf(f, "%u", &ret) != 1 || ret > 100)
+			ret = 0;
+
+		fclose(f);
+	}
+
+	dbg_free(path);
+	return ret;
+}
+
+static int
+store_bandwidth(struct lib_context *lc, struct raid_set *rs,
+		unsigned int percent)
+{
+	int ret = 0;
+	char *path;
+	FILE *f;
+
+	if (!(path = state_path(lc, rs, BANDWIDTH)))
+		return 0;
+
+	if (mk_dir(lc, PROGRESS_DIR) && (f = fopen(path, "w"))) {
+		ret = fprintf(f, "%u\n", percent) > 0;
+		ret = !fclose(f) && ret;
+	}
+
+	if (!ret)
+		log_err(lc, "storing rebuild bandwidth in %s", path);
+
+	dbg_free(path);
+	return ret;
+}
+
+static int
+_set_rebuild_bandwidth(struct lib_context *lc, struct raid_set *rs,
+		       unsigned int percent, int *mirrors)
+{
+	char msg[32];
+	struct raid_set *r;
+
+	list_for_each_entry(r, &rs->sets, list) {
+		if (!_set_rebuild_bandwidth(lc, r, percent, mirrors))
+			return 0;
+	}
+
+	if (T_GROUP(rs))
+		return 1;
+
+	if (!store_bandwidth(lc, rs, percent))
+		return 0;
+
+	if (T_RAID1(rs))
+		(*mirrors)++;
+
+	/* Changing the table would restart any resynchronization. */
+	if ((T_RAID4(rs) || T_RAID5(rs)) && dm_status(lc, rs)) {
+		sprintf(msg, "bandwidth set %u", percent);
+		if (!dm_message(lc, rs, get_dm_type(lc, rs->type), msg))
+			LOG_ERR(lc, 0, "setting rebuild bandwidth of RAID set "
+				"\"%s\"", rs->name);
+	}
+
+	return 1;
+}
+
+/*
+ * Set the recovery bandwidth share requested with --rebuild_bandwidth
+ * for RAID set @rs and any subsets.
+ *
+ * RAID4/5 mappings take it as a table parameter and get it sent when
+ * active already. The mirror target only supports one resynchronization
+ * throttle for all mirrors.
+ */
+int
+set_rebuild_bandwidth(struct lib_context *lc, struct raid_set *rs)
+{
+	int mirrors = 0;
+	unsigned int percent = rebuild_bandwidth(lc, rs);
+
+	if (OPT_TEST(lc))
+		return 1;
+
+	return _set_rebuild_bandwidth(lc, rs, percent, &mirrors) &&
+	       (!mirrors || dm_resync_throttle(lc, percent));
+}
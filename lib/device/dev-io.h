@@ -14,10 +14,61 @@
 
 #define BLKGETSIZE	_IO(0x12, 0x60) /* get block device size */
 #define BLKSSZGET	_IO(0x12, 0x68) /* get block device sector size */
+#define BLKPBSZGET	_IO(0x12, 123)	/* get physical block size */
 
 #define	DMRAID_SECTOR_SIZE	512
 
+#ifndef	O_CLOEXEC
+#define	O_CLOEXEC	0
+#endif
+
+struct dev_info;
+
+/*
+ * Device I/O backend.
+ *
+ * open() returns 1 on success and 0 on error, read() and
+ * write() the number of bytes transferred or -1 on error.
+ */
+struct dev_io {
+	const char *name;
+
+	/* Add the devices the backend provides to the device list. */
+	int (*discover) (struct lib_context *lc, char **devnodes);
+	int (*open) (struct lib_context *lc, struct dev_info *di, int flags);
+	void (*close) (struct lib_context *lc, struct dev_info *di);
+	int (*size) (struct lib_context *lc, struct dev_info *di);
+	int (*serial) (struct lib_context *lc, struct dev_info *di);
+	ssize_t (*read) (struct lib_context *lc, struct dev_info *di,
+			 void *buffer, size_t size, loff_t offset);
+	ssize_t (*write) (struct lib_context *lc, struct dev_info *di,
+			  void *buffer, size_t size, loff_t offset);
+	void (*exit) (struct lib_context *lc);
+};
+
+/* Block devices in /dev (scan.c, file.c). */
+extern const struct dev_io blockdev_io;
+int blockdev_open(struct lib_context *lc, struct dev_info *di, int flags);
+void blockdev_close(struct lib_context *lc, struct dev_info *di);
+ssize_t blockdev_read(struct lib_context *lc, struct dev_info *di,
+		      void *buffer, size_t size, loff_t offset);
+ssize_t blockdev_write(struct lib_context *lc, struct dev_info *di,
+		       void *buffer, size_t size, loff_t offset);
+
+/* Metadata recorded with -D or device images (replay.c). */
+extern const struct dev_io replay_io;
+
+char *mk_sysfs_path(struct lib_context *lc, char const *path);
+int sysfs_block_fd(struct lib_context *lc);
+ssize_t sysfs_read_attr(struct lib_context *lc, const char *dev,
+			const char *attr, void *buf, size_t size);
+int sysfs_get_u64(struct lib_context *lc, const char *dev, const char *attr,
+		  uint64_t *val);
+int sysfs_get_serial(struct lib_context *lc, struct dev_info *di);
+void sysfs_exit(struct lib_context *lc);
+int add_device(struct lib_context *lc, char *path);
 int discover_devices(struct lib_context *lc, char **devnodes);
+void dev_io_exit(struct lib_context *lc);
 int removable_device(struct lib_context *lc, char *dev_path);
 int remove_device_partitions(struct lib_context *lc, void *rs, int dummy);
 
@@ -6,42 +6,125 @@
  */
 #include <linux/blkpg.h>
 #include <sys/ioctl.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include "internal.h"
 
+/*
+ * Delete partition number @pno from the block device open on @fd.
+ *
+ * Returns 1 on success, 0 if there's no such partition, -1 on error.
+ */
 static int
-_remove_subset_partitions(struct lib_context *lc, struct raid_set *rs)
+del_partition(int fd, int pno)
 {
-	struct raid_dev *rd;
-	struct blkpg_partition part = { 0, };
+	struct blkpg_partition part = { .pno = pno, };
 	struct blkpg_ioctl_arg io = {
 		.op = BLKPG_DEL_PARTITION,
 		.datalen = sizeof(part),
 		.data = &part,
 	};
 
-	list_for_each_entry(rd, &rs->devs, devs) {
-		int fd = open(rd->di->path, O_RDWR);
+	if (!ioctl(fd, BLKPG, &io))
+		return 1;
+
+	return errno == ENXIO ? 0 : -1;
+}
+
+/* Read a partition number from its sysfs "partition" attribute. */
+static int
+sysfs_partition_number(struct lib_context *lc, const char *dev,
+		       const char *part)
+{
+	uint64_t pno;
+	char attr[NAME_MAX + 16];
+
+	snprintf(attr, sizeof(attr), "%s/partition", part);
+	return sysfs_get_u64(lc, dev, attr, &pno) ? (int) pno : 0;
+}
+
+/*
+ * Remove the partitions sysfs shows below the device.
+ *
+ * Returns the number of partitions removed or -1 on error,
+ * -2 in case sysfs can't be used to enumerate partitions.
+ */
+static int
+_remove_sysfs_partitions(struct lib_context *lc, int fd, char *path)
+{
+	int dir, pno, r, ret = 0;
+	char *name = get_basename(lc, path);
+	size_t len = strlen(name);
+	DIR *d;
+	struct dirent *de;
+
+	if ((dir = sysfs_block_fd(lc)) < 0 ||
+	    (dir = openat(dir, name, O_RDONLY | O_DIRECTORY)) < 0)
+		return -2;
+
+	if (!(d = fdopendir(dir))) {
+		close(dir);
+		return -2;
+	}
+
+	/* Partition directories are named after the device (eg, sda1). */
+	while ((de = readdir(d))) {
+		if (strncmp(de->d_name, name, len) ||
+		    !de->d_name[len] ||
+		    !(pno = sysfs_partition_number(lc, name, de->d_name)))
+			continue;
 
-		if (fd < 0)
+		if ((r = del_partition(fd, pno)) < 0) {
+			log_err(lc, "removing part %d from %s: %s\n",
+				pno, path, strerror(errno));
+			ret = -1;
+			break;
+		}
+
+		ret += r;
+	}
+
+	closedir(d);
+	return ret;
+}
+
+/* Without sysfs there is no way to enumerate partitions: try them all. */
+static int
+_remove_all_partitions(struct lib_context *lc, int fd, char *path)
+{
+	int pno;
+
+	for (pno = 1; pno <= 256; pno++) {
+		if (del_partition(fd, pno) < 0 &&
+		    (pno < 16 || errno != EINVAL))
+			LOG_ERR(lc, 0, "removing part %d from %s: %s\n",
+				pno, path, strerror(errno));
+	}
+
+	return 1;
+}
+
+static int
+_remove_subset_partitions(struct lib_context *lc, struct raid_set *rs)
+{
+	int fd, r;
+	struct raid_dev *rd;
+
+	list_for_each_entry(rd, &rs->devs, devs) {
+		if ((fd = dev_fd(lc, rd->di, O_RDWR)) < 0)
 			LOG_ERR(lc, 0, "opening %s: %s\n", rd->di->path,
 				strerror(errno));
 
-		/* There is no way to enumerate partitions */
-		for (part.pno = 1; part.pno <= 256; part.pno++) {
-			if (ioctl(fd, BLKPG, &io) < 0 &&
-			    errno != ENXIO &&
-			    (part.pno < 16 || errno != EINVAL)) {
-				close(fd);
-				LOG_ERR(lc, 0,
-					"removing part %d from %s: %s\n",
-					part.pno, rd->di->path,
-					strerror(errno));
-			}
-		}
+		if ((r = _remove_sysfs_partitions(lc, fd, rd->di->path)) == -2)
+			r = _remove_all_partitions(lc, fd, rd->di->path) ?
+			    0 : -1;
+		else if (r > 0)
+			log_notice(lc, "removed %d partition(s) from %s",
+				   r, rd->di->path);
 
-		close(fd);
+		if (r < 0)
+			return 0;
 	}
 
 	return 1;
@@ -0,0 +1,596 @@
+/*
+ * Copyright (C) 2004-2010  Heinz Mauelshagen, Red Hat GmbH.
+ *                          All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * Replay I/O backend.
+ *
+ * Provides devices from a directory holding either metadata recorded
+ * with -D (<device>.dat, .offset, .size and .serial files as written by
+ * file_metadata() and file_dev_size(); directories per format below
+ * the given one get searched as well) or (sparse) device image files,
+ * or from an archive written with --dump_archive.
+ * This allows for discovery, grouping and table generation of RAID
+ * sets without access to the disks.
+ *
+ * Recorded metadata, images and archives get mapped read-only. Device areas not
+ * recorded read as zeroes. Writes never reach any file; they get kept
+ * in memory and override what's been recorded on subsequent reads.
+ */
+
+#include <dirent.h>
+#include <paths.h>
+#include <sys/mman.h>
+#include "internal.h"
+#include "misc/archive.h"
+
+/* Data recorded for or written to an area of a device. */
+struct replay_extent {
+	struct list_head list;
+	uint64_t offset;	/* Byte offset on the device. */
+	size_t size;		/* Byte size of the area. */
+	void *data;
+	size_t map_len;		/* Length of mmap()ed data or 0. */
+	int allocated;		/* Data written, hence allocated. */
+};
+
+struct replay_dev {
+	struct list_head list;
+	char *name;		/* Device name (eg, "sda"). */
+	char *serial;
+	uint64_t sectors;
+	struct list_head extents;	/* Oldest first. */
+};
+
+struct replay {
+	struct list_head devs;
+	void *archive;		/* Archive mapped. */
+	size_t archive_len;
+};
+
+#define	REPLAY(lc)	((struct replay *) (lc)->io_data)
+
+static struct replay_dev *
+find_dev(struct lib_context *lc, const char *name, int create)
+{
+	struct replay_dev *dev;
+
+	list_for_each_entry(dev, &REPLAY(lc)->devs, list) {
+		if (!strcmp(dev->name, name))
+			return dev;
+	}
+
+	if (!create)
+		return NULL;
+
+	if (!(dev = dbg_malloc(sizeof(*dev))) ||
+	    !(dev->name = dbg_strdup((char *) name))) {
+		if (dev)
+			dbg_free(dev);
+
+		log_alloc_err(lc, __func__);
+		return NULL;
+	}
+
+	INIT_LIST_HEAD(&dev->extents);
+	list_add_tail(&dev->list, &REPLAY(lc)->devs);
+	return dev;
+}
+
+static void
+free_dev(struct replay_dev *dev)
+{
+	struct replay_extent *e, *tmp;
+
+	list_for_each_entry_safe(e, tmp, &dev->extents, list) {
+		if (e->map_len)
+			munmap(e->data, e->map_len);
+		else if (e->allocated)
+			dbg_free(e->data);
+
+		dbg_free(e);
+	}
+
+	if (dev->serial)
+		dbg_free(dev->serial);
+
+	dbg_free(dev->name);
+	dbg_free(dev);
+}
+
+static struct replay_extent *
+add_extent(struct lib_context *lc, struct replay_dev *dev, uint64_t offset,
+	   void *data, size_t size, size_t map_len)
+{
+	struct replay_extent *e;
+
+	if (!(e = dbg_malloc(sizeof(*e)))) {
+		log_alloc_err(lc, __func__);
+		return NULL;
+	}
+
+	e->offset = offset;
+	e->size = size;
+	e->data = data;
+	e->map_len = map_len;
+	list_add_tail(&e->list, &dev->extents);
+	return e;
+}
+
+/* Map a file below directory @dir privately and read-only. */
+static void *
+map_file(struct lib_context *lc, int dir, const char *file, size_t *len)
+{
+	int fd;
+	void *ret = NULL;
+	struct stat st;
+
+	if ((fd = openat(dir, file, O_RDONLY)) < 0)
+		LOG_ERR(lc, NULL, "opening %s", file);
+
+	if (fstat(fd, &st) || !st.st_size)
+		log_err(lc, "empty replay file %s", file);
+	else if ((ret = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+			     fd, 0)) == MAP_FAILED) {
+		log_err(lc, "mapping %s[%s]", file, strerror(errno));
+		ret = NULL;
+	} else
+		*len = st.st_size;
+
+	close(fd);
+	return ret;
+}
+
+/* Read file <@name>.<@suffix> below directory @dir 0-terminated. */
+static ssize_t
+read_attr(int dir, const char *name, const char *suffix,
+	  char *buf, size_t size)
+{
+	int fd;
+	ssize_t ret;
+	char file[NAME_MAX + 1];
+
+	if (snprintf(file, sizeof(file), "%s.%s", name, suffix) >=
+	    sizeof(file) ||
+	    (fd = openat(dir, file, O_RDONLY)) < 0)
+		return -1;
+
+	if ((ret = read(fd, buf, size - 1)) >= 0)
+		buf[ret] = 0;
+
+	close(fd);
+	return ret;
+}
+
+/* Does file <@name>.<@suffix> exist below directory @dir ? */
+static int
+has_attr(int dir, const char *name, const char *suffix)
+{
+	char file[NAME_MAX + 1];
+
+	return snprintf(file, sizeof(file), "%s.%s", name, suffix) <
+	       sizeof(file) && !faccessat(dir, file, F_OK, 0);
+}
+
+static int
+read_number(int dir, const char *name, const char *suffix, uint64_t *val)
+{
+	char buf[24];
+
+	return read_attr(dir, name, suffix, buf, sizeof(buf)) > 0 &&
+	       sscanf(buf, "%" PRIu64, val) == 1;
+}
+
+/* Size and serial number recorded with the device metadata. */
+static int
+dev_attrs(struct lib_context *lc, int dir, struct replay_dev *dev)
+{
+	ssize_t len;
+	char buf[64];
+
+	if (!dev->sectors)
+		read_number(dir, dev->name, "size", &dev->sectors);
+
+	if (!dev->serial &&
+	    (len = read_attr(dir, dev->name, "serial", buf, sizeof(buf))) > 0 &&
+	    !(dev->serial = dbg_strdup(remove_white_space(lc, buf, len))))
+		return log_alloc_err(lc, __func__);
+
+	return 1;
+}
+
+/* Formats filing several areas per device name them <device>_<area>. */
+static char *
+area_suffix(char *name)
+{
+	char *p = strrchr(name, '_');
+
+	return p && p[1] && strspn(p + 1, "0123456789") == strlen(p + 1) ?
+	       p : NULL;
+}
+
+/*
+ * Add metadata file <@stem>.dat recorded at the offset
+ * in <@stem>.offset to its device.
+ *
+ * Formats filing several areas per device (eg, sil) use
+ * <device>_<area> stems with just one <device>.size file.
+ */
+static int
+load_dat(struct lib_context *lc, int dir, const char *file, char *stem)
+{
+	char *p;
+	size_t len = 0;
+	uint64_t offset;
+	void *data;
+	struct replay_dev *dev;
+
+	if (!read_number(dir, stem, "offset", &offset))
+		LOG_ERR(lc, 0, "reading offset of replay file %s", file);
+
+	if (!has_attr(dir, stem, "size") && (p = area_suffix(stem))) {
+		*p = 0;
+		if (!has_attr(dir, stem, "size"))
+			*p = '_';
+	}
+
+	if (!(data = map_file(lc, dir, file, &len)))
+		return 0;
+
+	if (!(dev = find_dev(lc, stem, 1)) ||
+	    !add_extent(lc, dev, offset, data, len, len)) {
+		munmap(data, len);
+		return 0;
+	}
+
+	return dev_attrs(lc, dir, dev);
+}
+
+/* Add a device image file named <device>[.img]. */
+static int
+load_image(struct lib_context *lc, int dir, const char *file, char *stem)
+{
+	size_t len = 0;
+	void *data;
+	struct replay_dev *dev;
+
+	if (!(data = map_file(lc, dir, file, &len)))
+		return 0;
+
+	if (!(dev = find_dev(lc, stem, 1)) ||
+	    !add_extent(lc, dev, 0, data, len, len)) {
+		munmap(data, len);
+		return 0;
+	}
+
+	/* Images don't come with a .size file. */
+	if (!dev->sectors)
+		dev->sectors = len / DMRAID_SECTOR_SIZE;
+
+	return dev_attrs(lc, dir, dev);
+}
+
+/* Files holding attributes of a device rather than its data. */
+static const char *attr_suffixes[] = { "offset", "serial", "size", };
+
+static int
+load_file(struct lib_context *lc, int dir, const char *file)
+{
+	int ret = 1;
+	char *stem, *suffix;
+	const char **s;
+
+	if (!(stem = dbg_strdup((char *) file)))
+		return log_alloc_err(lc, __func__);
+
+	if ((suffix = strrchr(stem, '.')))
+		*suffix++ = 0;
+
+	if (suffix && !strcmp(suffix, "dat"))
+		ret = load_dat(lc, dir, file, stem);
+	else {
+		for (s = attr_suffixes; suffix && s < ARRAY_END(attr_suffixes);
+		     s++) {
+			if (!strcmp(suffix, *s))
+				goto out;
+		}
+
+		/* Anything else is a device image. */
+		if (suffix && strcmp(suffix, "img"))
+			suffix[-1] = '.';
+
+		ret = load_image(lc, dir, file, stem);
+	}
+
+out:
+	dbg_free(stem);
+	return ret;
+}
+
+/*
+ * Load directory @path below @parent. Directories
+ * in the top level one (eg, -D output per format) get loaded too.
+ */
+static int
+load_dir(struct lib_context *lc, int parent, const char *path, int depth)
+{
+	int fd, ret = 1;
+	DIR *d;
+	struct dirent *de;
+	struct stat st;
+
+	if ((fd = openat(parent, path, O_RDONLY | O_DIRECTORY)) < 0 ||
+	    !(d = fdopendir(fd))) {
+		if (fd > -1)
+			close(fd);
+
+		LOG_ERR(lc, 0, "opening replay directory %s", path);
+	}
+
+	while (ret && (de = readdir(d))) {
+		if (*de->d_name == '.' ||
+		    fstatat(dirfd(d), de->d_name, &st, 0))
+			continue;
+
+		if (S_ISDIR(st.st_mode)) {
+			if (!depth)
+				ret = load_dir(lc, dirfd(d), de->d_name, 1);
+		} else if (S_ISREG(st.st_mode))
+			ret = load_file(lc, dirfd(d), de->d_name);
+	}
+
+	closedir(d);
+	return ret;
+}
+
+/* Device size and serial number records of an archive. */
+static int
+load_rec_attr(struct lib_context *lc, struct archive_rec *rec, void *arg)
+{
+	struct replay_dev *dev;
+
+	if (rec->type != AR_SIZE && rec->type != AR_SERIAL)
+		return 1;
+
+	if (!(dev = find_dev(lc, rec->name, 1)))
+		return 0;
+
+	if (rec->type == AR_SIZE)
+		dev->sectors = rec->offset;
+	else if (!dev->serial) {
+		if (!(dev->serial = dbg_malloc(rec->size + 1)))
+			return log_alloc_err(lc, __func__);
+
+		memcpy(dev->serial, rec->data, rec->size);
+	}
+
+	return 1;
+}
+
+/* Metadata records of an archive referencing the mapping. */
+static int
+load_rec_area(struct lib_context *lc, struct archive_rec *rec, void *arg)
+{
+	char *p, name[sizeof(((struct archive_entry *) 0)->name)];
+	struct replay_dev *dev;
+
+	if (rec->type != AR_METADATA)
+		return 1;
+
+	strcpy(name, rec->name);
+	if (!find_dev(lc, name, 0) && (p = area_suffix(name))) {
+		*p = 0;
+		if (!find_dev(lc, name, 0))
+			*p = '_';
+	}
+
+	return (dev = find_dev(lc, name, 1)) &&
+	       add_extent(lc, dev, rec->offset, (void *) rec->data,
+			  rec->size, 0);
+}
+
+/* Devices are known by their size records before areas get added. */
+static int
+load_archive(struct lib_context *lc, const char *path)
+{
+	struct replay *r = REPLAY(lc);
+
+	return (r->archive = archive_map(lc, path, &r->archive_len)) &&
+	       archive_for_each(lc, r->archive, r->archive_len,
+				load_rec_attr, NULL) &&
+	       archive_for_each(lc, r->archive, r->archive_len,
+				load_rec_area, NULL);
+}
+
+static void
+replay_exit(struct lib_context *lc)
+{
+	struct replay_dev *dev, *tmp;
+
+	if (!REPLAY(lc))
+		return;
+
+	list_for_each_entry_safe(dev, tmp, &REPLAY(lc)->devs, list)
+		free_dev(dev);
+
+	if (REPLAY(lc)->archive)
+		munmap(REPLAY(lc)->archive, REPLAY(lc)->archive_len);
+
+	dbg_free(REPLAY(lc));
+	lc->io_data = NULL;
+}
+
+static int
+replay_init(struct lib_context *lc, const char *path)
+{
+	struct replay *r;
+	struct stat st;
+
+	if (!(r = dbg_malloc(sizeof(*r))))
+		return log_alloc_err(lc, __func__);
+
+	INIT_LIST_HEAD(&r->devs);
+	lc->io_data = r;
+
+	log_notice(lc, "replaying devices from %s", path);
+	if (!stat(path, &st) && S_ISREG(st.st_mode) ?
+	    load_archive(lc, path) : load_dir(lc, AT_FDCWD, path, 0))
+		return 1;
+
+	replay_exit(lc);
+	return 0;
+}
+
+/* Is @name on the list of device nodes requested ? */
+static int
+requested(struct lib_context *lc, char **devnodes, const char *name)
+{
+	if (!devnodes || !*devnodes)
+		return 1;
+
+	while (*devnodes) {
+		if (!strcmp(get_basename(lc, *devnodes++), name))
+			return 1;
+	}
+
+	return 0;
+}
+
+static int
+replay_discover(struct lib_context *lc, char **devnodes)
+{
+	char path[PATH_MAX];
+	struct replay_dev *dev;
+
+	if (!REPLAY(lc) && !replay_init(lc, OPT_STR_REPLAY(lc)))
+		return 0;
+
+	list_for_each_entry(dev, &REPLAY(lc)->devs, list) {
+		if (requested(lc, devnodes, dev->name) &&
+		    snprintf(path, sizeof(path), "%s%s",
+			     _PATH_DEV, dev->name) < sizeof(path))
+			add_device(lc, path);
+	}
+
+	return 1;
+}
+
+static int
+replay_open(struct lib_context *lc, struct dev_info *di, int flags)
+{
+	if (!di->io_data && REPLAY(lc))
+		di->io_data = find_dev(lc, get_basename(lc, di->path), 0);
+
+	return di->io_data ? 1 : 0;
+}
+
+static void
+replay_close(struct lib_context *lc, struct dev_info *di)
+{
+	di->io_data = NULL;
+}
+
+/* Size from the .size file or the end of the last area recorded. */
+static int
+replay_size(struct lib_context *lc, struct dev_info *di)
+{
+	uint64_t end;
+	struct replay_dev *dev = di->io_data;
+	struct replay_extent *e;
+
+	if (!dev->sectors) {
+		list_for_each_entry(e, &dev->extents, list) {
+			end = div_up(e->offset + e->size, DMRAID_SECTOR_SIZE);
+			if (end > dev->sectors)
+				dev->sectors = end;
+		}
+	}
+
+	di->sectors = dev->sectors;
+	return 1;
+}
+
+/* Without a recorded serial number, the device name has to do. */
+static int
+replay_serial(struct lib_context *lc, struct dev_info *di)
+{
+	struct replay_dev *dev = di->io_data;
+
+	if (!(di->serial = dbg_strdup(dev->serial ? dev->serial : dev->name)))
+		return log_alloc_err(lc, __func__);
+
+	return 1;
+}
+
+static int
+in_range(struct dev_info *di, size_t size, loff_t offset)
+{
+	return offset >= 0 &&
+	       offset + size <= di->sectors * DMRAID_SECTOR_SIZE;
+}
+
+/* Later extents override earlier ones. */
+static ssize_t
+replay_read(struct lib_context *lc, struct dev_info *di,
+	    void *buffer, size_t size, loff_t offset)
+{
+	uint64_t start, end;
+	struct replay_dev *dev = di->io_data;
+	struct replay_extent *e;
+
+	if (!in_range(di, size, offset))
+		return 0;
+
+	memset(buffer, 0, size);
+	list_for_each_entry(e, &dev->extents, list) {
+		start = max((uint64_t) offset, e->offset);
+		end = min((uint64_t) offset + size, e->offset + e->size);
+		if (start < end)
+			memcpy((uint8_t *) buffer + (start - offset),
+			       (uint8_t *) e->data + (start - e->offset),
+			       end - start);
+	}
+
+	return size;
+}
+
+static ssize_t
+replay_write(struct lib_context *lc, struct dev_info *di,
+	     void *buffer, size_t size, loff_t offset)
+{
+	void *data;
+	struct replay_extent *e;
+
+	if (!in_range(di, size, offset))
+		return 0;
+
+	if (!(data = dbg_malloc(size))) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	memcpy(data, buffer, size);
+	if ((e = add_extent(lc, di->io_data, offset, data, size, 0))) {
+		e->allocated = 1;
+		return size;
+	}
+
+	dbg_free(data);
+	errno = ENOMEM;
+	return -1;
+}
+
+const struct dev_io replay_io = {
+	.name = "replay",
+	.discover = replay_discover,
+	.open = replay_open,
+	.close = replay_close,
+	.size = replay_size,
+	.serial = replay_serial,
+	.read = replay_read,
+	.write = replay_write,
+	.exit = replay_exit,
+};
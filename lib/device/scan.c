@@ -7,13 +7,11 @@
 
 #ifdef __KLIBC__
 # define __KERNEL_STRICT_NAMES
-# include <dirent.h>
-# include <paths.h>
-#else
-# include <dirent.h>
-# include <mntent.h>
 #endif
 
+#include <dirent.h>
+#include <paths.h>
+
 #include <stdlib.h>
 #include <linux/hdreg.h>
 #include <sys/ioctl.h>
@@ -21,64 +19,6 @@
 #include "ata.h"
 #include "scsi.h"
 
-/*
- * subdirectory below sysfs moint point holding the 
- * subdirectory hierarchies of all block devices.
- */
-#define	BLOCK 		"/block"
-
-/* Find sysfs mount point */
-#ifndef	_PATH_MOUNTS
-#define	_PATH_MOUNTS	"/proc/mounts"
-#endif
-
-static char *
-find_sysfs_mp(struct lib_context *lc)
-{
-#ifndef __KLIBC__
-	char *ret = NULL;
-	FILE *mfile;
-	struct mntent *ment;
-
-	/* Try /proc/mounts first and failback to /etc/mtab. */
-	if (!(mfile = setmntent(_PATH_MOUNTS, "r"))) {
-		if (!(mfile = setmntent(_PATH_MOUNTED, "r")))
-			LOG_ERR(lc, NULL, "Unable to open %s or %s",
-				_PATH_MOUNTS, _PATH_MOUNTED);
-	}
-
-	while ((ment = getmntent(mfile))) {
-		if (!strcmp(ment->mnt_type, "sysfs")) {
-			ret = ment->mnt_dir;
-			break;
-		}
-	};
-
-	endmntent(mfile);
-
-	return ret;
-#else
-	return (char *) "/sys";
-#endif
-}
-
-/* Make up an absolute sysfs path given a relative one. */
-static char *
-mk_sysfs_path(struct lib_context *lc, char const *path)
-{
-	static char *ret = NULL, *sysfs_mp;
-
-	if (!(sysfs_mp = find_sysfs_mp(lc)))
-		LOG_ERR(lc, NULL, "finding sysfs mount point");
-
-	if ((ret = dbg_malloc(strlen(sysfs_mp) + strlen(path) + 1)))
-		sprintf(ret, "%s%s", sysfs_mp, path);
-	else
-		log_alloc_err(lc, __func__);
-
-	return ret;
-}
-
 /* Test with sparse mapped devices. */
 #ifdef	DMRAID_TEST
 static int
@@ -138,30 +78,16 @@ get_device_serial(struct lib_context *lc, int fd, struct dev_info *di)
 }
 
 static int
-di_ioctl(struct lib_context *lc, int fd, struct dev_info *di)
+blockdev_serial(struct lib_context *lc, struct dev_info *di)
 {
-	unsigned int sector_size = 0;
-	unsigned long size;
-
-	/* Fetch sector size. */
-	if (ioctl(fd, BLKSSZGET, &sector_size))
-		sector_size = DMRAID_SECTOR_SIZE;
-
-	if (sector_size != DMRAID_SECTOR_SIZE)
-		LOG_ERR(lc, 0, "unsupported sector size %d on %s.",
-			sector_size, di->path);
-
-	/* Use size device ioctl in case we didn't get the size from sysfs. */
-	if (!di->sectors && !ioctl(fd, BLKGETSIZE, &size))
-		di->sectors = size;
-
 #ifdef	DMRAID_TEST
 	/* Test with sparse mapped devices. */
 	if (dm_test_device(lc, di->path))
 		return get_dm_test_serial(lc, di, di->path);
 	else
 #endif
-		return get_device_serial(lc, fd, di);
+		return (sysfs_block_fd(lc) > -1 && sysfs_get_serial(lc, di)) ||
+		       get_device_serial(lc, di->fd, di);
 }
 
 /* Are we interested in this device ? */
@@ -188,112 +114,93 @@ interested(struct lib_context *lc, char *path)
 int
 removable_device(struct lib_context *lc, char *dev_path)
 {
-	int ret = 0;
-	char buf[2], *name, *sysfs_path, *sysfs_file;
-	const char *sysfs_removable = "removable";
-	FILE *f;
-
-	if (!(sysfs_path = mk_sysfs_path(lc, BLOCK)))
-		return 0;
+	char buf[4];
 
-	name = get_basename(lc, dev_path);
-	if (!(sysfs_file = dbg_malloc(strlen(sysfs_path) + strlen(name) +
-				      strlen(sysfs_removable) + 3))) {
-		log_alloc_err(lc, __func__);
-		goto out;
+	if (sysfs_read_attr(lc, get_basename(lc, dev_path), "removable",
+			    buf, sizeof(buf)) > 0 && *buf == '1') {
+		log_notice(lc, "skipping removable device %s", dev_path);
+		return 1;
 	}
 
-	sprintf(sysfs_file, "%s/%s/%s", sysfs_path, name, sysfs_removable);
-	if ((f = fopen(sysfs_file, "r"))) {
-		/* Using fread for klibc compatibility. */
-		if (fread(buf, sizeof(char), sizeof(buf) - 1, f) && *buf == '1') {
-			log_notice(lc, "skipping removable device %s",
-				   dev_path);
-			ret = 1;
-		}
+	return 0;
+}
 
-		fclose(f);
-	}
+/*
+ * Retrieve the device size in sectors from the sysfs "size" file
+ * or the size ioctl and check the sector size (queue limits in
+ * sysfs if available).
+ */
+static int
+blockdev_size(struct lib_context *lc, struct dev_info *di)
+{
+	int sysfs = sysfs_block_fd(lc) > -1;
+	unsigned int sector_size = 0;
+	unsigned long size;
+	uint64_t lbs;
+	char *name = get_basename(lc, di->path);
 
-	dbg_free(sysfs_file);
+	if (sysfs && sysfs_get_u64(lc, name, "queue/logical_block_size", &lbs))
+		sector_size = lbs;
+	else if (ioctl(di->fd, BLKSSZGET, &sector_size))
+		sector_size = DMRAID_SECTOR_SIZE;
 
-out:
-	dbg_free(sysfs_path);
+	if (sector_size != DMRAID_SECTOR_SIZE)
+		LOG_ERR(lc, 0, "unsupported sector size %d on %s.",
+			sector_size, di->path);
 
-	return ret;
+	if (sysfs) {
+		if (sysfs_get_u64(lc, name, "size", &di->sectors))
+			return 1;
+
+		LOG_ERR(lc, 0, "reading disk size for %s from sysfs",
+			di->path);
+	}
+
+	if (!ioctl(di->fd, BLKGETSIZE, &size))
+		di->sectors = size;
+
+	return 1;
 }
 
 /*
- * Read the size in sectors from the sysfs "size" file.
- * Avoid access to removable devices.
+ * Set up a device with the I/O backend and keep it on the device
+ * list. It stays open for metadata reads until RAID device discovery
+ * is done.
  */
-static int
-sysfs_get_size(struct lib_context *lc, struct dev_info *di,
-	       const char *path, char *name)
+int
+add_device(struct lib_context *lc, char *path)
 {
-	int ret = 0;
-	char buf[22], *sysfs_file;
-	const char *sysfs_size = "size";
-	FILE *f;
-
-	if (!(sysfs_file = dbg_malloc(strlen(path) + strlen(name) +
-				      strlen(sysfs_size) + 3)))
-		return log_alloc_err(lc, __func__);
+	struct dev_info *di;
 
-	sprintf(sysfs_file, "%s/%s/%s", path, name, sysfs_size);
-	if ((f = fopen(sysfs_file, "r"))) {
-		/* Use fread+sscanf for klibc compatibility. */
-		if (fread(buf, sizeof(char), sizeof buf - 1, f) &&
-		    (ret = sscanf(buf, "%" PRIu64, &di->sectors)) != 1) {
-			ret = 0;
-			log_err(lc, "reading disk size for %s from sysfs",
-				di->path);
-		}
-
-		fclose(f);
-	} else
-		log_err(lc, "opening %s", sysfs_file);
+	if (!(di = alloc_dev_info(lc, path)))
+		return 0;
 
-	dbg_free(sysfs_file);
+	if (lc->io->open(lc, di, O_RDONLY) &&
+	    lc->io->size(lc, di) &&
+	    lc->io->serial(lc, di)) {
+		list_add(&di->list, LC_DI(lc));
+		return 1;
+	}
 
-	return ret;
+	free_dev_info(lc, di);
+	return 0;
 }
 
+/* Avoid access to removable devices. */
 static int
-get_size(struct lib_context *lc, const char *path, char *name, int sysfs)
+add_blockdev(struct lib_context *lc, char *name)
 {
-	int fd, ret = 0;
+	int ret = 0;
 	char *dev_path;
-	struct dev_info *di = NULL;
 
 	if (!(dev_path = dbg_malloc(strlen(_PATH_DEV) + strlen(name) + 1)))
 		return log_alloc_err(lc, __func__);
 
 	sprintf(dev_path, "%s%s", _PATH_DEV, name);
-	if (!interested(lc, dev_path)) {
-		ret = 0;
-		goto out;
-	}
+	if (interested(lc, dev_path) && !removable_device(lc, dev_path))
+		ret = add_device(lc, dev_path);
 
-	if (removable_device(lc, dev_path) ||
-	    !(di = alloc_dev_info(lc, dev_path)) ||
-	    (sysfs && !sysfs_get_size(lc, di, path, name)) ||
-	    (fd = open(dev_path, O_RDONLY)) == -1)
-		goto out;
-
-	if (di_ioctl(lc, fd, di)) {
-		list_add(&di->list, LC_DI(lc));
-		ret = 1;
-	}
-
-	close(fd);
-
-out:
 	dbg_free(dev_path);
-
-	if (!ret && di)
-		free_dev_info(lc, di);
-
 	return ret;
 }
 
@@ -301,44 +208,69 @@ out:
  * Find disk devices in sysfs or directly
  * in /dev (for Linux 2.4) and keep information.
  */
-int
-discover_devices(struct lib_context *lc, char **devnodes)
+static int
+blockdev_discover(struct lib_context *lc, char **devnodes)
 {
-	int sysfs, ret = 0;
-	const char *path;
-	char *p;
+	int fd, sysfs = sysfs_block_fd(lc) > -1;
 	DIR *d;
 	struct dirent *de;
 
-	if ((p = mk_sysfs_path(lc, BLOCK))) {
-		sysfs = 1;
-		path = p;
-	} else {
-		sysfs = 0;
-		path = _PATH_DEV;
-		log_print(lc, "carrying on with %s", path);
-	}
-
-	if (!(d = opendir(path))) {
-		log_err(lc, "opening path %s", path);
-		goto out;
-	}
+	if (!sysfs)
+		log_print(lc, "carrying on with %s", _PATH_DEV);
 
 	if (devnodes && *devnodes) {
 		while (*devnodes)
-			get_size(lc, path, get_basename(lc, *devnodes++),
-				 sysfs);
-	} else {
-		while ((de = readdir(d)))
-			get_size(lc, path, de->d_name, sysfs);
+			add_blockdev(lc, get_basename(lc, *devnodes++));
+
+		return 1;
+	}
+
+	/* Private open file description of the directory for readdir(). */
+	fd = sysfs ? openat(sysfs_block_fd(lc), ".", O_RDONLY | O_DIRECTORY) :
+		     open(_PATH_DEV, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0 || !(d = fdopendir(fd))) {
+		if (fd > -1)
+			close(fd);
+
+		LOG_ERR(lc, 0, "opening path %s",
+			sysfs ? "sysfs block directory" : _PATH_DEV);
 	}
 
+	while ((de = readdir(d)))
+		add_blockdev(lc, de->d_name);
+
 	closedir(d);
-	ret = 1;
+	return 1;
+}
+
+const struct dev_io blockdev_io = {
+	.name = "block device",
+	.discover = blockdev_discover,
+	.open = blockdev_open,
+	.close = blockdev_close,
+	.size = blockdev_size,
+	.serial = blockdev_serial,
+	.read = blockdev_read,
+	.write = blockdev_write,
+};
+
+/* Discover devices through the I/O backend selected. */
+int
+discover_devices(struct lib_context *lc, char **devnodes)
+{
+	if (OPT_REPLAY(lc))
+		lc->io = &replay_io;
+
+	log_dbg(lc, "discovering devices with %s backend", lc->io->name);
+	return lc->io->discover(lc, devnodes);
+}
 
-out:
-	if (p)
-		dbg_free(p);
+/* Release resources of the I/O backend. */
+void
+dev_io_exit(struct lib_context *lc)
+{
+	if (lc->io->exit)
+		lc->io->exit(lc);
 
-	return ret;
+	lc->io = &blockdev_io;
 }
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2004-2010  Heinz Mauelshagen, Red Hat GmbH.
+ *                          All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * sysfs access.
+ *
+ * The sysfs mount point is looked up once per library context and
+ * <mount point>/block is kept open, so that attributes of block devices
+ * can be read relative to that directory without any path building
+ * or memory allocation.
+ */
+
+#ifdef __KLIBC__
+# define __KERNEL_STRICT_NAMES
+# include <paths.h>
+#else
+# include <mntent.h>
+#endif
+
+#include "internal.h"
+
+/*
+ * subdirectory below sysfs moint point holding the
+ * subdirectory hierarchies of all block devices.
+ */
+#define	BLOCK 		"/block"
+
+/* Find sysfs mount point */
+#ifndef	_PATH_MOUNTS
+#define	_PATH_MOUNTS	"/proc/mounts"
+#endif
+
+static char *
+find_sysfs_mp(struct lib_context *lc)
+{
+#ifndef __KLIBC__
+	char *ret = NULL;
+	FILE *mfile;
+	struct mntent *ment;
+
+	/* Try /proc/mounts first and failback to /etc/mtab. */
+	if (!(mfile = setmntent(_PATH_MOUNTS, "r"))) {
+		if (!(mfile = setmntent(_PATH_MOUNTED, "r")))
+			LOG_ERR(lc, NULL, "Unable to open %s or %s",
+				_PATH_MOUNTS, _PATH_MOUNTED);
+	}
+
+	while ((ment = getmntent(mfile))) {
+		if (!strcmp(ment->mnt_type, "sysfs")) {
+			/* mnt_dir is gone with endmntent(). */
+			if (!(ret = dbg_strdup(ment->mnt_dir)))
+				log_alloc_err(lc, __func__);
+
+			break;
+		}
+	};
+
+	endmntent(mfile);
+
+	return ret;
+#else
+	return dbg_strdup((char *) "/sys");
+#endif
+}
+
+/* Return the cached sysfs mount point. */
+static const char *
+sysfs_mp(struct lib_context *lc)
+{
+	if (!lc->sysfs.mp && !lc->sysfs.mp_searched) {
+		lc->sysfs.mp_searched = 1;
+		lc->sysfs.mp = find_sysfs_mp(lc);
+	}
+
+	return lc->sysfs.mp;
+}
+
+/* Make up an absolute sysfs path given a relative one. */
+char *
+mk_sysfs_path(struct lib_context *lc, char const *path)
+{
+	char *ret;
+	const char *mp;
+
+	if (!(mp = sysfs_mp(lc)))
+		LOG_ERR(lc, NULL, "finding sysfs mount point");
+
+	if ((ret = dbg_malloc(strlen(mp) + strlen(path) + 1)))
+		sprintf(ret, "%s%s", mp, path);
+	else
+		log_alloc_err(lc, __func__);
+
+	return ret;
+}
+
+/* Return directory file descriptor of <sysfs>/block or -1. */
+int
+sysfs_block_fd(struct lib_context *lc)
+{
+	char *path;
+
+	if (lc->sysfs.block_fd < 0 && (path = mk_sysfs_path(lc, BLOCK))) {
+		if ((lc->sysfs.block_fd =
+		     open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+			log_err(lc, "opening %s", path);
+
+		dbg_free(path);
+	}
+
+	return lc->sysfs.block_fd;
+}
+
+/*
+ * Read attribute @attr of block device @dev (eg, "sda", "size")
+ * into @buf, which is always 0-terminated on success.
+ *
+ * Returns the number of bytes read or -1 on error.
+ */
+ssize_t
+sysfs_read_attr(struct lib_context *lc, const char *dev, const char *attr,
+		void *buf, size_t size)
+{
+	int dir, fd;
+	ssize_t ret;
+	char path[PATH_MAX];
+
+	if (!size || (dir = sysfs_block_fd(lc)) < 0 ||
+	    snprintf(path, sizeof(path), "%s/%s", dev, attr) >= sizeof(path) ||
+	    (fd = openat(dir, path, O_RDONLY)) < 0)
+		return -1;
+
+	if ((ret = pread(fd, buf, size - 1, 0)) >= 0)
+		((char *) buf)[ret] = 0;
+
+	close(fd);
+	return ret;
+}
+
+/* Read a numeric attribute of a block device. */
+int
+sysfs_get_u64(struct lib_context *lc, const char *dev, const char *attr,
+	      uint64_t *val)
+{
+	char buf[24];
+
+	return sysfs_read_attr(lc, dev, attr, buf, sizeof(buf)) > 0 &&
+	       sscanf(buf, "%" PRIu64, val) == 1;
+}
+
+/*
+ * Retrieve the serial number of a block device from the
+ * unit serial number VPD page the SCSI layer caches in sysfs.
+ *
+ * Same layout as the SG_IO INQUIRY response (see scsi.c):
+ * length in byte 3 followed by the serial number string.
+ */
+int
+sysfs_get_serial(struct lib_context *lc, struct dev_info *di)
+{
+	ssize_t len;
+	size_t serial_len;
+	unsigned char buf[256];
+
+	if ((len = sysfs_read_attr(lc, get_basename(lc, di->path),
+				   "device/vpd_pg80", buf, sizeof(buf))) < 4 ||
+	    buf[1] != 0x80)
+		return 0;
+
+	if ((serial_len = buf[3]) > len - 4)
+		serial_len = len - 4;
+
+	if (!(di->serial = dbg_strdup(remove_white_space(lc, (char *) buf + 4,
+							 serial_len))))
+		return log_alloc_err(lc, __func__);
+
+	/* Empty serial -> let the ioctls have a go. */
+	if (!*di->serial) {
+		dbg_free(di->serial);
+		di->serial = NULL;
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Release cached sysfs resources of a library context. */
+void
+sysfs_exit(struct lib_context *lc)
+{
+	if (lc->sysfs.block_fd > -1) {
+		close(lc->sysfs.block_fd);
+		lc->sysfs.block_fd = -1;
+	}
+
+	if (lc->sysfs.mp) {
+		dbg_free(lc->sysfs.mp);
+		lc->sysfs.mp = NULL;
+	}
+
+	lc->sysfs.mp_searched = 0;
+}
@@ -255,11 +255,89 @@ get_format_name(struct raid_set *rs)
 	return (void *) check_null(fmt ? fmt->name : NULL);
 }
 
+/*
+ * Rebuild progress of a RAID set formatted for display: percentage in
+ * sync, KiB/s and seconds to completion or "N/A" where unknown.
+ * Querying it costs a device-mapper status call per set, so it's only
+ * done once any of it gets displayed.
+ */
+#define	PROGRESS_LEN	24
+struct progress {
+	struct raid_set *rs;
+	int valid;		/* Fields below are set. */
+	int resyncing;
+	char percent[PROGRESS_LEN], rate[PROGRESS_LEN], eta[PROGRESS_LEN];
+};
+
+static struct progress *
+progress_fields(struct lib_context *lc, struct progress *pr)
+{
+	struct rebuild_progress p;
+
+	if (pr->valid)
+		return pr;
+
+	pr->valid = 1;
+	pr->resyncing = 0;
+	strcpy(pr->percent, "N/A");
+	strcpy(pr->rate, "N/A");
+	strcpy(pr->eta, "N/A");
+
+	/* Replayed sets aren't mapped unless the mock is. */
+	if (T_GROUP(pr->rs) || (OPT_REPLAY(lc) && !OPT_DM_MOCK(lc)) ||
+	    !rebuild_progress(lc, pr->rs, &p) || !p.total)
+		return pr;
+
+	snprintf(pr->percent, PROGRESS_LEN, "%.1f",
+		 (double) p.sync * 100 / p.total);
+	if (p.rate || p.sync >= p.total)
+		snprintf(pr->rate, PROGRESS_LEN, "%" PRIu64, p.rate / 2);
+
+	if (p.eta > -1)
+		snprintf(pr->eta, PROGRESS_LEN, "%" PRId64, p.eta);
+
+	pr->resyncing = p.sync < p.total;
+	return pr;
+}
+
+static void
+log_percent(struct lib_context *lc, void *arg)
+{
+	log_string(lc, progress_fields(lc, arg)->percent);
+}
+
+static void
+log_rate(struct lib_context *lc, void *arg)
+{
+	log_string(lc, progress_fields(lc, arg)->rate);
+}
+
+static void
+log_eta(struct lib_context *lc, void *arg)
+{
+	log_string(lc, progress_fields(lc, arg)->eta);
+}
+
+/* Display rebuild progress line. */
+static void
+log_progress(struct lib_context *lc, struct progress *pr)
+{
+	long secs = strtol(pr->eta, NULL, 10);
+
+	if (*pr->eta == 'N')
+		log_print(lc, "resync : %s%%, rate unknown", pr->percent);
+	else
+		log_print(lc, "resync : %s%%, %s KiB/s, eta %ld:%02ld:%02ld",
+			  pr->percent, pr->rate, secs / 3600, secs / 60 % 60,
+			  secs % 60);
+}
+
 static void
 log_rs(struct lib_context *lc, struct raid_set *rs)
 {
 	unsigned int devs = 0, spares = 0, subsets = 0;
 	uint64_t sectors = 0;
+	struct progress progress = { .rs = rs, .valid = 0, };
 
 	if (T_GROUP(rs) && !OPT_GROUP(lc))
 		return;
@@ -272,8 +350,11 @@ log_rs(struct lib_context *lc, struct raid_set *rs)
 	if (OPT_STR_COLUMN(lc)) {
 		const struct log_handler log_handlers[] = {
 			{"devices", 1, log_uint, &devs},
+			{"eta", 1, log_eta, &progress},
 			{"format", 1, log_string, get_format_name(rs)},
+			{"progress", 1, log_percent, &progress},
 			{"raidname", 1, log_string, rs->name},
+			{"rate", 3, log_rate, &progress},
 			{"sectors", 2, log_uint64, &sectors},
 			{"size", 2, log_uint64, &sectors},
 			{"spares", 2, log_uint, &spares},
@@ -306,6 +387,8 @@ log_rs(struct lib_context *lc, struct raid_set *rs)
 			  check_null(get_status(lc, rs->status)),
 			  subsets, devs, spares);
 
+		if (!o && progress_fields(lc, &progress)->resyncing)
+			log_progress(lc, &progress);
 	}
 
 	if (OPT_COLUMN(lc) > 2) {
@@ -24,6 +24,11 @@
  * Date:    08/07-04/09
  * Description: This is a DSO library that is registered with dmeventd 
  *                     to capture device mapper raid events for dmraid.
+ *                     Built with DMRAID_EVENTS_GENERIC defined, it is
+ *                     libdmraid-events.so, which serves formats without
+ *                     a DSO of their own through their event handlers.
+ *                     Rebuild progress gets checkpointed into the
+ *                     metadata on timeouts.
  */
 
 /*
@@ -46,6 +51,11 @@
  * o streamlined in general for better readability
  * o avoid DSO header file
  * o white space / indenting
+ * o LED control blocking event processing on system("sgpio ...")
+ * o unregistration polling an unsynchronized in-use flag
+ * o event bursts causing repeated rebuild attempts and log floods
+ * o no event handling for formats other than Intel Matrix RAID
+ * o rebuilds restarting from scratch after a reboot
  */
 
 /*
@@ -64,11 +74,27 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <libgen.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
 #include <libdevmapper.h>
 #include <libdevmapper-event.h>
 #include <dmraid/dmraid.h>
 
 #define LIBDMRAID_EVENTS_VERSION "1.0.0.rc5"
+
+/*
+ * The generic DSO only records member failures through the format's
+ * I/O error handler. Hot spare rebuilds, LEDs and rebuild checkpoints
+ * go through the isw metadata handler, which has no I/O error handler.
+ */
+#ifdef	DMRAID_EVENTS_GENERIC
+#define	DSO_ISW	0
+#else
+#define	DSO_ISW	1
+#endif
 #define BUF_SIZE 256
  
 /* Disk states definitions. */
@@ -91,8 +117,8 @@ static const char *sys_dm_dm = "dm-";
 static const char *sys_block_path = "/sys/block/";
 static const char *sys_scsi_path = "/sys/class/scsi_device/";
 static const char *sys_slaves_dir = "/slaves";
-static const char *sys_scsi_dev_blk = "/device/block";
-static const char sys_scsi_dev_blk_delims[] = { '/', ':' };
+static const char *sys_scsi_dev_dir = "/device";
+static const char *sys_scsi_dev_blk = "block";
 static const char *sys_dev_dir = "/dev";
 
 /* Logging. */
@@ -125,77 +151,164 @@ struct dso_raid_dev {
  * This will allow for reporting robust information for when a drive
  * within a RAID set is exhibiting problems. 
  */
-#define	RS_IN_USE	1 /* RAID set structure in use flag. */
 struct dso_raid_set {
 	pthread_mutex_t event_mutex; /* Event processing serialization. */
-	struct dso_raid_set *next;   /* next RAID set registered against DSO. */
+	pthread_mutex_t ref_mutex;   /* Protects ref_cond. */
+	pthread_cond_t ref_cond;     /* Signaled when ref drops to 0. */
+	struct dso_raid_set *next;   /* Next RAID set in hash bucket. */
 	char *name;		     /* RAID set name. */
 	int num_devs;	 	     /* Number of devices in RAID set. */
 	int max_devs;	 	     /* Number of devices allocated. */
-	unsigned long flags;	     /* Used as lock if RS_IN_USE bit set. */
+	int ref;		     /* # of event handlers using the set. */
+	struct timespec decided;     /* Time of last event decision. */
+	char *status;		     /* Status acted on last. */
+	unsigned long coalesced;     /* Events dropped since. */
+	int pending;		     /* Status change left pending. */
+	uint64_t checkpoint;	     /* Rebuild checkpoint written last. */
+	int no_checkpoints;	     /* Format keeps no checkpoints. */
+	struct lib_context *lc;	     /* Library context kept for events. */
+	char **devnodes;	     /* Devices to rescan (NULL: all). */
 
 	/* Do not declare anything below this structure. */
 	struct dso_raid_dev devs[0];
 };
 
-static struct dso_raid_set *raid_sets = NULL;
+/* Registered RAID sets hashed by name. */
+#define	RS_HASH_SIZE	64
+static struct dso_raid_set *raid_sets[RS_HASH_SIZE];
+static int num_raid_sets = 0;
 
 /*
  * register_device() is called first and performs initialisation.
- * Only one device may be registered or unregistered at a time.
+ * Only one device may be registered or unregistered at a time;
+ * lookups from event processing take the lock shared.
  */
-static pthread_mutex_t _register_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t _register_lock = PTHREAD_RWLOCK_INITIALIZER;
 
 /* Is sgpio app available? */
 static int _issgpio = 0;
 
-/* Check for availibility of sgpio tool. */
+/*
+ * Events within this many milliseconds of the last decision
+ * on a RAID set get merged into it (0 disables this).
+ */
+#define	DEBOUNCE_ENV	"DMRAID_EVENT_DEBOUNCE_MS"
+#define	DEBOUNCE_MS	500
+static unsigned long _debounce_ms = DEBOUNCE_MS;
+
+/* Read debounce interval from the environment. */
+static void _check_debounce(void)
+{
+	char *end, *val = getenv(DEBOUNCE_ENV);
+	unsigned long ms;
+
+	if (!val)
+		return;
+
+	ms = strtoul(val, &end, 10);
+	if (*val && !*end)
+		_debounce_ms = ms;
+	else
+		syslog(LOG_ERR, "Ignoring invalid %s=\"%s\"",
+		       DEBOUNCE_ENV, val);
+}
+
+/* Check for availibility of sgpio tool in $PATH without forking. */
 /* FIXME: what's the use of this when admin removes sgpio? */
 static void _check_sgpio(void)
 {
-	char sgpio_path[50];
-	FILE *fd = popen("which sgpio", "r");
+	char sgpio_path[PATH_MAX], *path, *dir, *p;
 
-	if (fd) {
-		if (fscanf(fd, "%s", sgpio_path) == 1) {
+	_issgpio = 0;
+	path = getenv("PATH");
+	if (!path || !(path = dm_strdup(path)))
+		return;
+
+	for (dir = strtok_r(path, ":", &p); dir; dir = strtok_r(NULL, ":", &p)) {
+		if (snprintf(sgpio_path, sizeof(sgpio_path), "%s/sgpio",
+			     dir) < sizeof(sgpio_path) &&
+		    !access(sgpio_path, X_OK)) {
 			_issgpio = 1;
 			syslog(LOG_ALERT, "SGPIO handling enabled");
+			break;
 		}
+	}
 
-		fclose(fd);
-	} else
-		_issgpio = 0;
+	dm_free(path);
 }
 
 /*
- * Call sgpio app to control LED on one device.
+ * LED requests get queued to a worker thread, so that event
+ * processing never blocks on sysfs writes or on forking sgpio.
+ *
+ * A request for a device (or port) still pending
+ * gets updated rather than queued again.
  */
+struct led_request {
+	struct led_request *next;
+	enum led_ctrl_type status;
+	char type;		/* SGPIO_DISK or SGPIO_PORT. */
+	int port;
+	char name[DEV_NAME];
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t thread;
+	int running;
+	int exit;
+	struct led_request *head, *tail;
+} _led = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
 /*
- * FIXME: run in seperate thread to prevent blocking main
- *	  dmeventd thread or use sgpio library functions.
+ * Set LED through the AHCI enclosure management message
+ * attribute of the SCSI host (ie. the port) directly.
+ *
+ * Return 1 for success and 0 for failure.
  */
-static int _dev_led_one(enum led_ctrl_type status, const char type,
-			struct dso_raid_dev *dev)
+static int _led_em_message(struct led_request *req)
+{
+	/* AHCI LED message values (fault and locate LEDs). */
+	static const unsigned int em_led[] = { 0x0, 0x400000, 0x480000 };
+	int fd, len, ret;
+	char path[BUF_SIZE], msg[16];
+
+	snprintf(path, sizeof(path), "/sys/class/scsi_host/host%d/em_message",
+		 req->port);
+	if ((fd = open(path, O_WRONLY)) < 0)
+		return 0;
+
+	len = snprintf(msg, sizeof(msg), "%u", em_led[req->status]);
+	ret = write(fd, msg, len) == len;
+	close(fd);
+	return ret;
+}
+
+/* Call sgpio app to control LED on one device. */
+static int _led_sgpio(struct led_request *req)
 {
 	int ret, sz;
 	char com[100];
 	static const char *led_ctrl[] = { "off", "fault", "rebuild" };
 
-	if (!_issgpio ||
-	    dev->port < 0)
-		return 0;
+	if (!_issgpio)
+		return -1;
 
 	sz = sprintf(com, "sgpio -");
-	switch (type) {
+	switch (req->type) {
 	case SGPIO_DISK:
-		sz += sprintf(com + sz, "d %s", dev->name);
+		sz += sprintf(com + sz, "d %s", req->name);
 		break;
 
 	case SGPIO_PORT:
-		sz += sprintf(com + sz, "p %d", dev->port);
+		sz += sprintf(com + sz, "p %d", req->port);
 	}
 
-	sprintf(com + sz, " -s %s", led_ctrl[status]);
+	sprintf(com + sz, " -s %s", led_ctrl[req->status]);
 	ret = system(com);
 	if (ret == -1)
 		syslog(LOG_ERR, "Call \"%s\" failed", com);
@@ -203,6 +316,114 @@ static int _dev_led_one(enum led_ctrl_type status, const char type,
 	return ret;
 }
 
+/* LED worker thread: process requests until told to exit. */
+static void *_led_worker(void *arg)
+{
+	struct led_request *req;
+
+	pthread_mutex_lock(&_led.mutex);
+	for (;;) {
+		while (!_led.head && !_led.exit)
+			pthread_cond_wait(&_led.cond, &_led.mutex);
+
+		/* Drain the queue before exiting (eg. LEDs off). */
+		if (!(req = _led.head))
+			break;
+
+		if (!(_led.head = req->next))
+			_led.tail = NULL;
+
+		pthread_mutex_unlock(&_led.mutex);
+
+		if (!_led_em_message(req))
+			_led_sgpio(req);
+
+		dm_free(req);
+		pthread_mutex_lock(&_led.mutex);
+	}
+
+	pthread_mutex_unlock(&_led.mutex);
+	return NULL;
+}
+
+/* Stop the LED worker after it processed any pending requests. */
+static void _led_stop(void)
+{
+	int running;
+
+	pthread_mutex_lock(&_led.mutex);
+	running = _led.running;
+	_led.exit = 1;
+	pthread_cond_signal(&_led.cond);
+	pthread_mutex_unlock(&_led.mutex);
+
+	if (running)
+		pthread_join(_led.thread, NULL);
+
+	_led.running = _led.exit = 0;
+}
+
+/*
+ * Queue LED state change on one device.
+ *
+ * Return 0 for success and -1 for failure.
+ */
+static int _dev_led_one(enum led_ctrl_type status, const char type,
+			struct dso_raid_dev *dev)
+{
+	int ret = 0;
+	struct led_request *req;
+
+	if (!DSO_ISW || dev->port < 0)
+		return 0;
+
+	pthread_mutex_lock(&_led.mutex);
+
+	/* Coalesce with a pending request for the same device. */
+	for (req = _led.head; req; req = req->next) {
+		if (req->type == type &&
+		    (type == SGPIO_PORT ? req->port == dev->port :
+					  !strcmp(req->name, dev->name))) {
+			req->status = status;
+			goto out;
+		}
+	}
+
+	if (!_led.running) {
+		if (pthread_create(&_led.thread, NULL, _led_worker, NULL)) {
+			syslog(LOG_ERR, "Failed to start LED worker thread");
+			ret = -1;
+			goto out;
+		}
+
+		_led.running = 1;
+	}
+
+	if (!(req = dm_malloc(sizeof(*req)))) {
+		syslog(LOG_ERR, "Failed to allocate LED request");
+		ret = -1;
+		goto out;
+	}
+
+	req->next = NULL;
+	req->status = status;
+	req->type = type;
+	req->port = dev->port;
+	strcpy(req->name, dev->name);
+
+	if (_led.tail)
+		_led.tail->next = req;
+	else
+		_led.head = req;
+
+	_led.tail = req;
+	pthread_cond_signal(&_led.cond);
+
+out:
+	pthread_mutex_unlock(&_led.mutex);
+	return ret;
+}
+
 /* Work all devices of @rs changing LED state. */
 static int _dev_led_all(enum led_ctrl_type status, struct dso_raid_set *rs)
 {
@@ -218,7 +439,6 @@ static int _dev_led_all(enum led_ctrl_type status, struct dso_raid_set *rs)
 	return ret;
 }
 
-
 /*************************************************/
 /******** Interfaces to dmraid library ***********/
 /*************************************************/
@@ -254,24 +474,44 @@ struct prepost prepost[] = {
 
 };
 
+/* Return hash bucket for RAID set @name. */
+static struct dso_raid_set **_raid_set_bucket(const char *name)
+{
+	unsigned int h = 5381;
+
+	while (*name)
+		h = h * 33 + (unsigned char) *name++;
+
+	return raid_sets + h % RS_HASH_SIZE;
+}
+
+/* Find RAID set by @name; caller holds _register_lock. */
+static struct dso_raid_set *_lookup_raid_set(const char *name)
+{
+	struct dso_raid_set *rs = *_raid_set_bucket(name);
+
+	while (rs && strcmp(rs->name, name))
+		rs = rs->next;
+
+	return rs;
+}
+
 /*
- * Find entry in global RAID set list by @dev_name.
+ * Find entry in global RAID set table by @dev_name.
  *
- * Optionally return reference to previous set in @prev.
+ * Optionally take a reference on it, which
+ * has to be dropped with _put_raid_set().
  */
 static struct dso_raid_set *_find_raid_set(const char *dev_name,
-					  struct dso_raid_set **prev,
-					  int log)
+					  int get, int log)
 {
-	struct dso_raid_set *rs = raid_sets;
+	struct dso_raid_set *rs;
 
-	if (prev)
-		*prev = rs;
+	pthread_rwlock_rdlock(&_register_lock);
+	if ((rs = _lookup_raid_set(dev_name)) && get)
+		__sync_add_and_fetch(&rs->ref, 1);
 
-	for ( ; rs && strcmp(rs->name, dev_name); rs = rs->next) {
-		if (prev)
-			*prev = rs;
-	}
+	pthread_rwlock_unlock(&_register_lock);
 
 	if (!rs && log)
 		syslog(LOG_ERR, "Can't find RAID set for device \"%s\"",
@@ -280,6 +520,30 @@ static struct dso_raid_set *_find_raid_set(const char *dev_name,
 	return rs;
 }
 
+/* Drop reference taken by _find_raid_set(); wake up unregistration. */
+static void _put_raid_set(struct dso_raid_set *rs)
+{
+	/*
+	 * Drop the reference under ref_mutex, so that _wait_raid_set()
+	 * can't see it drop to 0 and free @rs before we're done with it.
+	 */
+	pthread_mutex_lock(&rs->ref_mutex);
+	if (!__sync_sub_and_fetch(&rs->ref, 1))
+		pthread_cond_broadcast(&rs->ref_cond);
+
+	pthread_mutex_unlock(&rs->ref_mutex);
+}
+
+/* Wait for all references on unlinked RAID set @rs to be dropped. */
+static void _wait_raid_set(struct dso_raid_set *rs)
+{
+	pthread_mutex_lock(&rs->ref_mutex);
+	while (rs->ref)
+		pthread_cond_wait(&rs->ref_cond, &rs->ref_mutex);
+
+	pthread_mutex_unlock(&rs->ref_mutex);
+}
+
 /* Initialize a DSO RAID device structure. */
 static void _dso_dev_init(struct dso_raid_dev *dev)
 {
@@ -311,13 +575,22 @@ static void _dso_dev_copy(struct dso_raid_set *rs, struct dso_raid_dev *dst)
 	rs->num_devs--;
 }
 
+static void _lib_exit(struct dso_raid_set *rs);
+
 /* Free (destroy) a RAID set structure. */
 static void _destroy_raid_set(struct dso_raid_set *rs)
 {
 	if (rs) {
+		_lib_exit(rs);
 		if (rs->name)
 			dm_free(rs->name);
 
+		if (rs->status)
+			dm_free(rs->status);
+
+		pthread_cond_destroy(&rs->ref_cond);
+		pthread_mutex_destroy(&rs->ref_mutex);
+		pthread_mutex_destroy(&rs->event_mutex);
 		dm_free(rs);
 	}
 }
@@ -326,15 +599,24 @@ static void _destroy_raid_set(struct dso_raid_set *rs)
 static struct dso_raid_set *_init_raid_set(struct dso_raid_set *rs,
 				     const char *rs_name)
 {
+	rs->lc = NULL;
+	rs->devnodes = NULL;
+	rs->status = NULL;
+	pthread_mutex_init(&rs->event_mutex, NULL);
+	pthread_mutex_init(&rs->ref_mutex, NULL);
+	pthread_cond_init(&rs->ref_cond, NULL);
 	rs->name = dm_strdup(rs_name);
 	if (!rs->name) {
 		_destroy_raid_set(rs);
 		return NULL;
 	}
 
-	pthread_mutex_init(&rs->event_mutex, NULL);
 	rs->next = NULL;
-	rs->flags = 0;
+	rs->ref = 0;
+	rs->coalesced = 0;
+	rs->pending = 0;
+	rs->checkpoint = 0;
+	rs->no_checkpoints = 0;
 	rs->max_devs = rs->num_devs = 0;
 	return rs;
 }
@@ -373,28 +655,28 @@ static struct dso_raid_set *_inc_raid_set(struct dso_raid_set *rs,
 	return rs;
 }
 
-/* Link to global RAID set list. */
+/* Link to global RAID set table; caller holds _register_lock. */
 static void _add_raid_set(struct dso_raid_set *rs)
 {
-	/* Link to global RAID set list. */
-	if (raid_sets) {
-		struct dso_raid_set *prev;
+	struct dso_raid_set **bucket = _raid_set_bucket(rs->name);
 
-		/* Return last RAID set in @prev. */
-		_find_raid_set(" ", &prev, 0);
-		prev->next = rs;
-	} else
-		raid_sets = rs;
+	rs->next = *bucket;
+	*bucket = rs;
+	num_raid_sets++;
 }
 
-/* Delete from global RAID set list. */
-static void _del_raid_set(struct dso_raid_set *rs, struct dso_raid_set *prev)
+/* Delete from global RAID set table; caller holds _register_lock. */
+static void _del_raid_set(struct dso_raid_set *rs)
 {
-	/* Unlink RAID set from global list. */
-	if (rs == raid_sets) /* Remove head node. */
-		raid_sets = rs->next;
-	else		    /* Remove n+1 node. */
-		prev->next = rs->next;
+	struct dso_raid_set **p = _raid_set_bucket(rs->name);
+
+	for (; *p; p = &(*p)->next) {
+		if (*p == rs) {
+			*p = rs->next;
+			num_raid_sets--;
+			break;
+		}
+	}
 }
 
 /* Check if device in @path is active and adjust @dev. */
@@ -434,43 +716,90 @@ static enum action _lib_get_action(int o)
  */
 static enum action _lib_set_action(struct lib_context *lc, int o, char *str)
 {  
-	char *s;
 	enum action action = _lib_get_action(o);
 
 	if (action != UNDEF) {
-		s = dm_strdup(str);
-		if (!s) {
+		/* Context gets reused: replace any previous string. */
+		if (!lc_stralloc_opt(lc, LC_REBUILD_SET, str)) {
 			syslog(LOG_ERR, "Failed to allocate action string");
 			return UNDEF;
 		}
 	
-		OPT_STR(lc, LC_REBUILD_SET) = s;
-		lc_inc_opt(lc, LC_REBUILD_SET);
+		lc->options[LC_REBUILD_SET].opt = 1;
 	}
 
 	return action;
 }
 
-static int _dso_perform(struct lib_context *lc, char **argv, enum action action)
+/* Drop devices and RAID sets of any previous run from @lc. */
+static void _lib_reset(struct lib_context *lc)
 {
-	struct prepost *p;
+	free_raid_set(lc, NULL);
+	free_raid_dev(lc, NULL);
+	free_dev_info(lc, NULL);
+}
+
+/*
+ * Discover RAID sets on @devnodes (all devices if NULL).
+ *
+ * Return 1 for success, 0 for failure.
+ */
+static int _lib_scan(struct lib_context *lc, char **devnodes)
+{
+	char *no_sets[] = { NULL };
+
+	_lib_reset(lc);
+	if (!discover_devices(lc, devnodes) || !count_devices(lc, DEVICE))
+		return 0;
+
+	discover_raid_devices(lc, NULL);
+	return count_devices(lc, RAID) && group_set(lc, no_sets) &&
+	       count_devices(lc, SET);
+}
+
+/* Rescan metadata and run the library function for @action. */
+static int _dso_perform(struct lib_context *lc, char **devnodes,
+			enum action action)
+{
+	int ret = 1;
+	char *no_sets[] = { NULL };
+	struct prepost *p, pp;
 
 	/* Find appropriate action. */
 	for (p = prepost; p < ARRAY_END(prepost); p++) {
-		if (p->action & action)
-			return lib_perform(lc, action, p, argv);
+		if (!(p->action & action))
+			continue;
+
+		if (p->lock == LOCK && !lock_resource(lc, NULL)) {
+			syslog(LOG_ERR, "Failed to lock for action");
+			return 1;
+		}
+
+		/* Metadata got retrieved by _lib_scan() already. */
+		pp = *p;
+		pp.metadata = 0;
+		pp.lock = NO_LOCK;
+		if (_lib_scan(lc, devnodes))
+			ret = lib_perform(lc, action, &pp, no_sets);
+
+		if (p->lock == LOCK)
+			unlock_resource(lc, NULL);
+
+		break;
 	}
 
-	return 0;
+	return ret;
 }
 
 /* Find entry in RAID sets device list by major:minor or device name. */
 enum find_type { BY_NUM, BY_NAME };
+static int _topo_find(enum find_type type, const char *id,
+		      struct dso_raid_dev *dev);
 static struct dso_raid_dev *_find_dso_dev(struct dso_raid_set *rs,
 					  enum find_type type, const char *id)
 {
 	int i;
-	struct dso_raid_dev *dev;
+	struct dso_raid_dev *dev, tmp;
 
 	for (dev = rs->devs, i = rs->num_devs; i--; dev++) {
 		if (!strcmp(id, type == BY_NUM ? dev->major_minor :
@@ -478,21 +807,22 @@ static struct dso_raid_dev *_find_dso_dev(struct dso_raid_set *rs,
 			return dev;
 	}
 
-	syslog(LOG_ERR, "Finding RAID dev for \"%s\" failed!", id);
-	return NULL;
-}
-
-/* Return number of devices in @status string by counting 'A'/'D' characters. */
-static int _get_num_devs_from_status(char *status)
-{
-	int ret;
-
-	for (ret = 0; *status; status++) {
-		if (*status == 'A' || *status == 'D')
-			ret++;
+	/*
+	 * Member got a new major:minor (eg. after a hot plug)?
+	 * Map it to its name and update the entry.
+	 */
+	if (type == BY_NUM && !_topo_find(BY_NUM, id, &tmp)) {
+		for (dev = rs->devs, i = rs->num_devs; i--; dev++) {
+			if (!strcmp(tmp.name, dev->name)) {
+				strcpy(dev->major_minor, tmp.major_minor);
+				dev->port = tmp.port;
+				return dev;
+			}
+		}
 	}
 
-	return ret;
+	syslog(LOG_ERR, "Finding RAID dev for \"%s\" failed!", id);
+	return NULL;
 }
 
 /* Cleanup scandir() allocations. */
@@ -511,15 +841,9 @@ static void _destroy_dirent(struct dirent **dir_ent,
 	}
 }
 
-/*
- * On event status parsing failure:
- * free arguments in @args if any and log error message @what.
- */
-static void _event_cleanup_and_log(char **args, const char *what)
+/* On event status parsing failure: log error message @what. */
+static void _event_log_parse_failure(const char *what)
 {
-	if (args)
-		dm_free(args);
-
 	syslog(LOG_ERR, "  Unable to parse %s status string.", what);
 }
 
@@ -578,59 +902,225 @@ static int _get_sysfs_major_minor(const char *d_name, char *major_minor,
 }
 
 /*
- * Retrieve device properties for @dev_name from sysfs
- * (major:minor and port number) into @dev.
+ * Device topology map: major:minor and port of all SCSI block devices.
  *
- * Return 0 for failure, 0 for success.
+ * Built from sysfs once and kept until a kernel uevent on the block or
+ * scsi_device subsystems (ie. a device got added, removed or changed)
+ * marks it stale. Without a uevent socket, it gets rebuilt on every use.
  */
-/* FIXME: straighten this by using libsysfs ? */
-static int _set_raid_dev_properties(const char *dev_name,
-				    struct dso_raid_dev *dev,
-				    enum log_type log_type)
+static struct {
+	pthread_mutex_t mutex;
+	int init;
+	int stale;
+	int nl;			/* Uevent netlink socket or -1. */
+	int num_devs;
+	int max_devs;
+	struct dso_raid_dev *devs;
+} _topo = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.nl = -1,
+};
+
+/* Open the uevent netlink socket. */
+static void _topo_uevent_open(void)
 {
-	int dir_entries, i, len;
-	char path[BUF_SIZE];
-	DIR *dir;
-	struct dirent **dir_ent;
+	struct sockaddr_nl addr = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = 1, /* Kernel uevents. */
+	};
 
-	strcpy(dev->name, dev_name);
+	_topo.nl = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+			  NETLINK_KOBJECT_UEVENT);
+	if (_topo.nl < 0)
+		return;
+
+	if (bind(_topo.nl, (struct sockaddr *) &addr, sizeof(addr))) {
+		close(_topo.nl);
+		_topo.nl = -1;
+	}
+}
+
+/* Drain pending uevents; mark map stale on any relevant one. */
+static void _topo_uevents(void)
+{
+	char buf[4096], *p;
+	ssize_t len;
+
+	while ((len = recv(_topo.nl, buf, sizeof(buf) - 1, MSG_DONTWAIT))) {
+		if (len < 0) {
+			/* Socket buffer overrun: events lost. */
+			if (errno == ENOBUFS)
+				_topo.stale = 1;
+			else if (errno != EINTR)
+				break;
+
+			continue;
+		}
+
+		/* "ACTION@DEVPATH" followed by "KEY=VALUE" strings. */
+		buf[len] = 0;
+		for (p = buf; p < buf + len; p += strlen(p) + 1) {
+			if (!strcmp(p, "SUBSYSTEM=block") ||
+			    !strcmp(p, "SUBSYSTEM=scsi_device"))
+				_topo.stale = 1;
+		}
+	}
+}
+
+/* Add block device @name on @port to the map. */
+static void _topo_add(const char *name, int port)
+{
+	struct dso_raid_dev *dev;
 
-	/* Get major:minor of this RAID device. */
-	if (_get_sysfs_major_minor(dev_name, dev->major_minor, log_type))
-		return -ENOENT;
+	if (strlen(name) >= DEV_NAME)
+		return;
+
+	if (_topo.num_devs == _topo.max_devs) {
+		int n = _topo.max_devs ? 2 * _topo.max_devs : 32;
+
+		if (!(dev = dm_realloc(_topo.devs, n * sizeof(*dev))))
+			return;
+
+		_topo.devs = dev;
+		_topo.max_devs = n;
+	}
+
+	dev = _topo.devs + _topo.num_devs;
+	_dso_dev_init(dev);
+	strcpy(dev->name, name);
+	dev->port = port;
+	if (!_get_sysfs_major_minor(name, dev->major_minor, LOG_NONE))
+		_topo.num_devs++;
+}
+
+/*
+ * (Re)build the map by walking /sys/class/scsi_device/H:C:T:L/device,
+ * which holds either a "block" directory containing the device name or,
+ * with older kernels, a "block:NAME" entry.
+ */
+static void _topo_build(void)
+{
+	int dir_entries, i, len;
+	char path[BUF_SIZE];
+	DIR *dir, *blk;
+	struct dirent **dir_ent, *de;
 
+	_topo.num_devs = 0;
+	_topo.stale = _topo.nl < 0;
 	dir_entries = _scandir(sys_scsi_path, &dir_ent, _scandir_dot_filter);
 	if (dir_entries < 0)
-		return -ENOENT;
+		return;
 
-	/* Remember length of initial sysfs path. */
-	strcpy(path, sys_scsi_path);
-	len = strlen(path);
-	dev->port = -1;
 	for (i = 0; i < dir_entries; i++) {
-		int j;
-		/* d_name is the "X:X:X:X". */
+		/* d_name is the "H:C:T:L"; the host is the port. */
 		const char *d_name = dir_ent[i]->d_name;
+		int port = atoi(d_name);
 
-		for (j = 0; j < sizeof(sys_scsi_dev_blk_delims); j++) {
-			/* Append the "X:X:X:X/device/block[:/]$name". */
-			sprintf(path + len, "%s%s%c%s", d_name,
-				sys_scsi_dev_blk,
-				sys_scsi_dev_blk_delims[j], dev_name);
+		len = snprintf(path, sizeof(path), "%s%s%s/", sys_scsi_path,
+			       d_name, sys_scsi_dev_dir);
+		if (len >= sizeof(path) - DEV_NAME || !(dir = opendir(path)))
+			continue;
+
+		while ((de = readdir(dir))) {
+			const char *n = de->d_name;
+			int l = strlen(sys_scsi_dev_blk);
+
+			if (strncmp(n, sys_scsi_dev_blk, l))
+				continue;
+
+			if (n[l] == ':')
+				_topo_add(n + l + 1, port);
+			else if (!n[l]) {
+				strcpy(path + len, n);
+				if ((blk = opendir(path))) {
+					while ((de = readdir(blk))) {
+						if (*de->d_name != '.')
+							_topo_add(de->d_name,
+								  port);
+					}
 
-			if ((dir = opendir(path))) {
-				closedir(dir);
-				dev->port = atoi(d_name);
-				goto out;
+					closedir(blk);
+				}
+
+				break;
 			}
 		}
 
-		dm_free(dir_ent[i]);
+		closedir(dir);
 	}
 
-out:
-	_destroy_dirent(dir_ent, i, dir_entries);
-	return 0;
+	_destroy_dirent(dir_ent, 0, dir_entries);
+}
+
+/*
+ * Look up device by major:minor or name @id in the map and copy it to @dev.
+ *
+ * Return 1 for failure, 0 for success.
+ */
+static int _topo_find(enum find_type type, const char *id,
+		      struct dso_raid_dev *dev)
+{
+	int i, ret = 1;
+	struct dso_raid_dev *d;
+
+	pthread_mutex_lock(&_topo.mutex);
+	if (!_topo.init) {
+		_topo_uevent_open();
+		_topo.init = _topo.stale = 1;
+	}
+
+	if (_topo.nl > -1)
+		_topo_uevents();
+
+	if (_topo.stale)
+		_topo_build();
+
+	for (d = _topo.devs, i = _topo.num_devs; i--; d++) {
+		if (!strcmp(id, type == BY_NUM ? d->major_minor : d->name)) {
+			__dso_dev_copy(dev, d);
+			ret = 0;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&_topo.mutex);
+	return ret;
+}
+
+/* Release the map. */
+static void _topo_exit(void)
+{
+	pthread_mutex_lock(&_topo.mutex);
+	if (_topo.nl > -1)
+		close(_topo.nl);
+
+	if (_topo.devs)
+		dm_free(_topo.devs);
+
+	_topo.devs = NULL;
+	_topo.nl = -1;
+	_topo.init = _topo.num_devs = _topo.max_devs = 0;
+	pthread_mutex_unlock(&_topo.mutex);
+}
+
+/*
+ * Retrieve device properties for @dev_name from the topology map
+ * (major:minor and port number) into @dev.
+ *
+ * Return 1 for failure, 0 for success.
+ */
+static int _set_raid_dev_properties(const char *dev_name,
+				    struct dso_raid_dev *dev,
+				    enum log_type log_type)
+{
+	if (!_topo_find(BY_NAME, dev_name, dev))
+		return 0;
+
+	/* Not a SCSI device: no port. */
+	strcpy(dev->name, dev_name);
+	dev->port = -1;
+	return _get_sysfs_major_minor(dev_name, dev->major_minor, log_type) ?
+	       -ENOENT : 0;
 }
 
 /*
@@ -642,7 +1132,7 @@ static int _repopulate(const char *rs_name, char *dev_names)
 {
 	int r, ret = 0;
 	char *dev_name;
-	struct dso_raid_set *rs = _find_raid_set(rs_name, NULL, 1);
+	struct dso_raid_set *rs = _find_raid_set(rs_name, 0, 1);
 	struct dso_raid_dev *dev;
 
 	if (!rs)
@@ -684,48 +1174,194 @@ static int _repopulate(const char *rs_name, char *dev_names)
 	return !!ret;
 }
 
-/* DSO main function. */
-static int _lib_main(char op, const char *device)
+/* Free the list of devices to rescan. */
+static void _free_devnodes(struct dso_raid_set *rs)
+{
+	char **d;
+
+	if (rs->devnodes) {
+		for (d = rs->devnodes; *d; d++)
+			dm_free(*d);
+
+		dm_free(rs->devnodes);
+		rs->devnodes = NULL;
+	}
+}
+
+/* Add @path to the list of devices to rescan unless there already. */
+static int _add_devnode(struct dso_raid_set *rs, const char *path, int *n)
 {
-	int lib_argc = 3, ret = 0;
-	char op_str[] = { op, '\0' },
-	     *lib_argv[] = {
-		(char *) "dso",
-		op_str,
-		dm_strdup((char *)device),
-		NULL,
-	}, *dev_name = lib_argv[2];
-	struct lib_context *lc;
+	int i;
+	char **tmp;
 
-	if (!dev_name) {
-		syslog(LOG_ERR, "Failed to allocate memory for device name");
+	for (i = 0; i < *n; i++) {
+		if (!strcmp(rs->devnodes[i], path))
+			return 1;
+	}
+
+	tmp = dm_realloc(rs->devnodes, (*n + 2) * sizeof(*tmp));
+	if (!tmp)
+		return 0;
+
+	rs->devnodes = tmp;
+	if (!(rs->devnodes[*n] = dm_strdup((char *) path)))
 		return 0;
+
+	rs->devnodes[++(*n)] = NULL;
+	return 1;
+}
+
+/*
+ * Remember the member devices of RAID set @rs and any spares
+ * the last scan found, so that following events only need to
+ * rescan those rather than every block device in the system.
+ */
+static void _lib_remember(struct lib_context *lc, struct dso_raid_set *rs)
+{
+	int n = 0;
+	struct raid_set *sub_rs = find_set(lc, NULL, rs->name, FIND_ALL);
+	struct raid_dev *rd;
+
+	_free_devnodes(rs);
+	if (!sub_rs)
+		return;
+
+	list_for_each_entry(rd, &sub_rs->devs, devs) {
+		if (!_add_devnode(rs, rd->di->path, &n))
+			goto err;
 	}
 
-	lc = libdmraid_init(lib_argc, lib_argv);
-	if (lc) {
-		enum action action = _lib_set_action(lc, op, dev_name);
+	list_for_each_entry(rd, LC_RD(lc), list) {
+		if (T_SPARE(rd) && !_add_devnode(rs, rd->di->path, &n))
+			goto err;
+	}
 
-		if (action != UNDEF) {
-			/*
-			* init_locking returns 1 for success
-			* _dso_perform returns 0 for success
-			*/
-			ret = !init_locking(lc) ||
-			      _dso_perform(lc, lib_argv + lib_argc, action);
+	return;
+
+err:
+	/* Fall back to rescanning all devices. */
+	syslog(LOG_ERR, "Failed to allocate device list of RAID set \"%s\"",
+	       rs->name);
+	_free_devnodes(rs);
+}
 
-			if (!ret &&
-			    action == GET_MEMBERS) 
-				ret = _repopulate(device, (char *)OPT_STR(lc, LC_REBUILD_SET));
+/* Release the library context of @rs. */
+static void _lib_exit(struct dso_raid_set *rs)
+{
+	_free_devnodes(rs);
+	if (rs->lc) {
+		libdmraid_exit(rs->lc);
+		rs->lc = NULL;
+	}
+}
+
+/*
+ * DSO main function.
+ *
+ * The library context of @rs is created on first use and kept
+ * until @rs gets unregistered. Rebuild starts scan all devices to
+ * find spares, anything else just the devices remembered.
+ */
+/* Create library context of @rs on first use; return 0 for success. */
+static int _lib_init(struct dso_raid_set *rs)
+{
+	char *lib_argv[] = { (char *) "dso", NULL, };
+
+	if (!rs->lc) {
+		rs->lc = libdmraid_init(1, lib_argv);
+		if (!rs->lc)
+			return 1;
+
+		/* init_locking returns 1 for success. */
+		if (!init_locking(rs->lc)) {
+			_lib_exit(rs);
+			return 1;
 		}
+	}
+
+	return 0;
+}
+
+static int _lib_main(char op, struct dso_raid_set *rs)
+{
+	int ret = 1;
+	enum action action;
 
-		libdmraid_exit(lc);
+	if (_lib_init(rs))
+		return 1;
+
+	if (op == 'R')
+		_free_devnodes(rs);
+
+	action = _lib_set_action(rs->lc, op, rs->name);
+	if (action != UNDEF) {
+		/* _dso_perform returns 0 for success. */
+		ret = _dso_perform(rs->lc, rs->devnodes, action);
+		_lib_remember(rs->lc, rs);
+
+		/* Don't keep member devices open until the next event. */
+		_lib_reset(rs->lc);
+
+		if (!ret &&
+		    action == GET_MEMBERS) 
+			ret = _repopulate(rs->name,
+					  (char *)OPT_STR(rs->lc, LC_REBUILD_SET));
 	}
 
-	dm_free(dev_name);
 	return ret; /* return 0 for success */
 }
 
+/*
+ * Hand failure of member @dev_name to the format's event handler
+ * through the library, which writes the metadata it changed.
+ */
+static void _lib_event_io(struct dso_raid_set *rs, const char *dev_name)
+{
+	if (_lib_init(rs))
+		return;
+
+	if (!lock_resource(rs->lc, NULL)) {
+		syslog(LOG_ERR, "Failed to lock for event");
+		return;
+	}
+
+	if (_lib_scan(rs->lc, rs->devnodes) &&
+	    dso_event_io(rs->lc, rs->name, dev_name, 0))
+		syslog(LOG_NOTICE, "  Failure of %s recorded in metadata",
+		       dev_name);
+
+	_lib_reset(rs->lc);
+	unlock_resource(rs->lc, NULL);
+}
+
+/* Checkpoint rebuild of @rs at @sector in the metadata. */
+static void _lib_checkpoint(struct dso_raid_set *rs, uint64_t sector)
+{
+	if (_lib_init(rs))
+		return;
+
+	if (!lock_resource(rs->lc, NULL)) {
+		syslog(LOG_ERR, "Failed to lock for checkpoint");
+		return;
+	}
+
+	if (!_lib_scan(rs->lc, rs->devnodes))
+		goto out;
+
+	if (dso_rebuild_checkpoint(rs->lc, rs->name, sector)) {
+		rs->checkpoint = sector;
+		syslog(LOG_INFO, "Rebuild of RAID set %s checkpointed at "
+		       "sector %llu", rs->name, (unsigned long long) sector);
+	} else
+		/* Don't rescan on every timeout for nothing. */
+		rs->no_checkpoints = 1;
+
+out:
+
+	_lib_reset(rs->lc);
+	unlock_resource(rs->lc, NULL);
+}
+
 /*******************************************/
 
 
@@ -738,7 +1374,7 @@ static int _log_event(struct dm_task *dmt,
 		     const char *major_minor, const char *type)
 {
 	const char *dev_name = dm_task_get_name(dmt);
-	struct dso_raid_set *rs = _find_raid_set(dev_name, NULL, 1);
+	struct dso_raid_set *rs = _find_raid_set(dev_name, 0, 1);
 	struct dso_raid_dev *dev;
 	struct dm_info dev_info;
 
@@ -1000,16 +1636,18 @@ static struct dso_raid_set *_create_raid_set(const char *rs_name,
 static int _rebuild(enum rebuild_type rebuild_type, const char *dev_name)
 {
 	int ret = 0;
-	struct dso_raid_set *rs = _find_raid_set(dev_name, NULL, 1);
+	struct dso_raid_set *rs = _find_raid_set(dev_name, 0, 1);
 
-	if (!rs)
+	if (!DSO_ISW || !rs)
 		return 0;
 
 	switch (rebuild_type) {
 	case REBUILD_START:
-		if (!_lib_main('R', dev_name)) {
+		if (!_lib_main('R', rs)) {
 			syslog(LOG_INFO, "Rebuild started");
-			_lib_main('r', dev_name);
+			rs->checkpoint = 0;
+			rs->no_checkpoints = 0;
+			_lib_main('r', rs);
 
 			/* Turn all LEDs to rebuild state. */
 			_dev_led_all(DSO_LED_REBUILD, rs);
@@ -1020,8 +1658,8 @@ static int _rebuild(enum rebuild_type rebuild_type, const char *dev_name)
 		break;
 
 	case REBUILD_END:
-		if (!_lib_main('F', dev_name) ||
-		    !_lib_main('r', dev_name))
+		if (!_lib_main('F', rs) ||
+		    !_lib_main('r', rs))
 			syslog(LOG_NOTICE, "Rebuild of RAID set %s complete",
 					dev_name);
 			
@@ -1035,30 +1673,47 @@ static int _rebuild(enum rebuild_type rebuild_type, const char *dev_name)
 }
 
 
-/* Get number of devices from status parameter string. */
-static int _get_num_devs(char *params, char **p)
+/*
+ * Log failure of member @major_minor, set its LED to fault and
+ * remove it from @rs. Return D_FAILURE_DISK if found, else @ret.
+ */
+static enum disk_state_type _dso_dev_failed(struct dm_task *dmt,
+					    struct dso_raid_set *rs,
+					    const char *major_minor,
+					    const char *what,
+					    enum disk_state_type ret)
 {
-	/* Split number of devices from status parameter string. */
-	if (dm_split_words(params, 1, 0, p) == 1) {
-		char *numstr = *p;
+	struct dso_raid_dev *dev;
+
+	_log_event(dmt, major_minor, what);
+
+	/* Find and remove failed disk member. */
+	dev = _find_dso_dev(rs, BY_NUM, major_minor);
+	if (dev) {
+		/* Persist the failure through the format's handler. */
+		if (!DSO_ISW)
+			_lib_event_io(rs, dev->name);
+
+		/* Set device LED to fault on port. */
+		_dev_led_one(DSO_LED_FAULT, SGPIO_PORT, dev);
 
-		/* Skip past split num_devs. */
-		*p += strlen(*p) + 1;
-		return atoi(numstr);
+		/* Copy last device in set; reduce num_devs. */
+		_dso_dev_copy(rs, dev);
+		ret = D_FAILURE_DISK;
 	}
 
-	return 0;
+	return ret;
 }
 
 /* Get the stripe device(s) that caused the trigger. */
 static enum disk_state_type _process_stripe_event(struct dm_task *dmt,
 						  char *params)
 {
-	int argc, i, num_devs, ret = D_INSYNC;
-	char **args = NULL, *dev_status_str, *p;
+	unsigned int i;
+	enum disk_state_type ret = D_INSYNC;
 	const char *rs_name = dm_task_get_name(dmt);
-	struct dso_raid_set *rs = _find_raid_set(rs_name, NULL, 1);
-	struct dso_raid_dev *dev;
+	struct dso_raid_set *rs = _find_raid_set(rs_name, 0, 1);
+	struct dm_status st;
 
 	if (!rs)
 		return D_IGNORE;
@@ -1069,60 +1724,30 @@ static enum disk_state_type _process_stripe_event(struct dm_task *dmt,
 	 * stripe device parms:		2 253:4 253:5 
 	 * stripe device status:	1 AA
 	 */
-
-	/* Number of devices. */
-	num_devs = _get_num_devs(params, &p);
-	if (!num_devs)
-		goto err;
-
-	/* Allocate array for num_devs plus status paramter count + chars. */
-	argc = num_devs + 2;
-	args = dm_malloc(argc * sizeof(*args));
-	if (!args ||
-	    dm_split_words(p, argc, 0, args) != argc)
-		goto err;
-
-	/* Consistency check on num_devs and status chars. */
-	dev_status_str = args[num_devs + 1];
-	i = _get_num_devs_from_status(dev_status_str);
-	if (i != num_devs)
-		goto err;
+	if (!dm_status_parse("striped", params, &st)) {
+		_event_log_parse_failure("stripe");
+		return D_IGNORE;
+	}
 
 	/* Check for bad stripe devices. */
-	for (i = 0, p = dev_status_str; i < rs->num_devs; i++, p++) {
-		if (*p == 'D') {
-			_log_event(dmt, args[i], "Stripe device dead");
-
-			/* Find and remove failed striped device member. */
-			dev = _find_dso_dev(rs, BY_NUM, args[i]);
-			if (dev) {
-				/* Set device LED to fault on device. */
-				_dev_led_one(DSO_LED_FAULT, SGPIO_PORT, dev);
-
-				/* Copy last device in set; reduce num_devs. */
-				_dso_dev_copy(rs, dev);
-				ret = D_FAILURE_DISK;
-			}
-		}
+	for (i = 0; i < st.num_devs; i++) {
+		if (st.devs[i].health == DM_HEALTH_DEAD)
+			ret = _dso_dev_failed(dmt, rs, st.devs[i].name,
+					      "Stripe device dead", ret);
 	}
 
 	return ret;
-
-err:
-	/* Clean up and syslog. */
-	_event_cleanup_and_log(args, "stripe");
-	return D_IGNORE;
 }
 
 /* Get the mirror event that caused the trigger. */
 static enum disk_state_type _process_mirror_event(struct dm_task *dmt,
 						  char *params)
 {
-	int argc, i, log_argc, num_devs, ret = D_INSYNC;
-	char **args = NULL, *dev_status_str,
-	     *log_status_str = NULL, *p, *sync_str;
+	unsigned int i;
+	enum disk_state_type ret = D_INSYNC;
 	const char *rs_name = dm_task_get_name(dmt);
-	struct dso_raid_set *rs = _find_raid_set(rs_name, NULL, 1);
+	struct dso_raid_set *rs = _find_raid_set(rs_name, 0, 1);
+	struct dm_status st;
 
 	if (!rs)
 		return D_IGNORE;
@@ -1136,124 +1761,63 @@ static enum disk_state_type _process_mirror_event(struct dm_task *dmt,
 	 *	 *or*			3 disk 253:3 A
 	 *	 *or*  			1 core
 	 */
-
-	/* Number of devices. */
-	num_devs = _get_num_devs(params, &p);
-	if (!num_devs)
-		goto err;
-
-	/* devices names + "400/400 1 AA" + 1 or 3 log parms. */
-	argc = num_devs + 4;
-	args = dm_malloc(argc * sizeof(*args));
-	if (!args ||
-	    dm_split_words(p, argc, 0, args) != argc)
-		goto err;
-
-	log_argc = atoi(args[num_devs + 3]);
-	if (!log_argc)
-		goto err;
-
-	if (log_argc > 1) {
-		/* Skip split pointer past last split argument. */
-		p += strlen(args[argc - 1]) + 1;
-
-		/* Reallocate array for new members. */
-		argc += log_argc;
-		args = dm_realloc(args, argc * sizeof(*args));
-		if (!args ||
-		    dm_split_words(p, log_argc, 0,
-				   args + argc - log_argc) != log_argc)
-			goto err;
-	
-		log_status_str = args[num_devs + log_argc + 3];
+	if (!dm_status_parse("mirror", params, &st)) {
+		_event_log_parse_failure("mirror");
+		return D_IGNORE;
 	}
 
-	/* Consistency check on num_devs and status chars. */
-	dev_status_str = args[num_devs + 2];
-	i = _get_num_devs_from_status(dev_status_str);
-	if (i != num_devs)
-		goto err;
-
-	sync_str = args[num_devs];
-
 	/* Check for bad mirror devices. */
-	for (i = 0, p = dev_status_str; i < rs->num_devs; i++, p++) {
-		struct dso_raid_dev *dev;
+	for (i = 0; i < st.num_devs; i++) {
+		const char *mm = st.devs[i].name;
 
-		switch (*p) {
+		switch (st.devs[i].health) {
 		/* Mirror leg dead -> remove it. */
-		case 'D': 
-			_log_event(dmt, args[i], "Mirror device failed");
-
-			/* Find and remove failed disk member. */
-			dev = _find_dso_dev(rs, BY_NUM, args[i]);
-			if (dev) {
-				/* Set device LED to fault on port. */
-				_dev_led_one(DSO_LED_FAULT, SGPIO_PORT, dev);
-	
-				/* Copy last device in set; reduce num_devs. */
-				_dso_dev_copy(rs, dev);
-				ret = D_FAILURE_DISK;
-			}
-
+		case DM_HEALTH_DEAD:
+			ret = _dso_dev_failed(dmt, rs, mm,
+					      "Mirror device failed", ret);
 			break; 
 
-		case 'R':
-			_log_event(dmt, args[i], "Mirror device read error");
+		case DM_HEALTH_READ_ERROR:
+			_log_event(dmt, mm, "Mirror device read error");
 			ret = D_FAILURE_READ;
 			break;
 
-		case 'S':
-			syslog(LOG_ERR, "Mirror device %s out of sync",
-			       args[i]);
+		case DM_HEALTH_NOSYNC:
+			syslog(LOG_ERR, "Mirror device %s out of sync", mm);
 			ret = D_FAILURE_NOSYNC;
 			break;
 
-		case 'U':
-			_log_event(dmt, args[i], "Mirror device unknown error");
+		case DM_HEALTH_UNKNOWN:
+			_log_event(dmt, mm, "Mirror device unknown error");
 			ret = D_FAILURE_DISK;
+
+		default:
+			break;
 		}
 	}
 
 	if (ret > D_INSYNC)
-		goto out;
+		return ret;
 
 	/* Check for bad disk log device. */
-	if (log_argc > 1 &&
-	    *log_status_str == 'D') {
-		syslog(LOG_ERR, "  Log device, %s, has failed.",
-		       args[num_devs + log_argc + 2]);
-		ret = D_FAILURE_LOG;
-		goto out;
+	if (st.log.dev && st.log.health == DM_HEALTH_DEAD) {
+		syslog(LOG_ERR, "  Log device, %s, has failed.", st.log.dev);
+		return D_FAILURE_LOG;
 	}
 
 	/* Compare the sync/total counters. */
-	p = strstr(sync_str, "/");
-	if (p++)
-		ret = strncmp(sync_str, p, strlen(p)) ? D_IGNORE : D_INSYNC;
-	else
-		goto err;
-
-out:
-	if (args)
-		dm_free(args);
-
-	return ret;
-
-err:
-	_event_cleanup_and_log(args, "mirror");
-	return D_IGNORE;
+	return st.sync == st.total ? D_INSYNC : D_IGNORE;
 }
 
 /* Get the raid45 device(s) that caused the trigger. */
 static enum disk_state_type _process_raid45_event(struct dm_task *dmt,
 						  char *params)
 {
-	int argc, i, num_devs, dead, ret = D_INSYNC;
-	char **args = NULL, *dev_status_str, *p;
+	unsigned int i;
+	enum disk_state_type ret = D_INSYNC;
 	const char *rs_name = dm_task_get_name(dmt);
-	struct dso_raid_set *rs = _find_raid_set(rs_name, NULL, 1);
-	struct dso_raid_dev *dev;
+	struct dso_raid_set *rs = _find_raid_set(rs_name, 0, 1);
+	struct dm_status st;
 
 	if (!rs)
 		return D_IGNORE;
@@ -1264,60 +1828,82 @@ static enum disk_state_type _process_raid45_event(struct dm_task *dmt,
 	 * raid45 device parms:     	3 253:4 253:5 253:6
 	 * raid45 device status:	1 AAA
 	 */
+	if (!dm_status_parse("raid45", params, &st)) {
+		_event_log_parse_failure("raid45");
+		return D_IGNORE;
+	}
 
-	/* Number of devices. */
-	num_devs = _get_num_devs(params, &p);
-	if (!num_devs)
-		goto err;
-
-	/* Devices names + "1" + "AA". */
-	argc = num_devs + 2;
-	args = dm_malloc(argc * sizeof(*args));
-	if (!args ||
-	    dm_split_words(p, argc, 0, args) != argc)
-		goto err;
+	/* Check for bad raid45 devices. */
+	for (i = 0; i < st.num_devs; i++) {
+		if (st.devs[i].health == DM_HEALTH_DEAD)
+			ret = _dso_dev_failed(dmt, rs, st.devs[i].name,
+					      "Raid45 device failed", ret);
+	}
 
-	dev_status_str = args[num_devs + 1];
+	return ret;
+}
 
-	/* Consistency check on num_devs and status chars. */
-	i = _get_num_devs_from_status(dev_status_str);
-	if (i != num_devs)
-		goto err;
+/* Get the raid device(s) that caused the trigger. */
+static enum disk_state_type _process_raid_event(struct dm_task *dmt,
+						char *params)
+{
+	unsigned int i;
+	enum disk_state_type ret = D_INSYNC;
+	uint64_t start, length;
+	char *target_type = NULL, *table;
+	const char *rs_name = dm_task_get_name(dmt);
+	struct dso_raid_set *rs = _find_raid_set(rs_name, 0, 1);
+	struct dm_task *tt;
+	struct dm_status st;
 
-	/* Check for bad raid45 devices. */
-	for (i = 0, p = dev_status_str; i < rs->num_devs; i++) {
-		/* Skip past any non active/dead identifiers. */
-		dead = *(p++) == 'D';
-		while (*p && *p != 'A' && *p != 'D')
-			p++;
+	if (!rs)
+		return D_IGNORE;
 
-		if (!dead)
-			continue;
+	/*
+	 * dm core parms (NOT provided in @params):	0 976783872 raid
+	 *
+	 * raid device status:		raid5_ls 3 AAa 1024/2048 recover 0
+	 *
+	 * Device numbers are only provided in the table:
+	 *				raid5_ls 1 128 3 - 253:4 - 253:5 - 253:6
+	 */
+	if (!dm_status_parse("raid", params, &st)) {
+		_event_log_parse_failure("raid");
+		return D_IGNORE;
+	}
 
-		_log_event(dmt, args[i], "Raid45 device failed");
+	if (!(tt = dm_task_create(DM_DEVICE_TABLE)))
+		return D_IGNORE;
 
-		/* Find and remove failed disk member. */
-		dev = _find_dso_dev(rs, BY_NUM, args[i]);
-		if (dev) {
-			/* Set device LED to fault on port. */
-			_dev_led_one(DSO_LED_FAULT, SGPIO_PORT, dev);
+	if (!dm_task_set_name(tt, rs_name) || !dm_task_run(tt) ||
+	    (dm_get_next_target(tt, NULL, &start, &length,
+				&target_type, &table), !target_type) ||
+	    strcmp(target_type, "raid") || !dm_status_raid_devs(table, &st)) {
+		_event_log_parse_failure("raid table");
+		ret = D_IGNORE;
+		goto out;
+	}
 
-			/* Copy last device in set; reduce num_devs. */
-			_dso_dev_copy(rs, dev);
-			ret = D_FAILURE_DISK;
-		}
+	/* Check for bad raid devices. */
+	for (i = 0; i < st.num_devs; i++) {
+		if (st.devs[i].health == DM_HEALTH_DEAD && st.devs[i].name)
+			ret = _dso_dev_failed(dmt, rs, st.devs[i].name,
+					      "Raid device failed", ret);
 	}
 
-	return ret;
+	/* Resynchronization still running? */
+	if (ret == D_INSYNC && st.sync != st.total)
+		ret = D_IGNORE;
 
-err:
-	_event_cleanup_and_log(args, "raid45");
-	return D_IGNORE;
+out:
+	dm_task_destroy(tt);
+	return ret;
 }
 
 
 /* Process RAID device events. */
-static void _process_event(char *target_type, struct dm_task *dmt, char *params)
+static void _process_event(char *target_type, struct dm_task *dmt, char *params,
+			   int resyncing)
 {
 	const char *uuid = dm_task_get_uuid(dmt);
 	const char *rs_name = dm_task_get_name(dmt);
@@ -1329,6 +1915,7 @@ static void _process_event(char *target_type, struct dm_task *dmt, char *params)
 		{ "striped", _process_stripe_event, 0 },
 		{ "mirror",  _process_mirror_event, 1 },
 		{ "raid45",  _process_raid45_event, 1 },
+		{ "raid",    _process_raid_event, 1 },
 	};
 #ifdef	_LIBDMRAID_DSO_TESTING
 	struct dso_raid_set *rs;
@@ -1338,8 +1925,9 @@ static void _process_event(char *target_type, struct dm_task *dmt, char *params)
 	 * Determine if this was a
 	 * stripe (raid 0),
 	 * mirror (raid 1)
+	 * raid45 (raid 4/5)
 	 * or
-	 * raid45 (raid 4/5).
+	 * raid (dm-raid).
 	 */
 	for (proc = process; proc < ARRAY_END(process); proc++) {
 		if (!strcmp(target_type, proc->target_type))
@@ -1351,6 +1939,10 @@ static void _process_event(char *target_type, struct dm_task *dmt, char *params)
 
 	switch (proc->f(dmt, params)) {
 	case D_INSYNC:
+		/* Another segment of the mapping may still resynchronize. */
+		if (proc->rebuild && resyncing)
+			break;
+
 		if (proc->rebuild) {
 			_rebuild(REBUILD_END, rs_name);
 			syslog(LOG_NOTICE, "  %s is now in-sync", rs_name);
@@ -1386,6 +1978,124 @@ static void _process_event(char *target_type, struct dm_task *dmt, char *params)
 #endif
 }
 
+/* Concatenate target types and parameters of @dmt into one string. */
+static char *_status_string(struct dm_task *dmt)
+{
+	void *next = NULL;
+	uint64_t start, length;
+	char *params, *target_type, *str = NULL, *tmp;
+	size_t len = 0, l;
+
+	do {
+		target_type = params = NULL;
+		next = dm_get_next_target(dmt, next, &start, &length,
+					  &target_type, &params);
+		l = (target_type ? strlen(target_type) : 0) +
+		    (params ? strlen(params) : 0) + 3;
+		if (!(tmp = dm_realloc(str, len + l))) {
+			if (str)
+				dm_free(str);
+
+			return NULL;
+		}
+
+		str = tmp;
+		len += sprintf(str + len, "%s %s;",
+			       target_type ? target_type : "",
+			       params ? params : "");
+	} while (next);
+
+	return str;
+}
+
+/*
+ * Find how far the mapping in @dmt is in sync: up to the first target
+ * still resynchronizing plus the part of it resynchronized already.
+ *
+ * Return 1 and set @sector if resynchronization is running, else 0.
+ */
+static int _resync_point(struct dm_task *dmt, uint64_t *sector)
+{
+	int ret = 0;
+	void *next = NULL;
+	uint64_t start, length;
+	char *params, *target_type, *p;
+	struct dm_status st;
+
+	do {
+		target_type = params = NULL;
+		next = dm_get_next_target(dmt, next, &start, &length,
+					  &target_type, &params);
+		if (!target_type || !params || !(p = dm_strdup(params)))
+			continue;
+
+		/* Parsing splits @p; mirror status counts regions. */
+		if (dm_status_parse(target_type, p, &st) &&
+		    st.total && st.sync < st.total) {
+			*sector = start + st.sync * (length / st.total);
+			ret = 1;
+		}
+
+		dm_free(p);
+	} while (!ret && next);
+
+	return ret;
+}
+
+/*
+ * Checkpoint an ongoing rebuild of @rs, unless it didn't
+ * progress since the last checkpoint or the format can't
+ * keep checkpoints.
+ */
+static void _checkpoint(struct dso_raid_set *rs, struct dm_task *dmt)
+{
+	uint64_t sector;
+
+	if (DSO_ISW && !rs->no_checkpoints && _resync_point(dmt, &sector) &&
+	    sector != rs->checkpoint)
+		_lib_checkpoint(rs, sector);
+}
+
+/* Return milliseconds elapsed since @ts. */
+static unsigned long _elapsed_ms(struct timespec *ts)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - ts->tv_sec) * 1000 +
+	       (now.tv_nsec - ts->tv_nsec) / 1000000;
+}
+
+/*
+ * Debounce an event on @rs.
+ *
+ * The first status change gets acted on right away. Events within the
+ * debounce interval of that decision get merged into it: unchanged
+ * status is dropped, changed status is left pending to be acted on
+ * with the first event or timeout after the interval expired.
+ *
+ * Return 1 to drop the event, 0 to process it.
+ */
+static int _debounce(struct dso_raid_set *rs, struct dm_task *dmt)
+{
+	int same;
+	char *status;
+
+	if (!_debounce_ms || !rs->status ||
+	    _elapsed_ms(&rs->decided) >= _debounce_ms ||
+	    !(status = _status_string(dmt)))
+		return 0;
+
+	/* The latest status decides whether anything is pending. */
+	same = !strcmp(status, rs->status);
+	dm_free(status);
+	if (same)
+		rs->coalesced++;
+
+	rs->pending = !same;
+	return 1;
+}
+
 /*
  * External function.
  *
@@ -1394,34 +2104,59 @@ static void _process_event(char *target_type, struct dm_task *dmt, char *params)
 void process_event(struct dm_task *dmt, enum dm_event_mask event,
 		   void **unused __attribute((unused)))
 {
+	int resyncing;
 	void *next = NULL;
-	uint64_t start, length;
+	uint64_t start, length, sector;
 	char *params, *target_type = NULL;
 	const char *rs_name = dm_task_get_name(dmt);
 	struct dso_raid_set *rs;
 
-	pthread_mutex_lock(&_register_mutex);
-
-	rs = _find_raid_set(rs_name, NULL, 1);
-	if (!rs) {
-		pthread_mutex_unlock(&_register_mutex);
+	/* Reference keeps unregistration from freeing the RAID set. */
+	rs = _find_raid_set(rs_name, 1, 1);
+	if (!rs)
 		return;
+
+	/*
+	 * Make sure, events are processed sequentially per RAID set.
+	 */
+	if (pthread_mutex_trylock(&rs->event_mutex)) {
+		syslog(LOG_NOTICE, "  Another thread is handling an event "
+		       "for RAID set \"%s\".  Waiting...", rs->name);
+		pthread_mutex_lock(&rs->event_mutex);
 	}
 
-	/* Flag RAID set in use to unregistration function. */
-	rs->flags |= RS_IN_USE;
+	/*
+	 * Periodic timeout: act on a status left pending by
+	 * debouncing, else just checkpoint any rebuild.
+	 */
+	if (event == DM_EVENT_TIMEOUT &&
+	    (!rs->pending || _elapsed_ms(&rs->decided) < _debounce_ms)) {
+		_checkpoint(rs, dmt);
+		goto out;
+	}
 
-	pthread_mutex_unlock(&_register_mutex);
+	/* Merged into the previous decision? Stay quiet. */
+	if (_debounce(rs, dmt))
+		goto out;
 
 	syslog(LOG_INFO, "Processing RAID set \"%s\" for Events", rs->name);
+	if (rs->coalesced) {
+		syslog(LOG_INFO, "  %lu unchanged event(s) coalesced",
+		       rs->coalesced);
+		rs->coalesced = 0;
+	}
 
 	/*
-	 * Make sure, events are processed sequentially per RAID set.
+	 * Take note of resynchronization and the status acted
+	 * on before status parsing splits the parameters.
 	 */
-	if (pthread_mutex_trylock(&rs->event_mutex)) {
-		syslog(LOG_NOTICE,
-		       "  Another thread is handling an event.  Waiting...");
-		pthread_mutex_lock(&rs->event_mutex);
+	resyncing = _resync_point(dmt, &sector);
+	rs->pending = 0;
+	if (_debounce_ms) {
+		if (rs->status)
+			dm_free(rs->status);
+
+		rs->status = _status_string(dmt);
 	}
 
 	do {
@@ -1433,18 +2168,21 @@ void process_event(struct dm_task *dmt, enum dm_event_mask event,
 		       ALL_EVENTS, start, length, target_type, params);
 #endif			  
 		if (target_type)
-			_process_event(target_type, dmt, params);
+			_process_event(target_type, dmt, params,
+				       resyncing);
 		else
 			syslog(LOG_INFO, "  %s mapping lost?!", rs_name);
 	} while (next);
 
-	pthread_mutex_unlock(&rs->event_mutex);
-
-	/* Flag RAID set ain't no more in use to unregister function. */
-	rs->flags &= ~RS_IN_USE;
+	/* Remember when status got acted on for subsequent events. */
+	if (_debounce_ms)
+		clock_gettime(CLOCK_MONOTONIC, &rs->decided);
 
 	syslog(LOG_INFO, "End of event processing for RAID set \"%s\"",
 	       rs_name);
+out:
+	pthread_mutex_unlock(&rs->event_mutex);
+	_put_raid_set(rs);
 }
 
 /* Check for pending registration. */
@@ -1510,14 +2248,14 @@ int register_device(const char *rs_name_in, const char *uuid,
 	struct dso_raid_set *rs, *rs_new;
 
 	/* FIXME: need to run first to get syslog() to work. */
-	_check_sgpio();
+	if (DSO_ISW)
+		_check_sgpio();
+	_check_debounce();
 
 	rs_name = basename((char *) rs_name_in);
 
 	/* Check for double registration attempt. */
-	pthread_mutex_lock(&_register_mutex);
-	rs = _find_raid_set(rs_name, NULL, 0);
-	pthread_mutex_unlock(&_register_mutex);
+	rs = _find_raid_set(rs_name, 0, 0);
 
 	if (rs) {
 		syslog(LOG_ERR, "RAID set \"%s\" already registered.", rs_name);
@@ -1534,11 +2272,11 @@ int register_device(const char *rs_name_in, const char *uuid,
 		return 0;
 
 	/* Check for double registration attempt again after allocation. */
-	pthread_mutex_lock(&_register_mutex);
-	rs = _find_raid_set(rs_name, NULL, 0);
+	pthread_rwlock_wrlock(&_register_lock);
+	rs = _lookup_raid_set(rs_name);
 	if (rs) {
 		/* We lost the race. */
-		pthread_mutex_unlock(&_register_mutex);
+		pthread_rwlock_unlock(&_register_lock);
 		syslog(LOG_ERR,
 		       "dual registration attempt for \"%s\" cancelled",
 		       rs_name);
@@ -1546,7 +2284,7 @@ int register_device(const char *rs_name_in, const char *uuid,
 		return 0;
 	} else {
 		_add_raid_set(rs_new); /* Add our new RAID set. */
-		pthread_mutex_unlock(&_register_mutex);
+		pthread_rwlock_unlock(&_register_lock);
 	} 
 
 	syslog(LOG_INFO, "Monitoring RAID set \"%s\" (uuid: %s) for events",
@@ -1571,36 +2309,41 @@ int unregister_device(const char *rs_name_in, const char *uuid,
 		      int major, int minor,
 		      void **unused __attribute((unused)))
 {
+	int last;
 	char *rs_name;
-	struct dso_raid_set *prev, *rs;
+	struct dso_raid_set *rs;
 
 	rs_name = basename((char *) rs_name_in);
 
-	pthread_mutex_lock(&_register_mutex);
-
 	/* Remove the dso_raid_set from the global structure. */
-	rs = _find_raid_set(rs_name, &prev, 1);
-	if (rs) {
-		/* Event being processed! */
-		if (rs->flags & RS_IN_USE)
-			syslog(LOG_ERR,
-			       "Can't unregister busy RAID set \"%s\" "
-			       "(uuid: %s)\n", rs_name, uuid);
-		else {
-			_del_raid_set(rs, prev); /* Unlink RAID set. */
+	pthread_rwlock_wrlock(&_register_lock);
+	if ((rs = _lookup_raid_set(rs_name)))
+		_del_raid_set(rs); /* Unlink RAID set. */
 
-			pthread_mutex_unlock(&_register_mutex);
+	last = !num_raid_sets;
+	pthread_rwlock_unlock(&_register_lock);
 
-			syslog(LOG_INFO,
-			       "No longer monitoring RAID set \"%s\" "
-			       "(uuid: %s) for events\n", rs->name, uuid);
-			_destroy_raid_set(rs); /* Free the raid_set struct. */
-			return 1;
-		}
+	if (!rs) {
+		syslog(LOG_ERR, "Can't find RAID set for device \"%s\"",
+		       rs_name);
+		return 0;
 	}
 
-	pthread_mutex_unlock(&_register_mutex);
-	return 0;
+	/* Event being processed? Wait for it to finish. */
+	_wait_raid_set(rs);
+
+	syslog(LOG_INFO,
+	       "No longer monitoring RAID set \"%s\" "
+	       "(uuid: %s) for events\n", rs->name, uuid);
+	_destroy_raid_set(rs); /* Free the raid_set struct. */
+
+	/* Stop LED worker before the DSO may get unloaded. */
+	if (last) {
+		_led_stop();
+		_topo_exit();
+	}
+
+	return 1;
 }
 
 #ifdef APP_TEST
@@ -1613,6 +2356,7 @@ int main(int argc, char **argv)
 {
 	int ret;
 	char *rs_name;
+	struct dso_raid_set *rs;
 
 	if (argc != 2) {
 		printf("%s name\n", argv[0]);        
@@ -1620,12 +2364,18 @@ int main(int argc, char **argv)
 	}
 
 	rs_name = argv[1];
-	ret = _lib_main('r', rs_name);
+	if (!(rs = _create_raid_set(rs_name, LOG_OPEN_FAILURE)))
+		return 1;
+
+	_add_raid_set(rs);
+	ret = _lib_main('r', rs);
 	printf("Got Members: %s=%d\n", rs_name, ret);
-	ret = _lib_main('R', rs_name);
+	ret = _lib_main('R', rs);
 	printf("Rebuild initiated for %s=%d\n", rs_name, ret);
-	ret = _lib_main('F', rs_name);
+	ret = _lib_main('F', rs);
 	printf("Rebuild ended for %s=%d\n", rs_name, ret);
+	_del_raid_set(rs);
+	_destroy_raid_set(rs);
 	return 0;
 }
 #endif
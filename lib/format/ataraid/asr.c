@@ -207,14 +207,8 @@ static unsigned
 compute_checksum(struct asr *asr)
 {
 	struct asr_raidtable *rt = asr->rt;
-	uint8_t *ptr = (uint8_t *) rt->ent;
-	unsigned checksum = 0, end = sizeof(*rt->ent) * rt->elmcnt;
 
-	/* Compute checksum. */
-	while (end--)
-		checksum += *(ptr++);
-
-	return checksum & 0xFFFF;
+	return csum_bytes(rt->ent, sizeof(*rt->ent) * rt->elmcnt) & 0xFFFF;
 }
 
 /* (Un)truncate white space at the end of a name */
@@ -239,8 +233,8 @@ read_extended(struct lib_context *lc, struct dev_info *di, struct asr *asr)
 	log_notice(lc, "%s: reading extended data on %s", handler, di->path);
 
 	/* Read the RAID table. */
-	if (!read_file(lc, handler, di->path, rt, ASR_DISK_BLOCK_SIZE,
-		       (uint64_t) asr->rb.raidtbl * ASR_DISK_BLOCK_SIZE))
+	if (!dev_read(lc, handler, di, rt, ASR_DISK_BLOCK_SIZE,
+		      (uint64_t) asr->rb.raidtbl * ASR_DISK_BLOCK_SIZE))
 		LOG_ERR(lc, 0, "%s: Could not read metadata off %s",
 			handler, di->path);
 
@@ -266,9 +260,9 @@ read_extended(struct lib_context *lc, struct dev_info *di, struct asr *asr)
 	/* Figure out how much else we need to read. */
 	if (rt->elmcnt > ASR_TBLELMCNT) {
 		remaining = rt->elmsize * (rt->elmcnt - 7);
-		if (!read_file(lc, handler, di->path, rt->ent + 7,
-			       remaining, (uint64_t) (asr->rb.raidtbl + 1) *
-			       ASR_DISK_BLOCK_SIZE))
+		if (!dev_read(lc, handler, di, rt->ent + 7,
+			      remaining, (uint64_t) (asr->rb.raidtbl + 1) *
+			      ASR_DISK_BLOCK_SIZE))
 			return 0;
 
 		to_cpu(asr, ASR_EXTTABLE);
@@ -371,7 +365,7 @@ read_metadata_areas(struct lib_context *lc, struct dev_info *di,
 	if (!(asr->rt = alloc_private(lc, handler, sizeof(*asr->rt))))
 		goto bad1;
 
-	if (!read_file(lc, handler, di->path, &asr->rb, size, asr_sboffset))
+	if (!dev_read(lc, handler, di, &asr->rb, size, asr_sboffset))
 		goto bad2;
 
 	/*
@@ -415,8 +409,8 @@ read_metadata_chunk(struct lib_context *lc, struct dev_info *di, uint64_t start)
 		LOG_ERR(lc, ret, "%s: unable to allocate memory for %s",
 			handler, di->path);
 
-	if (!read_file(lc, handler, di->path, ret, size,
-		       start * ASR_DISK_BLOCK_SIZE)) {
+	if (!dev_read(lc, handler, di, ret, size,
+		      start * ASR_DISK_BLOCK_SIZE)) {
 		dbg_free(ret);
 		LOG_ERR(lc, NULL, "%s: unable to read metadata on %s",
 			handler, di->path);
@@ -557,34 +551,73 @@ js_name(struct lib_context *lc, struct raid_dev *rd, unsigned subset)
 	return name(lc, META(rd, asr));
 }
 
+/* Check if a disk with @magic got discovered. */
+static int
+disk_present(struct lib_context *lc, uint32_t magic)
+{
+	struct raid_dev *rd;
+
+	list_for_each_entry(rd, LC_RD(lc), list) {
+		if (!strcmp(rd->fmt->name, handler) &&
+		    META(rd, asr)->rb.drivemagic == magic)
+			return 1;
+	}
+
+	return 0;
+}
+
 /*
  * IO error event handler.
+ *
+ * Every disk carries the config lines of all components, so the
+ * failure gets marked on the survivors as well. If the failed disk
+ * is gone, the components which didn't get discovered are the
+ * failed ones.
  */
-#if 0
 static int
 event_io(struct lib_context *lc, struct event_io *e_io)
 {
-	struct raid_dev *rd = e_io->rd;
+	int ret = 0;
+	struct raid_dev *rd = e_io->member;
 	struct asr *asr = META(rd, asr);
-	struct asr_raid_configline *cl = this_disk(asr);
-	struct asr_raid_configline *fwl = find_logical(asr);
+	struct asr_raidtable *rt = asr->rt;
+	struct asr_raid_configline *cl, *fwl = find_logical(asr);
 
-	/* Ignore if we've already marked this disk broken(?) */
-	if (rd->status & s_broken)
+	if (!fwl)
 		return 0;
 
-	log_err(lc, "%s: I/O error on device %s at sector %lu",
-		handler, e_io->rd->di->path, e_io->sector);
+	/* The components follow their logical drive's config line. */
+	for (cl = fwl + 1; cl < rt->ent + rt->elmcnt && cl->raidlevel != FWL;
+	     cl++) {
+		/* Ignore if we've already marked this disk broken. */
+		if (cl->raidstate == LSU_COMPONENT_STATE_FAILED)
+			continue;
+
+		if (e_io->rd ?
+		    cl->raidmagic != META(e_io->rd, asr)->rb.drivemagic :
+		    disk_present(lc, cl->raidmagic))
+			continue;
 
-	/* Mark the array as degraded and the disk as failed. */
-	rd->status = s_broken;
-	cl->raidstate = LSU_COMPONENT_STATE_FAILED;
-	fwl->raidstate = LSU_COMPONENT_STATE_DEGRADED;
-	/* FIXME: Do we have to mark a parent too? */
+		/* Mark the array as degraded and the disk as failed. */
+		cl->raidstate = LSU_COMPONENT_STATE_FAILED;
+		fwl->raidstate = LSU_COMPONENT_STATE_DEGRADED;
+		/* FIXME: Do we have to mark a parent too? */
+		ret = 1;
+	}
+
+	if (ret && rd == e_io->rd) {
+		log_err(lc, "%s: I/O error on device %s at sector %" PRIu64,
+			handler, rd->di->path, e_io->sector);
+		rd->status = s_broken;
+	}
 
-	return 1;		/* Indicate that this is indeed a failure. */
+	return ret;
 }
-#endif
+
+static struct event_handlers asr_event_handlers = {
+	.io = event_io,
+	.rd = NULL,	/* FIXME: no device add/remove event handler yet. */
+};
 
 /*
  * Helper routines for asr_group()
@@ -1134,6 +1167,12 @@ asr_log(struct lib_context *lc, struct raid_dev *rd)
 }
 #endif
 
+/* The reserved block; the RAID table gets read after it. */
+static const struct probe_area asr_probe[] = {
+	{ -1, 1 },
+	{ 0, 0 },
+};
+
 static struct dmraid_format asr_format = {
 	.name = HANDLER,
 	.descr = "Adaptec HostRAID ASR",
@@ -1143,6 +1182,8 @@ static struct dmraid_format asr_format = {
 	.write = asr_write,
 	.group = asr_group,
 	.check = asr_check,
+	.events = &asr_event_handlers,
+	.probe = asr_probe,
 #ifdef DMRAID_NATIVE_LOG
 	.log = asr_log,
 #endif
@@ -305,12 +305,17 @@ hpt37x_check(struct lib_context *lc, struct raid_set *rs)
 /*
  * IO error event handler.
  */
-#if 0
 static int
 event_io(struct lib_context *lc, struct event_io *e_io)
 {
 	struct raid_dev *rd = e_io->rd;
-	struct hpt37x *hpt = META(rd, hpt37x);
+	struct hpt37x *hpt;
+
+	/* A bad magic marks the failed disk itself. */
+	if (rd != e_io->member)
+		return 0;
+
+	hpt = META(rd, hpt37x);
 
 	/* Avoid write trashing. */
 	if (status(hpt) & s_broken)
@@ -319,7 +324,11 @@ event_io(struct lib_context *lc, struct event_io *e_io)
 	hpt->magic = HPT37X_MAGIC_BAD;
 	return 1;
 }
-#endif
+
+static struct event_handlers hpt37x_event_handlers = {
+	.io = event_io,
+	.rd = NULL,	/* FIXME: no device add/remove event handler yet. */
+};
 
 #ifdef DMRAID_NATIVE_LOG
 /*
@@ -364,6 +373,12 @@ hpt37x_log(struct lib_context *lc, struct raid_dev *rd)
 }
 #endif
 
+/* Metadata sector at the beginning of the device. */
+static const struct probe_area hpt37x_probe[] = {
+	{ 9, 1 },
+	{ 0, 0 },
+};
+
 static struct dmraid_format hpt37x_format = {
 	.name = HANDLER,
 	.descr = "Highpoint HPT37X",
@@ -373,6 +388,8 @@ static struct dmraid_format hpt37x_format = {
 	.write = hpt37x_write,
 	.group = hpt37x_group,
 	.check = hpt37x_check,
+	.events = &hpt37x_event_handlers,
+	.probe = hpt37x_probe,
 #ifdef DMRAID_NATIVE_LOG
 	.log = hpt37x_log,
 #endif
@@ -254,12 +254,17 @@ hpt45x_check(struct lib_context *lc, struct raid_set *rs)
 /*
  * IO error event handler.
  */
-#if 0
 static int
 event_io(struct lib_context *lc, struct event_io *e_io)
 {
 	struct raid_dev *rd = e_io->rd;
-	struct hpt45x *hpt = META(rd, hpt45x);
+	struct hpt45x *hpt;
+
+	/* Only the failed disk gets a bad magic. */
+	if (rd != e_io->member)
+		return 0;
+
+	hpt = META(rd, hpt45x);
 
 	/* Avoid write trashing. */
 	if (S_BROKEN(status(hpt)))
@@ -268,7 +273,11 @@ event_io(struct lib_context *lc, struct event_io *e_io)
 	hpt->magic = HPT45X_MAGIC_BAD;
 	return 1;
 }
-#endif
+
+static struct event_handlers hpt45x_event_handlers = {
+	.io = event_io,
+	.rd = NULL,	/* FIXME: no device add/remove event handler yet. */
+};
 
 #ifdef DMRAID_NATIVE_LOG
 /*
@@ -301,6 +310,12 @@ hpt45x_log(struct lib_context *lc, struct raid_dev *rd)
 }
 #endif
 
+/* Metadata sector 11 sectors off the end of the device. */
+static const struct probe_area hpt45x_probe[] = {
+	{ -11, 1 },
+	{ 0, 0 },
+};
+
 static struct dmraid_format hpt45x_format = {
 	.name = HANDLER,
 	.descr = "Highpoint HPT45X",
@@ -310,6 +325,8 @@ static struct dmraid_format hpt45x_format = {
 	.write = hpt45x_write,
 	.group = hpt45x_group,
 	.check = hpt45x_check,
+	.events = &hpt45x_event_handlers,
+	.probe = hpt45x_probe,
 #ifdef DMRAID_NATIVE_LOG
 	.log = hpt45x_log,
 #endif
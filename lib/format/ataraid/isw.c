@@ -306,13 +306,7 @@ type(struct isw_dev *dev)
 static uint32_t
 _checksum(struct isw *isw)
 {
-	uint32_t end = isw->mpb_size / sizeof(end),
-		*p = (uint32_t *) isw, ret = 0;
-
-	while (end--)
-		ret += *p++;
-
-	return ret - isw->check_sum;
+	return csum32(isw, isw->mpb_size / sizeof(uint32_t)) - isw->check_sum;
 }
 
 /* Calculate next isw device offset. */
@@ -353,6 +347,35 @@ raiddev(struct isw *isw, unsigned i)
 	return dev;
 }
 
+/*
+ * Walk the isw_dev table in one pass rather than
+ * looking every device up by index from the start.
+ */
+#define	for_each_raiddev(isw, dev, i) \
+	for (i = 0, dev = raiddev(isw, 0); i < (isw)->num_raid_devs; \
+	     i++, dev = advance_raiddev(dev))
+
+/*
+ * Check that the isw_dev table lies within the MPB, so
+ * that walking it later needs no further bounds checks.
+ */
+static int
+raiddevs_fit(struct lib_context *lc, struct dev_info *di, struct isw *isw)
+{
+	unsigned int i;
+	uint8_t *end = (uint8_t *) isw + isw->mpb_size;
+	struct isw_dev *dev;
+
+	for_each_raiddev(isw, dev, i) {
+		if ((uint8_t *) (dev + 1) > end ||
+		    (uint8_t *) advance_raiddev(dev) > end)
+			LOG_ERR(lc, 0, "%s: RAID device table exceeds "
+				"metadata size on %s", handler, di->path);
+	}
+
+	return 1;
+}
+
 /*
  * Read an Intel RAID device
  */
@@ -388,9 +411,7 @@ to_cpu(struct isw *isw, enum convert cvt)
 		CVT32(dsk->status);
 	}
 
-	for (i = 0; i < isw->num_raid_devs; i++) {
-		dev = raiddev(isw, i);
-
+	for_each_raiddev(isw, dev, i) {
 		/* RAID device. */
 		CVT32(dev->SizeLow);
 		CVT32(dev->SizeHigh);
@@ -503,12 +524,18 @@ isw_file_metadata(struct lib_context *lc, struct dev_info *di, void *meta)
 {
 	struct isw *isw = meta;
 	/* Get the rounded up value for the metadata size */
-	size_t size = isw_size(isw);
+	size_t size = isw_size(isw), ext = size - ISW_DISK_BLOCK_SIZE;
+	uint8_t *buf;
+
+	/* File in on disk order: extended blocks precede the first one. */
+	if ((buf = alloc_private(lc, handler, size))) {
+		memcpy(buf, (uint8_t *) meta + ISW_DISK_BLOCK_SIZE, ext);
+		memcpy(buf + ext, meta, ISW_DISK_BLOCK_SIZE);
+		file_metadata(lc, handler, di->path, buf, size,
+			      ISW_CONFIGOFFSET(di) - ext);
+		dbg_free(buf);
+	}
 
-	file_metadata(lc, handler, di->path,
-		      meta + (size / ISW_DISK_BLOCK_SIZE > 1 ?
-			      ISW_DISK_BLOCK_SIZE : 0),
-		      size, (di->sectors - (size / ISW_DISK_BLOCK_SIZE)) << 9);
 	file_dev_size(lc, handler, di);
 }
 
@@ -530,7 +557,7 @@ isw_read_extended(struct lib_context *lc, struct dev_info *di,
 
 		/* Read extended metadata to offset ISW_DISK_BLOCK_SIZE */
 		if (blocks > 1 &&
-		    !read_file(lc, handler, di->path,
+		    !dev_read(lc, handler, di,
 			(void *) (((uint8_t*)isw_tmp) + ISW_DISK_BLOCK_SIZE),
 			*size - ISW_DISK_BLOCK_SIZE, *isw_sboffset)) {
 			dbg_free(isw_tmp);
@@ -562,7 +589,7 @@ isw_read_metadata(struct lib_context *lc, struct dev_info *di,
 	struct isw *isw;
 
 	if (!(isw = alloc_private_and_read(lc, handler, size,
-					   di->path, isw_sboffset)))
+					   di, isw_sboffset)))
 		goto out;
 
 	/*
@@ -580,6 +607,9 @@ isw_read_metadata(struct lib_context *lc, struct dev_info *di,
 	 * Now that we made sure, that we've got all the
 	 * metadata, we can convert it completely.
 	 */
+	if (!raiddevs_fit(lc, di, isw))
+		goto bad;
+
 	to_cpu(isw, LAST);
 
 	if (disk_ok(lc, di, isw)) {
@@ -678,17 +708,18 @@ _create_rd(struct lib_context *lc,
 	if (!(r = alloc_raid_dev(lc, handler)))
 		return NULL;
 
-	if (!(r->meta_areas = alloc_meta_areas(lc, rd, handler, 1)))
+	if (!(r->meta_areas = alloc_meta_areas(lc, r, handler, 1)))
 		goto free;
 
+	/* All volumes of a disk reference its one metadata copy. */
+	if (!share_meta_area(lc, r->meta_areas, rd->meta_areas, 0))
+		goto free;
+
+	r->meta_areas->offset = rd->meta_areas->offset;
+	r->meta_areas->size = rd->meta_areas->size;
+
 	/* Configuration for spare disk. */
 	if (isw->disk[0].status & SPARE_DISK) {
-		r->meta_areas->offset = rd->meta_areas->offset;
-		r->meta_areas->size = rd->meta_areas->size;
-		r->meta_areas->area =
-			alloc_private(lc, handler, rd->meta_areas->size);
-		memcpy(r->meta_areas->area, rd->meta_areas->area,
-		       rd->meta_areas->size);
 
 		r->type = t_spare;
 		if (!(r->name = name(lc, rd, NULL, N_PATH)))
@@ -708,11 +739,6 @@ _create_rd(struct lib_context *lc,
 
 	memcpy(r->private.ptr, dev, sizeof(*dev));
 
-	r->meta_areas->offset = rd->meta_areas->offset;
-	r->meta_areas->size = rd->meta_areas->size;
-	r->meta_areas->area = alloc_private(lc, handler, rd->meta_areas->size);
-	memcpy(r->meta_areas->area, rd->meta_areas->area, rd->meta_areas->size);
-
 	if ((r->type = type(dev)) == t_undef) {
 		log_err(lc, "%s: RAID type %u not supported",
 			handler, (unsigned) dev->vol.map[0].raid_level);
@@ -797,9 +823,7 @@ group_rd(struct lib_context *lc,
 		list_add_sorted(lc, &rs->devs, &rd->devs, dev_sort);
 	} else {
 		/* Loop the device/volume table. */
-		for (d = 0; d < isw->num_raid_devs; d++) {
-			dev = raiddev(isw, d);
-
+		for_each_raiddev(isw, dev, d) {
 			if (!(rd = _create_rd(lc, rd_meta, isw, dev)))
 				return NULL;
 			if (is_raid10(dev)) {
@@ -903,14 +927,16 @@ adjust_length(struct isw_dev *dev, struct isw_dev *dev_rebuilt,
 static int
 rd_idx_by_name(struct isw *isw, const char *name)
 {
-	int i = isw->num_raid_devs;
+	int i, ret = -ENOENT;
+	struct isw_dev *dev;
 
-	while (i--) {
-		if (strstr(name, (const char *) raiddev(isw, i)->volume))
-			return i;
+	/* Last match wins. */
+	for_each_raiddev(isw, dev, i) {
+		if (strstr(name, (const char *) dev->volume))
+			ret = i;
 	}
 
-	return -ENOENT;
+	return ret;
 }
 
 /* Return RAID device for serial string. */
@@ -958,6 +984,7 @@ update_metadata_after_rebuild(struct lib_context *lc, struct raid_set *rs)
 	vol_rebuilt = vol_rebuilt_idx ? old_vol1 : old_vol0;
 	vol_rebuilt->vol.migr_type = ISW_T_MIGR_TYPE_INITIALIZING;
 	vol_rebuilt->vol.migr_state = ISW_T_MIGR_STATE_NORMAL;
+	vol_rebuilt->vol.curr_migr_unit = 0;
 
 	/* FIXME: replace magic number */
 	vol_rebuilt->vol.map[0].failed_disk_num = 255;
@@ -1283,6 +1310,9 @@ isw_metadata_handler(struct lib_context *lc, enum handler_commands command,
 				break;
 		}
 
+		if (ret)
+			ret = commit_set(lc, rs);
+
 		break;
 	case GET_REBUILD_STATE:
 		return get_rebuild_state(lc, rs, rd);
@@ -1344,6 +1374,14 @@ isw_metadata_handler(struct lib_context *lc, enum handler_commands command,
 		return get_device_idx(lc, info->data.ptr);
 	case GET_NUMBER_OF_DEVICES: /* Get number of RAID devices. */
 		return get_number_of_devices(lc, rs);
+	/*
+	 * The volume's migration unit counter isn't kept in sectors and
+	 * gets read by the OROM and other tools, so neither write rebuild
+	 * checkpoints to it nor trust it to skip resynchronization.
+	 */
+	case UPDATE_REBUILD_CHECKPOINT:
+	case GET_REBUILD_CHECKPOINT:
+		return 0;
 	default:
 		LOG_ERR(lc, 0, "%u not yet supported", command);
 
@@ -1971,8 +2009,7 @@ get_raiddev(struct isw *isw, char *name)
 	struct isw_dev *dev;
 	int i;
 
-	for (i = 0; i < isw->num_raid_devs; i++) {
-		dev = raiddev(isw, i);
+	for_each_raiddev(isw, dev, i) {
 		if (!strcmp((const char *) dev->volume, (const char *) name))
 			return dev;
 	}
@@ -1994,9 +2031,7 @@ update_raidset(struct lib_context *lc, struct raid_set *rs, struct isw *isw)
 
 	list_for_each_entry(rd, &rs->devs, devs) {
 		if (rd->meta_areas) {
-			if (rd->meta_areas->area)
-				dbg_free(rd->meta_areas->area);
-
+			put_meta_area(lc, rd->meta_areas);
 			dbg_free(rd->meta_areas);
 		}
 
@@ -2182,9 +2217,7 @@ _isw_log(struct lib_context *lc, struct isw *isw)
 	}
 
 	/* RAID device/volume table. */
-	for (d = 0; d < isw->num_raid_devs; d++) {
-		dev = raiddev(isw, d);
-
+	for_each_raiddev(isw, dev, d) {
 		/* RAID device */
 		P("isw_dev[%u].volume: \"%*s\"", isw,
 		  dev->volume, d, MAX_RAID_SERIAL_LEN, dev->volume);
@@ -2311,6 +2344,8 @@ isw_erase_metadata(struct lib_context *lc, struct raid_set *rs)
 
 	list_for_each_entry(rd, &rs->devs, devs)
 		isw_write(lc, rd, 1);
+
+	commit_set(lc, rs);
 }
 
 /*
@@ -2340,7 +2375,7 @@ isw_write_all(struct lib_context *lc, struct raid_set *rs, struct isw *isw)
 	}
 
 	dbg_free(rd);
-	return 1;
+	return commit_set(lc, rs);
 }
 
 /* Remove an isw device. */
@@ -2508,6 +2543,12 @@ isw_delete(struct lib_context *lc, struct raid_set *rs_group)
 }
 
 
+/* MPB header; extended metadata ahead of it is read on demand. */
+static const struct probe_area isw_probe[] = {
+	{ -2, 1 },
+	{ 0, 0 },
+};
+
 static struct dmraid_format isw_format = {
 	.name = HANDLER,
 	.descr = "Intel Software RAID",
@@ -2521,6 +2562,7 @@ static struct dmraid_format isw_format = {
 	.check = isw_check,
 	.metadata_handler = isw_metadata_handler,
 	.scope = t_scope_global /* | t_scope_local */ ,
+	.probe = isw_probe,
 #ifdef DMRAID_NATIVE_LOG
 	.log = isw_log,
 #endif
@@ -2579,6 +2621,7 @@ update_metadata_isw_dev(struct isw *new_isw,
 	new_dev = raiddev(new_isw, isw_dev_idx);
 	new_dev->vol.migr_state = ISW_T_MIGR_STATE_MIGRATING;
 	new_dev->vol.migr_type = ISW_T_MIGR_TYPE_REBUILDING;
+	new_dev->vol.curr_migr_unit = 0;
 
 	/* Update information in the first map. */
 	new_dev->vol.map[0].map_state = ISW_T_STATE_NORMAL;
@@ -2794,10 +2837,8 @@ update_metadata(struct lib_context *lc, struct raid_set *rs)
 	new_dev = raiddev(new_isw, idx);
 	sub_rs = find_set(lc, NULL, rebuild_set_name, FIND_ALL);
 	list_for_each_entry(rd, &sub_rs->devs, devs) {
-		if (rd->meta_areas && rd->meta_areas->area) {
-
-			dbg_free(rd->meta_areas->area);
-		}
+		if (rd->meta_areas)
+			put_meta_area(lc, rd->meta_areas);
 
 		if (!rd->meta_areas || rd->status == s_init) {
 			if (rd->meta_areas)
@@ -2840,12 +2881,10 @@ update_metadata(struct lib_context *lc, struct raid_set *rs)
 	}
 
 	list_for_each_entry(rd, &rs->devs, devs) {
-		if (rd->meta_areas && rd->meta_areas->area)
-			dbg_free(rd->meta_areas->area);
+		if (rd->meta_areas)
+			put_meta_area(lc, rd->meta_areas);
 
 		if (!rd->meta_areas || rd->status == s_init) {
-			if (rd->meta_areas && rd->meta_areas->area)
-				dbg_free(rd->meta_areas->area);
 
 			rd->meta_areas = alloc_meta_areas(lc, rd, handler, 1);
 			if (!rd->meta_areas)
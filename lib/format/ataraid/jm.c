@@ -83,11 +83,7 @@ type(struct jm *jm)
 static int
 checksum(struct jm *jm)
 {
-	int count = 64;
-	uint16_t *p = (uint16_t *) jm, sum = 0;
-
-	while (count--)
-		sum += *p++;
+	uint16_t sum = csum16(jm, 64);
 
 	/* FIXME: shouldn't this be one value only ? */
 	return !sum || sum == 1;
@@ -341,6 +337,12 @@ jm_log(struct lib_context *lc, struct raid_dev *rd)
 }
 #endif
 
+/* Last sector holding the metadata. */
+static const struct probe_area jm_probe[] = {
+	{ -1, 1 },
+	{ 0, 0 },
+};
+
 static struct dmraid_format jm_format = {
 	.name = HANDLER,
 	.descr = "JMicron ATARAID",
@@ -350,6 +352,7 @@ static struct dmraid_format jm_format = {
 	.write = jm_write,
 	.group = jm_group,
 	.check = jm_check,
+	.probe = jm_probe,
 #ifdef DMRAID_NATIVE_LOG
 	.log = jm_log,
 #endif
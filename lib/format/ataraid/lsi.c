@@ -327,6 +327,12 @@ lsi_log(struct lib_context *lc, struct raid_dev *rd)
 }
 #endif
 
+/* Metadata in the last sector. */
+static const struct probe_area lsi_probe[] = {
+	{ -1, 1 },
+	{ 0, 0 },
+};
+
 static struct dmraid_format lsi_format = {
 	.name = HANDLER,
 	.descr = "LSI Logic MegaRAID",
@@ -336,6 +342,7 @@ static struct dmraid_format lsi_format = {
 	.write = lsi_write,
 	.group = lsi_group,
 	.check = lsi_check,
+	.probe = lsi_probe,
 #ifdef DMRAID_NATIVE_LOG
 	.log = lsi_log,
 #endif
@@ -184,16 +184,13 @@ to_cpu(void *meta)
 static int
 checksum(struct nv *nv)
 {
-	uint32_t sum = 0;
-	unsigned int s = nv->size;
+	uint32_t sum;
 
-	if (s != sizeof(*nv) / sizeof(sum))
+	if (nv->size != sizeof(*nv) / sizeof(sum))
 		return 0;
 
-	while (s--)
-		sum += ((uint32_t *) nv)[s];
-
 	/* Ignore chksum member itself. */
+	sum = csum32(nv, nv->size);
 	return nv->chksum - sum == nv->chksum;
 }
 
@@ -392,6 +389,12 @@ nv_log(struct lib_context *lc, struct raid_dev *rd)
 }
 #endif
 
+/* Metadata in the second to last sector. */
+static const struct probe_area nv_probe[] = {
+	{ -2, 1 },
+	{ 0, 0 },
+};
+
 static struct dmraid_format nv_format = {
 	.name = HANDLER,
 	.descr = "NVidia RAID",
@@ -401,6 +404,7 @@ static struct dmraid_format nv_format = {
 	.write = nv_write,
 	.group = nv_group,
 	.check = nv_check,
+	.probe = nv_probe,
 #ifdef DMRAID_NATIVE_LOG
 	.log = nv_log,
 #endif
@@ -104,13 +104,7 @@ type(struct pdc *pdc)
 static uint32_t
 checksum(struct pdc *pdc)
 {
-	unsigned i = 511, sum = 0;
-	uint32_t *p = (uint32_t *) pdc;
-
-	while (i--)
-		sum += *p++;
-
-	return sum == pdc->checksum;
+	return csum32(pdc, 511) == pdc->checksum;
 }
 
 /* Calculate metadata offset. */
@@ -191,9 +185,9 @@ pdc_read_metadata(struct lib_context *lc, struct dev_info *di,
 			     ma < PDC_MAX_META_AREAS &&
 			     sector <= pdc_sectors_max;
 			     ma++, sector += PDC_META_OFFSET) {
-				if (read_file(lc, handler, di->path,
-					      ret + ma, sizeof(*ret),
-					      sector << 9)) {
+				if (dev_read(lc, handler, di,
+					     ret + ma, sizeof(*ret),
+					     sector << 9)) {
 					/* No signature? */
 					if (!is_signature(ret + ma)) {
 						if (info->u32)
@@ -263,9 +257,11 @@ static int
 pdc_write(struct lib_context *lc, struct raid_dev *rd, int erase)
 {
 	int ret;
-#if	BYTE_ORDER != LITTLE_ENDIAN
 	struct pdc *pdc = META(rd, pdc);
 
+	/* Event handlers change checksummed fields. */
+	pdc->checksum = csum32(pdc, 511);
+#if	BYTE_ORDER != LITTLE_ENDIAN
 	to_disk(pdc);
 #endif
 	ret = write_metadata(lc, handler, rd, -1, erase);
@@ -351,12 +347,11 @@ _create_rd(struct lib_context *lc, struct raid_dev *rd,
 	if (!(r->meta_areas = alloc_meta_areas(lc, r, handler, 1)))
 		goto bad_free;
 
-	/* Allocate private metadata area so that free_raid_dev() succeeds. */
-	r->meta_areas->area = alloc_private(lc, handler, sizeof(*pdc));
-	if (!r->meta_areas->area)
+	/* Reference the metadata copy read with the first device. */
+	if (!share_meta_area(lc, r->meta_areas, rd->meta_areas,
+			     (uint8_t *) pdc - (uint8_t *) META(rd, pdc)))
 		goto bad_free;
 
-	memcpy(r->meta_areas->area, pdc, sizeof(*pdc));
 	r->meta_areas->size = sizeof(*pdc);
 	r->meta_areas->offset = rd->meta_areas->offset + idx * PDC_META_OFFSET;
 
@@ -523,12 +518,17 @@ pdc_check(struct lib_context *lc, struct raid_set *rs)
 /*
  * IO error event handler.
  */
-#if 0
 static int
 event_io(struct lib_context *lc, struct event_io *e_io)
 {
 	struct raid_dev *rd = e_io->rd;
-	struct pdc *pdc = META(rd, pdc);
+	struct pdc *pdc;
+
+	/* The broken flag only goes onto the failed disk. */
+	if (rd != e_io->member)
+		return 0;
+
+	pdc = META(rd, pdc);
 
 	/* Avoid write trashing. */
 	if (status(pdc) & s_broken)
@@ -537,7 +537,11 @@ event_io(struct lib_context *lc, struct event_io *e_io)
 	PDC_SET_BROKEN(pdc);
 	return 1;
 }
-#endif
+
+static struct event_handlers pdc_event_handlers = {
+	.io = event_io,
+	.rd = NULL,	/* FIXME: no device add/remove event handler yet. */
+};
 
 #ifdef DMRAID_NATIVE_LOG
 /* Log native information about a Promise RAID device. */
@@ -607,6 +611,29 @@ pdc_log(struct lib_context *lc, struct raid_dev *rd)
 }
 #endif
 
+/*
+ * Main metadata areas at PDC_CONFIGOFFSETS off the end of the device
+ * and the one at the beginning of large devices (see pdc_read_metadata()).
+ */
+#define	PDC_PROBE(sector)	{ sector, sizeof(struct pdc) >> 9 }
+static const struct probe_area pdc_probe[] = {
+	PDC_PROBE(-63),
+	PDC_PROBE(-255),
+	PDC_PROBE(-256),
+	PDC_PROBE(-16),
+	PDC_PROBE(-399),
+	PDC_PROBE(-591),
+	PDC_PROBE(-675),
+	PDC_PROBE(-735),
+	PDC_PROBE(-911),
+	PDC_PROBE(-974),
+	PDC_PROBE(-991),
+	PDC_PROBE(-3087),
+	PDC_PROBE(268435377),
+	{ 0, 0 },
+};
+#undef	PDC_PROBE
+
 static struct dmraid_format pdc_format = {
 	.name = HANDLER,
 	.descr = "Promise FastTrack",
@@ -616,6 +643,8 @@ static struct dmraid_format pdc_format = {
 	.write = pdc_write,
 	.group = pdc_group,
 	.check = pdc_check,
+	.events = &pdc_event_handlers,
+	.probe = pdc_probe,
 #ifdef DMRAID_NATIVE_LOG
 	.log = pdc_log,
 #endif
@@ -92,12 +92,7 @@ type(struct sil *sil)
 static int
 checksum(struct sil *sil)
 {
-	int sum = 0;
-	unsigned short count = struct_offset(sil, checksum1) / 2;
-	uint16_t *p = (uint16_t *) sil;
-
-	while (count--)
-		sum += *p++;
+	int sum = csum16(sil, struct_offset(sil, checksum1) / 2);
 
 	return (-sum & 0xFFFF) == sil->checksum1;
 }
@@ -199,7 +194,7 @@ sil_read_metadata(struct lib_context *lc, struct dev_info *di,
 	/* Read the 4 metadata areas. */
 	for (i = valid = 0; i < AREAS; i++) {
 		if (!(sil = alloc_private_and_read(lc, handler, sizeof(*sil),
-						   di->path, SIL_META_AREA(i))))
+						   di, SIL_META_AREA(i))))
 			goto bad;
 
 #if	BYTE_ORDER != LITTLE_ENDIAN
@@ -287,9 +282,11 @@ static int
 sil_write(struct lib_context *lc, struct raid_dev *rd, int erase)
 {
 	int ret;
-#if	BYTE_ORDER != LITTLE_ENDIAN
 	struct sil *sil = META(rd, sil);
 
+	/* Event handlers change checksummed fields. */
+	sil->checksum1 = -csum16(sil, struct_offset(sil, checksum1) / 2);
+#if	BYTE_ORDER != LITTLE_ENDIAN
 	to_disk(sil);
 #endif
 	ret = write_metadata(lc, handler, rd, -1, erase);
@@ -421,12 +418,17 @@ sil_check(struct lib_context *lc, struct raid_set *rs)
 /*
  * IO error event handler.
  */
-#if 0
 static int
 event_io(struct lib_context *lc, struct event_io *e_io)
 {
 	struct raid_dev *rd = e_io->rd;
-	struct sil *sil = META(rd, sil);
+	struct sil *sil;
+
+	/* Member status is per device: survivors have nothing to record. */
+	if (rd != e_io->member)
+		return 0;
+
+	sil = META(rd, sil);
 
 	/* Avoid write trashing. */
 	if (status(sil) & s_broken)
@@ -436,7 +438,11 @@ event_io(struct lib_context *lc, struct event_io *e_io)
 
 	return 1;
 }
-#endif
+
+static struct event_handlers sil_event_handlers = {
+	.io = event_io,
+	.rd = NULL,	/* FIXME: no device add/remove event handler yet. */
+};
 
 #ifdef DMRAID_NATIVE_LOG
 /*
@@ -497,6 +503,15 @@ sil_log(struct lib_context *lc, struct raid_dev *rd)
 }
 #endif
 
+/* The metadata area copies (see SIL_META_AREA()). */
+static const struct probe_area sil_probe[] = {
+	{ -1, 1 },
+	{ -513, 1 },
+	{ -1025, 1 },
+	{ -1537, 1 },
+	{ 0, 0 },
+};
+
 static struct dmraid_format sil_format = {
 	.name = HANDLER,
 	.descr = "Silicon Image(tm) Medley(tm)",
@@ -506,6 +521,8 @@ static struct dmraid_format sil_format = {
 	.write = sil_write,
 	.group = sil_group,
 	.check = sil_check,
+	.events = &sil_event_handlers,
+	.probe = sil_probe,
 #ifdef DMRAID_NATIVE_LOG
 	.log = sil_log,
 #endif
@@ -145,12 +145,7 @@ to_cpu(void *meta)
 static uint8_t
 checksum(struct via *via)
 {
-	uint8_t i = 50, sum = 0;
-
-	while (i--)
-		sum += ((uint8_t *) via)[i];
-
-	return sum == via->checksum;
+	return (uint8_t) csum_bytes(via, 50) == via->checksum;
 }
 
 static int
@@ -264,9 +259,11 @@ static int
 via_write(struct lib_context *lc, struct raid_dev *rd, int erase)
 {
 	int ret;
-#if	BYTE_ORDER != LITTLE_ENDIAN
 	struct via *via = META(rd, via);
 
+	/* Event handlers change checksummed fields. */
+	via->checksum = csum_bytes(via, 50);
+#if	BYTE_ORDER != LITTLE_ENDIAN
 	to_disk(via);
 #endif
 	ret = write_metadata(lc, handler, rd, -1, erase);
@@ -318,12 +315,17 @@ via_check(struct lib_context *lc, struct raid_set *rs)
 /*
  * IO error event handler.
  */
-#if 0
 static int
 event_io(struct lib_context *lc, struct event_io *e_io)
 {
 	struct raid_dev *rd = e_io->rd;
-	struct via *via = META(rd, via);
+	struct via *via;
+
+	/* via metadata keeps no state of the other members. */
+	if (rd != e_io->member)
+		return 0;
+
+	via = META(rd, via);
 
 	/* Avoid write trashing. */
 	if (status(via) & s_broken)
@@ -333,7 +335,11 @@ event_io(struct lib_context *lc, struct event_io *e_io)
 
 	return 1;
 }
-#endif
+
+static struct event_handlers via_event_handlers = {
+	.io = event_io,
+	.rd = NULL,	/* FIXME: no device add/remove event handler yet. */
+};
 
 #ifdef DMRAID_NATIVE_LOG
 /*
@@ -381,6 +387,12 @@ via_log(struct lib_context *lc, struct raid_dev *rd)
 }
 #endif
 
+/* VIA keeps its metadata in the last sector. */
+static const struct probe_area via_probe[] = {
+	{ -1, 1 },
+	{ 0, 0 },
+};
+
 static struct dmraid_format via_format = {
 	.name = HANDLER,
 	.descr = "VIA Software RAID",
@@ -390,6 +402,8 @@ static struct dmraid_format via_format = {
 	.write = via_write,
 	.group = via_group,
 	.check = via_check,
+	.events = &via_event_handlers,
+	.probe = via_probe,
 #ifdef DMRAID_NATIVE_LOG
 	.log = via_log,
 #endif
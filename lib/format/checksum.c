@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2004-2010  Heinz Mauelshagen, Red Hat GmbH.
+ *                          All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * Additive checksums over metadata buffers shared by format handlers.
+ *
+ * Each function sums in native byte order like the handlers did
+ * with their own loops. The bulk of a buffer gets summed in SIMD
+ * registers, the remainder in scalar code. SSE2 on x86_64 and NEON on
+ * ARM are used where the compiler target provides them; AVX2 gets
+ * picked at runtime on x86_64 processors supporting it.
+ * Results are identical either way, because the sums wrap at the
+ * respective word size no matter in which order words are added.
+ */
+
+#include "internal.h"
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+# define	CSUM_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define	CSUM_NEON
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__KLIBC__)
+# include <immintrin.h>
+# define	CSUM_AVX2
+#endif
+
+/* Checksum implementation for a processor. */
+struct csum_impl {
+	const char *name;
+	uint32_t (*bytes)(const void *buf, size_t len);
+	uint16_t (*sum16)(const void *buf, size_t words);
+	uint32_t (*sum32)(const void *buf, size_t words);
+};
+
+/* Sum of @len bytes. */
+uint32_t
+csum_bytes_scalar(const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t sum = 0;
+
+	while (len--)
+		sum += *p++;
+
+	return sum;
+}
+
+/* Sum of @words 16 bit words. */
+uint16_t
+csum16_scalar(const void *buf, size_t words)
+{
+	const uint16_t *p = buf;
+	uint16_t sum = 0;
+
+	while (words--)
+		sum += *p++;
+
+	return sum;
+}
+
+/* Sum of @words 32 bit words. */
+uint32_t
+csum32_scalar(const void *buf, size_t words)
+{
+	const uint32_t *p = buf;
+	uint32_t sum = 0;
+
+	while (words--)
+		sum += *p++;
+
+	return sum;
+}
+
+static const struct csum_impl csum_scalar = {
+	.name = "scalar",
+	.bytes = csum_bytes_scalar,
+	.sum16 = csum16_scalar,
+	.sum32 = csum32_scalar,
+};
+
+#if defined(CSUM_SSE2) || defined(CSUM_NEON)
+static uint32_t
+csum_bytes_simd(const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t sum;
+# if defined(CSUM_SSE2)
+	uint64_t lanes[2];
+	__m128i acc = _mm_setzero_si128(), zero = _mm_setzero_si128();
+
+	/* psadbw against zero sums 8 bytes each into 2 64 bit lanes. */
+	for (; len >= 16; p += 16, len -= 16)
+		acc = _mm_add_epi64(acc,
+				    _mm_sad_epu8(_mm_loadu_si128((const __m128i *) p),
+						 zero));
+
+	_mm_storeu_si128((__m128i *) lanes, acc);
+	sum = lanes[0] + lanes[1];
+# else
+	uint32_t lanes[4];
+	uint32x4_t acc = vdupq_n_u32(0);
+
+	for (; len >= 16; p += 16, len -= 16)
+		acc = vpadalq_u16(acc, vpaddlq_u8(vld1q_u8(p)));
+
+	vst1q_u32(lanes, acc);
+	sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+# endif
+	return sum + csum_bytes_scalar(p, len);
+}
+
+static uint16_t
+csum16_simd(const void *buf, size_t words)
+{
+	const uint16_t *p = buf;
+	uint16_t lanes[8];
+# if defined(CSUM_SSE2)
+	__m128i acc = _mm_setzero_si128();
+
+	for (; words >= 8; p += 8, words -= 8)
+		acc = _mm_add_epi16(acc, _mm_loadu_si128((const __m128i *) p));
+
+	_mm_storeu_si128((__m128i *) lanes, acc);
+# else
+	uint16x8_t acc = vdupq_n_u16(0);
+
+	for (; words >= 8; p += 8, words -= 8)
+		acc = vaddq_u16(acc, vld1q_u16(p));
+
+	vst1q_u16(lanes, acc);
+# endif
+	return csum16_scalar(lanes, 8) + csum16_scalar(p, words);
+}
+
+static uint32_t
+csum32_simd(const void *buf, size_t words)
+{
+	const uint32_t *p = buf;
+	uint32_t lanes[4];
+# if defined(CSUM_SSE2)
+	__m128i acc = _mm_setzero_si128();
+
+	for (; words >= 4; p += 4, words -= 4)
+		acc = _mm_add_epi32(acc, _mm_loadu_si128((const __m128i *) p));
+
+	_mm_storeu_si128((__m128i *) lanes, acc);
+# else
+	uint32x4_t acc = vdupq_n_u32(0);
+
+	for (; words >= 4; p += 4, words -= 4)
+		acc = vaddq_u32(acc, vld1q_u32(p));
+
+	vst1q_u32(lanes, acc);
+# endif
+	return csum32_scalar(lanes, 4) + csum32_scalar(p, words);
+}
+
+static const struct csum_impl csum_simd = {
+# if defined(CSUM_SSE2)
+	.name = "sse2",
+# else
+	.name = "neon",
+# endif
+	.bytes = csum_bytes_simd,
+	.sum16 = csum16_simd,
+	.sum32 = csum32_simd,
+};
+#endif
+
+#if defined(CSUM_AVX2)
+/* 32 bytes at a time; compiled for AVX2 and only called if present. */
+__attribute__ ((target("avx2")))
+static uint32_t
+csum_bytes_avx2(const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint64_t lanes[4];
+	__m256i acc = _mm256_setzero_si256(), zero = _mm256_setzero_si256();
+
+	for (; len >= 32; p += 32, len -= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) p);
+
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+	}
+
+	_mm256_storeu_si256((__m256i *) lanes, acc);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+	       csum_bytes_scalar(p, len);
+}
+
+__attribute__ ((target("avx2")))
+static uint16_t
+csum16_avx2(const void *buf, size_t words)
+{
+	const uint16_t *p = buf;
+	uint16_t lanes[16];
+	__m256i acc = _mm256_setzero_si256();
+
+	for (; words >= 16; p += 16, words -= 16)
+		acc = _mm256_add_epi16(acc,
+				       _mm256_loadu_si256((const __m256i *) p));
+
+	_mm256_storeu_si256((__m256i *) lanes, acc);
+	return csum16_scalar(lanes, 16) + csum16_scalar(p, words);
+}
+
+__attribute__ ((target("avx2")))
+static uint32_t
+csum32_avx2(const void *buf, size_t words)
+{
+	const uint32_t *p = buf;
+	uint32_t lanes[8];
+	__m256i acc = _mm256_setzero_si256();
+
+	for (; words >= 8; p += 8, words -= 8)
+		acc = _mm256_add_epi32(acc,
+				       _mm256_loadu_si256((const __m256i *) p));
+
+	_mm256_storeu_si256((__m256i *) lanes, acc);
+	return csum32_scalar(lanes, 8) + csum32_scalar(p, words);
+}
+
+static const struct csum_impl csum_avx2 = {
+	.name = "avx2",
+	.bytes = csum_bytes_avx2,
+	.sum16 = csum16_avx2,
+	.sum32 = csum32_avx2,
+};
+#endif
+
+/*
+ * Implementation picked on first use. Concurrent first calls
+ * store the same pointer, hence no locking.
+ */
+static const struct csum_impl *csum_impl;
+
+static const struct csum_impl *
+csum_select(void)
+{
+	const struct csum_impl *impl = &csum_scalar;
+
+#if defined(CSUM_SSE2) || defined(CSUM_NEON)
+	impl = &csum_simd;
+#endif
+#if defined(CSUM_AVX2)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		impl = &csum_avx2;
+#endif
+	return csum_impl = impl;
+}
+
+/* Name of the implementation in use (eg, "avx2"). */
+const char *
+csum_impl_name(void)
+{
+	return (csum_impl ? csum_impl : csum_select())->name;
+}
+
+uint32_t
+csum_bytes(const void *buf, size_t len)
+{
+	return (csum_impl ? csum_impl : csum_select())->bytes(buf, len);
+}
+
+uint16_t
+csum16(const void *buf, size_t words)
+{
+	return (csum_impl ? csum_impl : csum_select())->sum16(buf, words);
+}
+
+uint32_t
+csum32(const void *buf, size_t words)
+{
+	return (csum_impl ? csum_impl : csum_select())->sum32(buf, words);
+}
@@ -61,23 +61,16 @@ disk_status(struct ddf1_phys_drive *disk)
  * For now we'll compare the first twenty and only the last four if
  * both GUIDs don't have 0xFFFFFFFF in bytes 20-23.  Gross.
  */
-/* Find this drive's physical data */
+/* Find this drive's physical data (see build_index()). */
 static struct ddf1_phys_drive *
 get_phys_drive(struct ddf1 *ddf1)
 {
-	unsigned int i = ddf1->pd_header->max_drives;
-
-	while (i--) {
-		if (ddf1->pds[i].reference == ddf1->disk_data->reference)
-			return ddf1->pds + i;
-	}
-
-	return NULL;
+	return ddf1->pd;
 }
 
 /* Find the virtual drive that goes with this config record */
 static struct ddf1_virt_drive *
-get_virt_drive(struct ddf1 *ddf1, struct ddf1_config_record *cr)
+find_virt_drive(struct ddf1 *ddf1, struct ddf1_config_record *cr)
 {
 	int i = ddf1->vd_header->num_drives;
 
@@ -89,66 +82,110 @@ get_virt_drive(struct ddf1 *ddf1, struct ddf1_config_record *cr)
 	return NULL;
 }
 
+/* Same for config records of this drive using the index. */
+static struct ddf1_virt_drive *
+get_virt_drive(struct ddf1 *ddf1, struct ddf1_config_record *cr)
+{
+	struct ddf1_cfg_ref *ref;
+
+	for (ref = ddf1->refs; ref < ddf1->refs + ddf1->num_refs; ref++) {
+		if (ref->cr == cr)
+			return ref->vd;
+	}
+
+	return find_virt_drive(ddf1, cr);
+}
+
 /*
- * Find the index of the VD config record given a physical drive and offset.
+ * Find the index of the VD config record of this drive given an offset.
  */
 static int
 get_config_byoffset(struct ddf1 *ddf1, struct ddf1_phys_drive *pd,
 		    uint64_t offset)
 {
-	int cfgs = NUM_CONFIG_ENTRIES(ddf1), i;
-	uint32_t *cfg_drive_ids, j;
-	uint64_t *cfg_drive_offsets;
-	struct ddf1_config_record *cfg;
+	unsigned int i;
+	struct ddf1_cfg_ref *ref = ddf1->refs;
 
-	for (i = 0; i < cfgs; i++) {
-		cfg = CR(ddf1, i);
-		if (cfg->signature == DDF1_VD_CONFIG_REC) {
-			cfg_drive_ids = CR_IDS(ddf1, cfg);
-			cfg_drive_offsets = CR_OFF(ddf1, cfg);
-			for (j = 0; j < cfg->primary_element_count; j++) {
-				if (cfg_drive_ids[j] == pd->reference &&
-				    cfg_drive_offsets[j] == offset)
-					return i;
-			}
-		}
+	for (i = 0; i < ddf1->num_refs; i++, ref++) {
+		if (CR_OFF(ddf1, ref->cr)[ref->entry] == offset)
+			return i;
 	}
 
 	return -ENOENT;
 }
 
-/* Find the index of the nth VD config record for this physical drive. */
-static int
-get_config_index(struct ddf1 *ddf1, struct ddf1_phys_drive *pd, unsigned int *n)
+/*
+ * Find the nth VD config record for this physical drive.
+ */
+static inline struct ddf1_config_record *
+get_config(struct ddf1 *ddf1, struct ddf1_phys_drive *pd, unsigned int n)
+{
+	return n < ddf1->num_refs ? ddf1->refs[n].cr : NULL;
+}
+
+/*
+ * Collect the VD config records referencing this drive into @refs
+ * or just count them with @refs = NULL. A drive referenced multiple
+ * times by a record gets an entry per reference.
+ */
+static unsigned int
+index_refs(struct ddf1 *ddf1, struct ddf1_cfg_ref *refs)
 {
-	int cfgs = NUM_CONFIG_ENTRIES(ddf1), i, j, nn = *n;
+	unsigned int i, j, cfgs = NUM_CONFIG_ENTRIES(ddf1), ret = 0;
 	uint32_t *ids;
 	struct ddf1_config_record *cr;
 
 	for (i = 0; i < cfgs; i++) {
 		cr = CR(ddf1, i);
-		if (cr->signature == DDF1_VD_CONFIG_REC) {
-			ids = CR_IDS(ddf1, cr);
-			for (j = 0; j < cr->primary_element_count; j++) {
-				if (ids[j] == pd->reference && !nn--)
-					return i;
+		if (cr->signature != DDF1_VD_CONFIG_REC)
+			continue;
+
+		ids = CR_IDS(ddf1, cr);
+		for (j = 0; j < cr->primary_element_count; j++) {
+			if (ids[j] != ddf1->pd->reference)
+				continue;
+
+			if (refs) {
+				refs->cr = cr;
+				refs->entry = j;
+				refs->vd = find_virt_drive(ddf1, cr);
+				refs++;
 			}
+
+			ret++;
 		}
 	}
 
-	*n -= nn;
-	return nn < 0 ? -ENOENT : 0;
+	return ret;
 }
 
 /*
- * Find the nth VD config record for this physical drive.
+ * Index the records relating to this drive once after reading the
+ * metadata, so that lookups while grouping and naming don't scan the
+ * physical drive, virtual drive and config record tables every time.
+ *
+ * The index is kept at the end of the reallocated ddf1 structure,
+ * which gets freed with it.
  */
-static inline struct ddf1_config_record *
-get_config(struct ddf1 *ddf1, struct ddf1_phys_drive *pd, unsigned int n)
+static struct ddf1 *
+build_index(struct lib_context *lc, struct ddf1 *ddf1)
 {
-	int i = get_config_index(ddf1, pd, &n);
+	unsigned int i = ddf1->pd_header->max_drives, n = 0;
+	struct ddf1 *ret;
+
+	while (i--) {
+		if (ddf1->pds[i].reference == ddf1->disk_data->reference) {
+			ddf1->pd = ddf1->pds + i;
+			n = index_refs(ddf1, NULL);
+			break;
+		}
+	}
 
-	return i < 0 ? NULL : CR(ddf1, i);
+	if (!(ret = dbg_realloc(ddf1, sizeof(*ddf1) + n * sizeof(*ddf1->refs))))
+		LOG_ERR(lc, NULL, "%s: allocating index", handler);
+
+	ret->num_refs = n ? index_refs(ret, ret->refs) : 0;
+	return ret;
 }
 
 /* Find a config record for this drive, given the offset of the array. */
@@ -251,7 +288,7 @@ read_metadata_chunk(struct lib_context *lc, struct dev_info *di, uint64_t start)
 	if (!(ret = alloc_private(lc, handler, size)))
 		return NULL;
 
-	if (!read_file(lc, handler, di->path, ret, size, to_bytes(start))) {
+	if (!dev_read(lc, handler, di, ret, size, to_bytes(start))) {
 		dbg_free(ret);
 		LOG_ERR(lc, NULL, "%s: unable to read metadata off %s",
 			handler, di->path);
@@ -287,6 +324,20 @@ err_virt_drive(struct lib_context *lc, struct dev_info *di)
 	return err_drive(lc, di, "virtual");
 }
 
+/* Free what read_extended() allocated. */
+static void
+free_extended(struct ddf1 *ddf1)
+{
+	ddf1->vds = NULL;
+	ddf1->pds = NULL;
+	cond_free(ddf1->cfg);
+	cond_free(ddf1->pd_header);
+	cond_free(ddf1->disk_data);
+	cond_free(ddf1->adapter);
+	cond_free(ddf1->secondary);
+	cond_free(ddf1->primary);
+}
+
 /*
  * Read a DDF1 RAID device.  Fields are little endian, so
  * need to convert them if we're on a BE machine (ppc, etc).
@@ -308,7 +359,7 @@ read_extended(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
 	where = to_bytes(ddf1->anchor.primary_table_lba);
 	if (!(pri = ddf1->primary =
 	      alloc_private_and_read(lc, handler, sizeof(*pri),
-				     di->path, where)))
+				     di, where)))
 		goto bad;
 
 	/* Read the secondary header. */
@@ -318,7 +369,7 @@ read_extended(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
 
 	where = to_bytes(ddf1->anchor.secondary_table_lba);
 	if (ddf1->anchor.secondary_table_lba != 0xFFFFFFFFFFFFFFFFULL &&
-	    !read_file(lc, handler, di->path, sec, sizeof(*sec), where))
+	    !dev_read(lc, handler, di, sec, sizeof(*sec), where))
 		goto bad;
 
 	ddf1_cvt_header(ddf1, sec);
@@ -358,7 +409,7 @@ read_extended(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
 
 	where = to_bytes(pri->primary_table_lba + pri->adapter_data_offset);
 	if (pri->adapter_data_offset != 0xFFFFFFFF &&
-	    !read_file(lc, handler, di->path, adap, sizeof(*adap), where))
+	    !dev_read(lc, handler, di, adap, sizeof(*adap), where))
 		goto bad;
 
 	ddf1_cvt_adapter(ddf1, ddf1->adapter);
@@ -382,7 +433,7 @@ read_extended(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
 	where = to_bytes(pri->primary_table_lba + pri->disk_data_offset);
 	if (!(ddata = ddf1->disk_data =
 	      alloc_private_and_read(lc, handler, sizeof(*ddata),
-				     di->path, where)))
+				     di, where)))
 		goto bad;
 
 	/*
@@ -400,7 +451,7 @@ read_extended(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
 	where = to_bytes(pri->primary_table_lba + pri->phys_drive_offset);
 	size = to_bytes(pri->phys_drive_len);
 	if (!(pd = ddf1->pd_header =
-	      alloc_private_and_read(lc, handler, size, di->path, where)))
+	      alloc_private_and_read(lc, handler, size, di, where)))
 		goto bad;
 
 	ddf1_cvt_phys_drive_header(ddf1, pd);
@@ -426,7 +477,7 @@ read_extended(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
 	where = to_bytes(pri->primary_table_lba + pri->virt_drive_offset);
 	size = to_bytes(pri->phys_drive_len);
 	if (!(vd = ddf1->vd_header =
-	      alloc_private_and_read(lc, handler, size, di->path, where)))
+	      alloc_private_and_read(lc, handler, size, di, where)))
 		goto bad;
 
 	ddf1_cvt_virt_drive_header(ddf1, vd);
@@ -444,7 +495,7 @@ read_extended(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
 	where = to_bytes(pri->primary_table_lba + pri->config_record_offset);
 	size = to_bytes(pri->config_record_len);
 	if (!(ddf1->cfg = alloc_private_and_read(lc, handler, size,
-						 di->path, where)))
+						 di, where)))
 		goto bad;
 
 	/*
@@ -461,21 +512,13 @@ read_extended(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
 	 */
 	ddf1->in_cpu_format = 1;
 
-	/* FIXME: We should verify the checksums for all modes */
-	if (ddf1->adaptec_mode && !(ddf1_check_all_crcs(lc, di, ddf1)))
+	if (!ddf1_check_all_crcs(lc, di, ddf1))
 		goto bad;
 
 	return 1;
 
 bad:
-	ddf1->vds = NULL;
-	ddf1->pds = NULL;
-	cond_free(ddf1->cfg);
-	cond_free(ddf1->pd_header);
-	cond_free(ddf1->disk_data);
-	cond_free(ddf1->adapter);
-	cond_free(ddf1->secondary);
-	cond_free(ddf1->primary);
+	free_extended(ddf1);
 	return 0;
 }
 
@@ -483,11 +526,7 @@ bad:
 static unsigned int
 num_devs(struct lib_context *lc, void *meta)
 {
-	struct ddf1 *ddf1 = meta;
-	unsigned int num_drives = ~0;
-
-	get_config_index(ddf1, get_phys_drive(ddf1), &num_drives);
-	return num_drives;
+	return ((struct ddf1 *) meta)->num_refs;
 }
 
 /* Is this DDF1 metadata? */
@@ -511,7 +550,7 @@ try_to_find_ddf1(struct lib_context *lc,
 		 size_t * sz, uint64_t * offset,
 		 union read_info *info, uint64_t ddf1_sboffset)
 {
-	struct ddf1 *ddf1;
+	struct ddf1 *ddf1, *ret;
 
 	/*
 	 * Try to find a DDF1 anchor block at ddf1_sboffset.  In theory this
@@ -522,8 +561,8 @@ try_to_find_ddf1(struct lib_context *lc,
 	if (!(ddf1 = alloc_private(lc, handler, sizeof(*ddf1))))
 		goto err;
 
-	if (!read_file(lc, handler, di->path, &ddf1->anchor, to_bytes(1),
-		       ddf1_sboffset) || !is_ddf1(lc, di, ddf1))
+	if (!dev_read(lc, handler, di, &ddf1->anchor, to_bytes(1),
+		      ddf1_sboffset) || !is_ddf1(lc, di, ddf1))
 		goto bad;
 
 	ddf1->anchor_offset = ddf1_sboffset;
@@ -534,9 +573,13 @@ try_to_find_ddf1(struct lib_context *lc,
 		goto bad;
 	ddf1_cvt_header(ddf1, &ddf1->anchor);
 
-	/* Read extended metadata. */
-	if (read_extended(lc, di, ddf1))
-		return ddf1;
+	/* Read extended metadata and index it. */
+	if (read_extended(lc, di, ddf1)) {
+		if ((ret = build_index(lc, ddf1)))
+			return ret;
+
+		free_extended(ddf1);
+	}
 
 bad:
 	dbg_free(ddf1);
@@ -854,9 +897,7 @@ ddf1_write(struct lib_context *lc, struct raid_dev *rd, int erase)
 	int ret;
 	struct ddf1 *ddf1 = META(rd, ddf1);
 
-	if (ddf1->adaptec_mode)
-		ddf1_update_all_crcs(lc, rd->di, ddf1);
-
+	ddf1_update_all_crcs(lc, rd->di, ddf1);
 	ddf1_cvt_all(lc, ddf1, rd->di);
 	ret = write_metadata(lc, handler, rd, -1, erase);
 	ddf1_cvt_all(lc, ddf1, rd->di);
@@ -910,6 +951,16 @@ ddf1_log(struct lib_context *lc, struct raid_dev *rd)
 }
 #endif /* #ifdef DMRAID_NATIVE_LOG  */
 
+/*
+ * Anchor headers at the end of the device and the Adaptec one;
+ * the rest of the metadata gets read once an anchor is found.
+ */
+static const struct probe_area ddf1_probe[] = {
+	{ -1, 1 },
+	{ -257, 1 },
+	{ 0, 0 },
+};
+
 static struct dmraid_format ddf1_format = {
 	.name = HANDLER,
 	.descr = "SNIA DDF1",
@@ -919,6 +970,7 @@ static struct dmraid_format ddf1_format = {
 	.write = ddf1_write,
 	.group = ddf1_group,
 	.check = ddf1_check,
+	.probe = ddf1_probe,
 #ifdef DMRAID_NATIVE_LOG
 	.log = ddf1_log,
 #endif
@@ -247,6 +247,13 @@ struct ddf1_spare_header {
 	struct ddf1_spare	spares[0];
 } __attribute__ ((packed));
 
+/* Reference of a VD config record to this drive (see build_index()). */
+struct ddf1_cfg_ref {
+	struct ddf1_config_record *cr;
+	unsigned int entry;		/* Index into CR_IDS() and CR_OFF(). */
+	struct ddf1_virt_drive *vd;	/* Virtual drive of the record. */
+};
+
 /* Metadata owner */
 struct ddf1 {
 	struct ddf1_header anchor;
@@ -264,6 +271,11 @@ struct ddf1 {
 	int disk_format;
 	int in_cpu_format;
 	int adaptec_mode;
+
+	/* Records of this drive, indexed once after reading. */
+	struct ddf1_phys_drive *pd;
+	unsigned int num_refs;
+	struct ddf1_cfg_ref refs[0];
 };
 
 #endif /* FORMAT_HANDLER */
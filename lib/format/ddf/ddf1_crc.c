@@ -15,50 +15,45 @@
 #define FORMAT_HANDLER
 #include "ddf1.h"
 #include "ddf1_crc.h"
+#include "ddf1_cvt.h"
 #include "ddf1_lib.h"
 
 #define DM_BYTEORDER_SWAB
 #include <datastruct/byteorder.h>
 
 /*
- * CRC table code to avoid linking to zlib, because Ubuntu has
+ * CRC code to avoid linking to zlib, because Ubuntu has
  * problems with that plus this additionally saves space.
+ *
+ * Slicing-by-8: 8 bytes per iteration through 8 precomputed tables.
  */
-
-/* Make the table for a fast CRC. */
-#define	CRC_TABLE_SIZE	256
-static inline void
-crc_table_init(uint32_t * crc_table)
-{
-	static int new = 1;	/* Flag for table not yet computed. */
-
-	if (new) {
-		uint32_t c, n, k;
-
-		for (new = n = 0; n < CRC_TABLE_SIZE; *(crc_table++) = c, n++) {
-			for (c = n, k = 0; k < 8; k++)
-				c = (c & 1) ? (c >> 1) ^ 0xEDB88320L : c >> 1;
-		}
-	}
-}
+#include "ddf1_crc_table.h"
 
 /*
  * Update a running CRC with the bytes buf[0..len-1] -- the CRC
  * should be initialized to all 1's, and the transmitted value
- * is the 1's complement of the final running CRC (see the
- * crc() routine below).
+ * is the 1's complement of the final running CRC.
+ *
+ * Bytes are combined explicitly, so this works on any host byte order.
  */
-/* Return the CRC of the bytes buf[0..len-1]. */
 static uint32_t
-crc(uint32_t crc, unsigned char *buf, int len)
+crc(uint32_t crc, unsigned char *buf, size_t len)
 {
-	int n;
-	static uint32_t crc_table[CRC_TABLE_SIZE];	/* CRCs of 8-bit messages. */
+	uint32_t w;
+
+	for (; len >= 8; buf += 8, len -= 8) {
+		w = crc ^ (buf[0] | buf[1] << 8 | buf[2] << 16 |
+			   (uint32_t) buf[3] << 24);
+		crc = crc_table[7][w & 0xFF] ^
+		      crc_table[6][(w >> 8) & 0xFF] ^
+		      crc_table[5][(w >> 16) & 0xFF] ^
+		      crc_table[4][w >> 24] ^
+		      crc_table[3][buf[4]] ^ crc_table[2][buf[5]] ^
+		      crc_table[1][buf[6]] ^ crc_table[0][buf[7]];
+	}
 
-	crc_table_init(crc_table);
-	for (n = 0; n < len; n++)
-		crc = crc_table[(crc ^ buf[n]) & (CRC_TABLE_SIZE - 1)] ^
-			(crc >> 8);
+	while (len--)
+		crc = crc_table[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
 
 	return crc ^ 0xFFFFFFFFL;
 }
@@ -90,95 +85,72 @@ record_size(struct ddf1 *ddf1)
 	return ddf1->primary->vd_config_record_len * DDF1_BLKSIZE;
 }
 
-#define CRC32(suffix, record_type, macro) \
-static int crc32_ ## suffix(struct lib_context *lc, struct dev_info *di, \
-			    struct ddf1 *ddf1, int idx) \
-{ \
-	struct record_type *r = macro(ddf1, idx); \
-	struct crc_info ci = { \
-		.p = r, \
-		.crc = &r->crc, \
-		.size = record_size(ddf1), \
-	}; \
-\
-	r->crc = do_crc32(lc, &ci); \
-	return 1; \
-}
-
-CRC32(vd, ddf1_config_record, CR);
-CRC32(spare, ddf1_spare_header, SR);
-#undef CRC32
-
-
-/* Process the configuration records to have their CRCs updated */
-static int
-update_cfg_crc(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
-{
-	static struct ddf1_record_handler handlers = {
-		.vd = crc32_vd,
-		.spare = crc32_spare,
-	};
-
-	ddf1_process_records(lc, di, &handlers, ddf1, 0);
-	return 1;
-}
-
 /* Checks the CRC for a particular table */
 static int
-check_crc(struct lib_context *lc, struct dev_info *di, struct crc_info *ci)
+check_crc(struct lib_context *lc, struct dev_info *di, struct crc_info *ci,
+	  uint32_t crc32, int swab)
 {
-	uint32_t crc32;
+	uint32_t expected = *ci->crc;
 
-	crc32 = do_crc32(lc, ci);
-	if (*ci->crc != crc32)
-		log_print(lc, "%s: %s with CRC %X, expected %X on %s",
-			  HANDLER, ci->text, crc32, *ci->crc, di->path);
+	if (swab)
+		CVT32(expected);
 
+	if (expected != crc32)
+		log_print(lc, "%s: %s with CRC %X, expected %X on %s",
+			  HANDLER, ci->text, crc32, expected, di->path);
 
 	return 1;
-
-}
-
-#define	CHECK_CRC(prefix, record_type, macro, txt) \
-static int prefix ## _check_crc(struct lib_context *lc, struct dev_info *di, \
-				struct ddf1 *ddf1, int idx) \
-{ \
-	struct record_type *r = macro(ddf1, idx); \
-	struct crc_info ci = { \
-		.p = r, \
-		.crc = &r->crc, \
-		.size = record_size(ddf1), \
-		.text = txt, \
-	}; \
-\
-	return check_crc(lc, di, &ci); \
 }
-CHECK_CRC(vd, ddf1_config_record, CR, "VD CFG");
-CHECK_CRC(spare, ddf1_spare_header, SR, "Spare CFG");
-#undef CHECK_CRC
 
-/* Process the configuration records to have their CRCs checked */
-static int
-check_cfg_crc(struct lib_context *lc, struct dev_info *di, struct ddf1 *ddf1)
+/* Add the CRC info of the VD and spare configuration records. */
+static unsigned int
+cfg_crcs(struct ddf1 *ddf1, struct crc_info *ci)
 {
-	struct ddf1_record_handler handlers = {
-		.vd = vd_check_crc,
-		.spare = spare_check_crc,
-	};
+	unsigned int i, cfgs = NUM_CONFIG_ENTRIES(ddf1), ret = 0;
+
+	for (i = 0; i < cfgs; i++) {
+		switch (*((uint32_t *) CR(ddf1, i))) {
+		case DDF1_VD_CONFIG_REC:
+			ci->crc = &CR(ddf1, i)->crc;
+			ci->text = "VD CFG";
+			break;
+
+		case DDF1_SPARE_REC:
+			ci->crc = &SR(ddf1, i)->crc;
+			ci->text = "Spare CFG";
+			break;
+
+		default:
+			continue;
+		}
 
-	return ddf1_process_records(lc, di, &handlers, ddf1, 0);
-}
+		ci->p = CR(ddf1, i);
+		ci->size = record_size(ddf1);
+		ci++;
+		ret++;
+	}
 
+	return ret;
+}
 
-/* Processes all of the DDF1 information for having their CRCs updated*/
+/*
+ * Processes all of the DDF1 information for having their CRCs
+ * checked or updated.
+ *
+ * The CRCs cover the metadata in disk byte order, so the metadata
+ * (which has to be in CPU format) gets converted to it and back after
+ * the areas to cover have been collected from the header.
+ */
 enum all_type { CHECK, UPDATE };
 static int
 all_crcs(struct lib_context *lc, struct dev_info *di,
 	 struct ddf1 *ddf1, enum all_type type)
 {
-	int ret = 1;
+	int ret = 1, swab = BYTE_ORDER != ddf1->disk_format;
+	unsigned int n = 0;
 	uint32_t crc;
-	struct crc_info crcs[] = {
+	struct crc_info *crcs, *c;
+	struct crc_info tables[] = {
 		{ddf1->primary, &ddf1->primary->crc,
 		 sizeof(*ddf1->primary), "primary header"}
 		,
@@ -199,22 +171,35 @@ all_crcs(struct lib_context *lc, struct dev_info *di,
 		 ddf1->primary->virt_drive_len * DDF1_BLKSIZE,
 		 "virtual drives"}
 		,
+	};
+
+	if (!(crcs = dbg_malloc((ARRAY_SIZE(tables) +
+				 NUM_CONFIG_ENTRIES(ddf1)) * sizeof(*crcs))))
+		return log_alloc_err(lc, __func__);
+
+	for (c = tables; c < ARRAY_END(tables); c++) {
+		if (c->p)
+			crcs[n++] = *c;
 	}
-	, *c = ARRAY_END(crcs);
-
-	while (c-- > crcs) {
-		if (c->p) {
-			if (type == CHECK)
-				ret &= check_crc(lc, di, c);
-			else {
-				crc = do_crc32(lc, c);
-				*c->crc = crc;
-			}
+
+	n += cfg_crcs(ddf1, crcs + n);
+
+	ddf1_cvt_all(lc, ddf1, di);
+	for (c = crcs; c < crcs + n; c++) {
+		crc = do_crc32(lc, c);
+		if (type == CHECK)
+			ret &= check_crc(lc, di, c, crc, swab);
+		else {
+			if (swab)
+				CVT32(crc);
+
+			*c->crc = crc;
 		}
 	}
 
-	return type == CHECK ? (ret & check_cfg_crc(lc, di, ddf1)) :
-		update_cfg_crc(lc, di, ddf1);
+	ddf1_cvt_all(lc, ddf1, di);
+	dbg_free(crcs);
+	return ret;
 }
 
 /* Processes the tables to check their CRCs */
@@ -183,12 +183,12 @@ alloc_private(struct lib_context *lc, const char *who, size_t size)
 /* Allocate private space in format handlers and read data off device. */
 void *
 alloc_private_and_read(struct lib_context *lc, const char *who,
-		       size_t size, char *path, loff_t offset)
+		       size_t size, struct dev_info *di, loff_t offset)
 {
 	void *ret;
 
 	if ((ret = alloc_private(lc, who, size))) {
-		if (!read_file(lc, who, path, ret, size, offset)) {
+		if (!dev_read(lc, who, di, ret, size, offset)) {
 			dbg_free(ret);
 			ret = NULL;
 		}
@@ -227,7 +227,7 @@ _write_metadata(struct lib_context *lc, const char *handler,
 	    !(p = alloc_private(lc, handler, rd->meta_areas[idx].size)))
 		goto out;
 
-	ret = write_file(lc, handler, rd->di->path, (void *) p,
+	ret = dev_write(lc, handler, rd->di, (void *) p,
 			 rd->meta_areas[idx].size,
 			 rd->meta_areas[idx].offset << 9);
 
@@ -539,7 +539,7 @@ read_raid_dev(struct lib_context *lc,
 	 */
 	meta = f_read_metadata ?
 	       f_read_metadata(lc, di, &size, &offset, &info) :
-		alloc_private_and_read(lc, handler, size, di->path, offset);
+		alloc_private_and_read(lc, handler, size, di, offset);
 	if (!meta)
 		goto out;
 
@@ -238,7 +238,7 @@ group_rd_extended(struct lib_context *lc, struct raid_dev *rd,
 
 	/* Allocate and read a logical partition table. */
 	if (!(dos = alloc_private_and_read(lc, handler, sizeof(*dos),
-					   rd->di->path, start_sector << 9)))
+					   rd->di, start_sector << 9)))
 		return 0;
 
 	/* Weird: empty extended partitions are filled with 0xF6 by PM. */
@@ -25,6 +25,7 @@
 #include <stdint.h>
 #include <dmraid/lib_context.h>
 #include <dmraid/dmreg.h>
+#include <dmraid/dm_status.h>
 #include <dmraid/list.h>
 #include <dmraid/locking.h>
 #include "log/log.h"
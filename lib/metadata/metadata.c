@@ -9,8 +9,10 @@
  */
 
 #include <getopt.h>
+#include <sys/time.h>
 #include "internal.h"
 #include "activate/devmapper.h"
+#include "misc/archive.h"
 
 /*
  * Type -> ascii definitions.
@@ -275,6 +277,45 @@ count_devs(struct lib_context *lc, struct raid_set *rs,
 	return ret;
 }
 
+/*
+ * Let @dst reference the metadata of @src at byte @offset rather than
+ * keeping a copy of it. The buffer gets freed with the last reference.
+ */
+int
+share_meta_area(struct lib_context *lc, struct meta_areas *dst,
+		struct meta_areas *src, size_t offset)
+{
+	if (!src->buf) {
+		if (!(src->buf = dbg_malloc(sizeof(*src->buf))))
+			return log_alloc_err(lc, __func__);
+
+		src->buf->ptr = src->area;
+		src->buf->ref = 1;
+	}
+
+	src->buf->ref++;
+	dst->buf = src->buf;
+	dst->area = (uint8_t *) src->area + offset;
+	return 1;
+}
+
+/* Release the (shared) metadata buffer of an area. */
+void
+put_meta_area(struct lib_context *lc, struct meta_areas *ma)
+{
+	if (ma->buf) {
+		if (!--ma->buf->ref) {
+			dbg_free(ma->buf->ptr);
+			dbg_free(ma->buf);
+		}
+
+		ma->buf = NULL;
+	} else if (ma->area)
+		dbg_free(ma->area);
+
+	ma->area = NULL;
+}
+
 /*
  * Create list of unique memory pointers of a RAID device and free them.
  *
@@ -302,6 +343,12 @@ _free_dev_pointers(struct lib_context *lc, struct raid_dev *rd)
 
 	/* Add metadata area pointers to list. */
 	for (area = 0; area < rd->areas; area++) {
+		/* Shared buffers go with their last reference. */
+		if (rd->meta_areas[area].buf) {
+			put_meta_area(lc, rd->meta_areas + area);
+			continue;
+		}
+
 		/* Handle multiple pointers to the same memory. */
 		for (i = 0; i < idx; i++) {
 			if (p[i] == rd->meta_areas[area].area)
@@ -329,6 +376,7 @@ alloc_dev_info(struct lib_context *lc, char *path)
 	struct dev_info *di;
 
 	if ((di = dbg_malloc(sizeof(*di)))) {
+		di->fd = -1;
 		if ((di->path = dbg_strdup(path)))
 			INIT_LIST_HEAD(&di->list);
 		else {
@@ -345,6 +393,8 @@ alloc_dev_info(struct lib_context *lc, char *path)
 static void
 _free_dev_info(struct lib_context *lc, struct dev_info *di)
 {
+	dev_close(lc, di);
+
 	if (di->serial)
 		dbg_free(di->serial);
 
@@ -760,6 +810,20 @@ _want_device(struct dev_info *di, char **devices)
 	return 0;
 }
 
+/*
+ * Close all devices after probing them, so that large numbers of disks
+ * don't exhaust file descriptors and failed ones can be replaced.
+ * Metadata updates reopen the devices they write to.
+ */
+static void
+close_devices(struct lib_context *lc)
+{
+	struct dev_info *di;
+
+	list_for_each_entry(di, LC_DI(lc), list)
+		dev_close(lc, di);
+}
+
 /* Discover RAID devices that are spares */
 static void
 discover_raid_devices_spares(struct lib_context *lc, const char *format)
@@ -778,6 +842,50 @@ discover_raid_devices_spares(struct lib_context *lc, const char *format)
 		}
 
 	}
+
+	close_devices(lc);
+}
+
+/*
+ * Queue reads of the areas the RAID format handlers probe first on
+ * all devices up front, so that device latencies overlap rather than
+ * add up while the handlers read them one at a time. Metadata beyond
+ * those (eg, isw or DDF extended areas) gets read once a header has
+ * been found.
+ */
+static void
+prefetch_metadata(struct lib_context *lc, char **devices)
+{
+	uint64_t start;
+	struct dev_info *di;
+	struct format_list *fl;
+	const struct probe_area *pa;
+
+	/* Pointless with the page cache bypassed. */
+	if (OPT_DIRECT_IO(lc))
+		return;
+
+	list_for_each_entry(di, LC_DI(lc), list) {
+		if (!_want_device(di, devices))
+			continue;
+
+		list_for_each_entry(fl, LC_FMT(lc), list) {
+			if (!_want_format(fl->fmt, NULL, FMT_RAID) ||
+			    !(pa = fl->fmt->probe))
+				continue;
+
+			for (; pa->sectors; pa++) {
+				start = pa->sector < 0 ?
+					di->sectors + pa->sector : pa->sector;
+				if (start > di->sectors ||
+				    pa->sectors > di->sectors - start)
+					continue;
+
+				dev_prefetch(lc, di, start * DMRAID_SECTOR_SIZE,
+					     pa->sectors * DMRAID_SECTOR_SIZE);
+			}
+		}
+	}
 }
 
 /* Discover RAID devices. */
@@ -795,6 +903,8 @@ discover_raid_devices(struct lib_context *lc, char **devices)
 		return;
 	}
 
+	prefetch_metadata(lc, devices);
+
 	/* Walk the list of discovered block devices. */
 	list_for_each_entry(di, LC_DI(lc), list) {
 		if (_want_device(di, devices)) {
@@ -815,6 +925,8 @@ discover_raid_devices(struct lib_context *lc, char **devices)
 
 	if (names)
 		dbg_free(names);
+
+	close_devices(lc);
 }
 
 /*
@@ -892,7 +1004,9 @@ _discover_partitions(struct lib_context *lc, struct list_head *rs_list)
 void
 discover_partitions(struct lib_context *lc)
 {
-	_discover_partitions(lc, LC_RS(lc));
+	/* Mapped devices of the mock hold no data to read. */
+	if (!OPT_DM_MOCK(lc))
+		_discover_partitions(lc, LC_RS(lc));
 }
 
 /*
@@ -1628,12 +1742,45 @@ process_sets(struct lib_context *lc,
 	list_for_each_entry(rs, LC_RS(lc), list) p(lc, rs, func, arg);
 }
 
-/* Write RAID set metadata to devices. */
+/* Start (@wait = 0) or wait for flushing all devices of a set. */
+static int
+sync_set(struct lib_context *lc, struct raid_set *rs, int wait)
+{
+	int ret = 1;
+	struct raid_set *r;
+	struct raid_dev *rd;
+
+	list_for_each_entry(r, &rs->sets, list) {
+		if (!sync_set(lc, r, wait))
+			ret = 0;
+	}
+
+	list_for_each_entry(rd, &rs->devs, devs) {
+		if (!dev_sync(lc, rd->di, wait))
+			ret = 0;
+	}
+
+	return ret;
+}
+
+/*
+ * Commit metadata written to the devices of a set.
+ *
+ * Writeback is started on all members before waiting for any,
+ * so that the flushes overlap.
+ */
 int
-write_set(struct lib_context *lc, void *v)
+commit_set(struct lib_context *lc, struct raid_set *rs)
+{
+	sync_set(lc, rs, 0);
+	return sync_set(lc, rs, 1);
+}
+
+static int
+_write_set(struct lib_context *lc, struct raid_set *rs)
 {
 	int ret = 1;
-	struct raid_set *r, *rs = v;
+	struct raid_set *r;
 	struct raid_dev *rd;
 
 	/* Decend hierarchy */
@@ -1642,7 +1789,7 @@ write_set(struct lib_context *lc, void *v)
 		 * FIXME: does it make sense to try the rest of the subset
 		 *        in case we fail writing one ?
 		 */
-		if (!write_set(lc, (void *) r))
+		if (!_write_set(lc, r))
 			log_err(lc,
 				"writing RAID subset \"%s\", continuing",
 				r->name);
@@ -1665,6 +1812,15 @@ write_set(struct lib_context *lc, void *v)
 	return ret;
 }
 
+/* Write RAID set metadata to devices. */
+int
+write_set(struct lib_context *lc, void *v)
+{
+	int ret = _write_set(lc, v);
+
+	return commit_set(lc, v) && ret;
+}
+
 /* Erase ondisk metadata. */
 int
 erase_metadata(struct lib_context *lc)
@@ -1683,6 +1839,15 @@ erase_metadata(struct lib_context *lc)
 		}
 	}
 
+	/* Overlap flushing the devices. */
+	list_for_each_entry(rd, LC_RD(lc), list)
+		dev_sync(lc, rd->di, 0);
+
+	list_for_each_entry(rd, LC_RD(lc), list) {
+		if (!dev_sync(lc, rd->di, 1))
+			ret = 0;
+	}
+
 	return ret;
 }
 
@@ -1747,25 +1912,28 @@ list_add_sorted(struct lib_context *lc,
 /*
  * Support function for format handlers:
  *
- * File RAID metadata and offset on device for analysis.
+ * File RAID metadata and offset on device for analysis, either into
+ * files in a directory per format handler named after the command
+ * and the handler or into one archive (--dump_archive).
  */
 /* FIXME: all files into one directory ? */
 static size_t
-__name(struct lib_context *lc, char *str, size_t len,
+__name(struct lib_context *lc, char *str, size_t len, const char *dir,
        const char *path, const char *suffix)
 {
-	return snprintf(str, len, "%s.%s",
+	return snprintf(str, len, "%s%s%s.%s", dir ? dir : "", dir ? "/" : "",
 			get_basename(lc, (char *) path), suffix) + 1;
 }
 
 static char *
-_name(struct lib_context *lc, const char *path, const char *suffix)
+_name(struct lib_context *lc, const char *dir, const char *path,
+      const char *suffix)
 {
 	size_t len;
 	char *ret;
 
-	if ((ret = dbg_malloc((len = __name(lc, NULL, 0, path, suffix)))))
-		__name(lc, ret, len, path, suffix);
+	if ((ret = dbg_malloc((len = __name(lc, NULL, 0, dir, path, suffix)))))
+		__name(lc, ret, len, dir, path, suffix);
 	else
 		log_alloc_err(lc, __func__);
 
@@ -1773,13 +1941,13 @@ _name(struct lib_context *lc, const char *path, const char *suffix)
 }
 
 static int
-file_data(struct lib_context *lc, const char *handler,
+file_data(struct lib_context *lc, const char *handler, const char *dir,
 	  char *path, void *data, size_t size)
 {
 	int ret = 0;
 	char *name;
 
-	if ((name = _name(lc, path, "dat"))) {
+	if ((name = _name(lc, dir, path, "dat"))) {
 		log_notice(lc, "writing metadata file \"%s\"", name);
 		ret = write_file(lc, handler, name, data, size, 0);
 		dbg_free(name);
@@ -1789,48 +1957,43 @@ file_data(struct lib_context *lc, const char *handler,
 }
 
 static void
-file_number(struct lib_context *lc, const char *handler,
-	    char *path, uint64_t number, const char *suffix)
+file_string(struct lib_context *lc, const char *handler, const char *dir,
+	    char *path, char *str, size_t len, const char *suffix)
 {
-	char *name, s_number[32];
+	char *name;
 
-	if ((name = _name(lc, path, suffix))) {
+	if ((name = _name(lc, dir, path, suffix))) {
 		log_notice(lc, "writing %s to file \"%s\"", suffix, name);
-		write_file(lc, handler, name, (void *) s_number,
-			   snprintf(s_number, sizeof(s_number),
-				    "%" PRIu64 "\n", number), 0);
+		write_file(lc, handler, name, str, len, 0);
 		dbg_free(name);
 	}
 }
 
-static int
-_chdir(struct lib_context *lc, const char *dir)
+static void
+file_number(struct lib_context *lc, const char *handler, const char *dir,
+	    char *path, uint64_t number, const char *suffix)
 {
-	if (chdir(dir)) {
-		log_err(lc, "changing directory to %s", dir);
-		return -EFAULT;
-	}
+	char s_number[32];
 
-	return 0;
+	file_string(lc, handler, dir, path, s_number,
+		    snprintf(s_number, sizeof(s_number),
+			     "%" PRIu64 "\n", number), suffix);
 }
 
+/* Create the directory to file metadata of @handler into. */
 static char *
 _dir(struct lib_context *lc, const char *handler)
 {
-	char *dir = _name(lc, lc->cmd, handler);
+	char *dir = _name(lc, NULL, lc->cmd, handler);
 
 	if (!dir) {
 		log_err(lc, "allocating directory name for %s", handler);
 		return NULL;
 	}
 
-	if (!mk_dir(lc, dir))
-		goto out;
-
-	if (!_chdir(lc, dir))
+	if (mk_dir(lc, dir))
 		return dir;
 
-out:
 	dbg_free(dir);
 	return NULL;
 }
@@ -1842,37 +2005,45 @@ void
 file_metadata(struct lib_context *lc, const char *handler,
 	      char *path, void *data, size_t size, uint64_t offset)
 {
-	if (OPT_DUMP(lc)) {
-		char *dir = _dir(lc, handler);
+	char *dir;
 
-		if (dir)
-			dbg_free(dir);
-		else
-			return;
+	if (!OPT_DUMP(lc))
+		return;
 
-		if (file_data(lc, handler, path, data, size))
-			file_number(lc, handler, path, offset, "offset");
+	if (OPT_DUMP_ARCHIVE(lc))
+		archive_add(lc, handler, path, AR_METADATA, data, size, offset);
+	else if ((dir = _dir(lc, handler))) {
+		if (file_data(lc, handler, dir, path, data, size))
+			file_number(lc, handler, dir, path, offset, "offset");
 
-		_chdir(lc, "..");
+		dbg_free(dir);
 	}
 }
 
 /*
- * File RAID device size.
+ * File RAID device size and serial number (for --replay).
  */
 void
 file_dev_size(struct lib_context *lc, const char *handler, struct dev_info *di)
 {
-	if (OPT_DUMP(lc)) {
-		char *dir = _dir(lc, handler);
+	char *dir;
 
-		if (dir)
-			dbg_free(dir);
-		else
-			return;
+	if (!OPT_DUMP(lc))
+		return;
 
-		file_number(lc, handler, di->path, di->sectors, "size");
-		_chdir(lc, "..");
+	if (OPT_DUMP_ARCHIVE(lc)) {
+		archive_add(lc, handler, di->path, AR_SIZE, NULL, 0,
+			    di->sectors);
+		if (di->serial)
+			archive_add(lc, handler, di->path, AR_SERIAL,
+				    di->serial, strlen(di->serial), 0);
+	} else if ((dir = _dir(lc, handler))) {
+		file_number(lc, handler, dir, di->path, di->sectors, "size");
+		if (di->serial)
+			file_string(lc, handler, dir, di->path, di->serial,
+				    strlen(di->serial), "serial");
+
+		dbg_free(dir);
 	}
 }
 
@@ -2080,10 +2251,53 @@ format_error(struct lib_context *lc, const char *error, char **argv)
 	log_print(lc, "");
 }
 
+/* Counters at the start of a processing phase (--stats). */
+struct phase_stats {
+	struct timeval tv;
+	unsigned long reads, writes, allocations;
+	uint64_t bytes;
+};
+
+static void
+stats_start(struct lib_context *lc, struct phase_stats *ps)
+{
+	if (!OPT_STATS(lc))
+		return;
+
+	gettimeofday(&ps->tv, NULL);
+	ps->reads = lc->io_stats.reads;
+	ps->writes = lc->io_stats.writes;
+	ps->bytes = lc->io_stats.bytes;
+	ps->allocations = dbg_allocations();
+}
+
+/* Report what happened since stats_start() and restart the counters. */
+static void
+stats_end(struct lib_context *lc, const char *phase, struct phase_stats *ps)
+{
+	struct timeval tv;
+	long usecs;
+
+	if (!OPT_STATS(lc))
+		return;
+
+	gettimeofday(&tv, NULL);
+	usecs = (tv.tv_sec - ps->tv.tv_sec) * 1000000L +
+		tv.tv_usec - ps->tv.tv_usec;
+	log_print(lc, "%s: %ld.%06lds, %lu reads, %lu writes, "
+		  "%" PRIu64 " bytes, %lu allocations", phase,
+		  usecs / 1000000L, usecs % 1000000L,
+		  lc->io_stats.reads - ps->reads,
+		  lc->io_stats.writes - ps->writes,
+		  lc->io_stats.bytes - ps->bytes,
+		  dbg_allocations() - ps->allocations);
+	stats_start(lc, ps);
+}
+
 /* Retrieve and build metadata. */
 static int
 get_metadata(struct lib_context *lc, enum action action,
-	     struct prepost *p, char **argv)
+	     struct prepost *p, char **argv, struct phase_stats *ps)
 {
 	if (!(M_DEVICE & p->metadata))
 		return 1;
@@ -2091,6 +2305,7 @@ get_metadata(struct lib_context *lc, enum action action,
 	if (!discover_devices(lc, OPT_DEVICES(lc) ? argv : NULL))
 		LOG_ERR(lc, 0, "failed to discover devices");
 
+	stats_end(lc, "device discovery", ps);
 	if (!count_devices(lc, DEVICE)) {
 		log_print(lc, "no block devices found");
 		return 0;
@@ -2108,6 +2323,7 @@ get_metadata(struct lib_context *lc, enum action action,
 			      (RAID_DEVICES & action) ? argv : NULL);
 # endif
 
+	stats_end(lc, "RAID device discovery", ps);
 	if (!OPT_HOT_SPARE_SET(lc) && !OPT_CREATE(lc)
 	    && !count_devices(lc, RAID)) {
 		format_error(lc, "disks", argv);
@@ -2117,6 +2333,7 @@ get_metadata(struct lib_context *lc, enum action action,
 	if (M_SET & p->metadata) {
 		/* Group RAID sets. */
 		group_set(lc, argv);
+		stats_end(lc, "RAID set grouping", ps);
 		if (!OPT_HOT_SPARE_SET(lc) && !OPT_CREATE(lc)
 		    && !count_devices(lc, SET)) {
 			format_error(lc, "sets", argv);
@@ -2133,18 +2350,23 @@ lib_perform(struct lib_context *lc, enum action action,
 	    struct prepost *p, char **argv)
 {
 	int ret = 0;
+	struct phase_stats ps;
 
-	if (ROOT == p->id && geteuid())
+	/* Replayed devices don't need privileges. */
+	if (ROOT == p->id && geteuid() && !OPT_REPLAY(lc))
 		LOG_ERR(lc, 0, "you must be root");
 
 	/* Lock against parallel runs. Resource NULL for now. */
 	if (LOCK == p->lock && !lock_resource(lc, NULL))
 		LOG_ERR(lc, 0, "lock failure");
 
-	if (get_metadata(lc, action, p, argv))
+	stats_start(lc, &ps);
+	if (get_metadata(lc, action, p, argv, &ps)) {
 		ret = p->post(lc, p->pre ? p->pre(p->arg) : p->arg);
+		stats_end(lc, "action", &ps);
+	}
 
-	if (ret && (RMPARTITIONS & action))
+	if (ret && (RMPARTITIONS & action) && !OPT_REPLAY(lc))
 		process_sets(lc, remove_device_partitions, 0, SETS);
 
 	if (LOCK == p->lock)
@@ -2156,12 +2378,22 @@ lib_perform(struct lib_context *lc, enum action action,
 int
 dso_get_members(struct lib_context *lc, int arg)
 {
-	static char disks[100] = "\0";
+	size_t len = 1;
+	char *disks;
 	const char *vol_name = lc->options[LC_REBUILD_SET].arg.str;
 	struct raid_set *sub_rs;
 	struct raid_dev *rd;
 
 	if ((sub_rs = find_set(lc, NULL, vol_name, FIND_ALL))) {
+		/* Called repeatedly on one context by the DSO. */
+		list_for_each_entry(rd, &sub_rs->devs, devs)
+			len += strlen(rd->di->path) + 1;
+
+		if (!(disks = dbg_malloc(len))) {
+			log_alloc_err(lc, __func__);
+			return 1;
+		}
+
 		lc->options[LC_REBUILD_SET].opt = 0;
 
 		list_for_each_entry(rd, &sub_rs->devs, devs) {
@@ -2171,10 +2403,157 @@ dso_get_members(struct lib_context *lc, int arg)
 		}
 
 		dbg_free((char *) lc->options[LC_REBUILD_SET].arg.str);
-		lc->options[LC_REBUILD_SET].arg.str = dbg_strdup(disks);
+		lc->options[LC_REBUILD_SET].arg.str = disks;
 		return 0;
 	}
 	else
 		/* RAID set not found. */
 		return 1;
 }
+
+/* Find member @dev_name (eg, "sda") of @rs or its subsets. */
+static struct raid_dev *
+find_member(struct lib_context *lc, struct raid_set *rs, const char *dev_name)
+{
+	struct raid_set *r;
+	struct raid_dev *rd;
+
+	/* Stacked sets (eg. RAID10) keep their devices in the subsets. */
+	list_for_each_entry(r, &rs->sets, list) {
+		if ((rd = find_member(lc, r, dev_name)))
+			return rd;
+	}
+
+	list_for_each_entry(rd, &rs->devs, devs) {
+		if (!strcmp(get_basename(lc, rd->di->path), dev_name))
+			return rd;
+	}
+
+	return NULL;
+}
+
+/*
+ * Apply I/O error @e_io to the metadata of all members of @rs
+ * and its subsets, writing the metadata of those which changed.
+ *
+ * Return 0 if writing the metadata of any survivor failed.
+ */
+static int
+_event_io(struct lib_context *lc, struct raid_set *rs,
+	  struct event_io *e_io, unsigned int *changed)
+{
+	int ret = 1;
+	struct raid_set *r;
+	struct raid_dev *rd;
+
+	list_for_each_entry(r, &rs->sets, list) {
+		if (!_event_io(lc, r, e_io, changed))
+			ret = 0;
+	}
+
+	list_for_each_entry(rd, &rs->devs, devs) {
+		if (!rd->fmt->events || !rd->fmt->events->io)
+			continue;
+
+		e_io->member = rd;
+		if (!rd->fmt->events->io(lc, e_io))
+			continue;
+
+		(*changed)++;
+		if (OPT_TEST(lc))
+			continue;
+
+		/*
+		 * The failed device may well not take the write;
+		 * flush it right away, so that commit_set() won't
+		 * trip over it.
+		 */
+		if (rd == e_io->rd) {
+			if (write_dev(lc, rd, 0))
+				dev_sync(lc, rd->di, 1);
+		} else if (!write_dev(lc, rd, 0))
+			ret = 0;
+	}
+
+	return ret;
+}
+
+/*
+ * Route an I/O error on member @dev_name (eg, "sda") of RAID set
+ * @rs_name to the format's event handler, which records it in the
+ * metadata of the surviving members (and of the failed one, if it
+ * still can be read), so that the failure persists across reboots.
+ *
+ * A failed device often can't be rediscovered, in which
+ * case the handler gets no RAID device of the I/O error.
+ *
+ * Return 1 if the failure got recorded.
+ */
+int
+dso_event_io(struct lib_context *lc, const char *rs_name,
+	     const char *dev_name, uint64_t sector)
+{
+	int ret;
+	unsigned int changed = 0;
+	struct raid_set *rs;
+	struct event_io e_io = { .sector = sector };
+
+	if (!(rs = find_set(lc, NULL, rs_name, FIND_ALL)))
+		LOG_ERR(lc, 0, "RAID set \"%s\" not found", rs_name);
+
+	e_io.rs = rs;
+	e_io.rd = find_member(lc, rs, dev_name);
+	ret = _event_io(lc, rs, &e_io, &changed);
+	if (!changed)
+		LOG_ERR(lc, 0, "failure of device \"%s\" not recordable in "
+			"metadata of RAID set \"%s\"", dev_name, rs_name);
+
+	if (OPT_TEST(lc))
+		return 1;
+
+	return commit_set(lc, rs) && ret;
+}
+
+static int
+_rebuild_checkpoint(struct lib_context *lc, struct raid_set *rs,
+		    struct handler_info *info)
+{
+	int ret = 1;
+	struct raid_set *r;
+	struct raid_dev *rd;
+
+	/* Stacked sets (eg. RAID10) keep their devices in the subsets. */
+	list_for_each_entry(r, &rs->sets, list)
+		ret &= _rebuild_checkpoint(lc, r, info);
+
+	if (list_empty(&rs->devs))
+		return ret;
+
+	rd = RD_RS(rs);
+	return rd->fmt->metadata_handler &&
+	       rd->fmt->metadata_handler(lc, UPDATE_REBUILD_CHECKPOINT,
+					 info, rs) && ret;
+}
+
+/*
+ * Checkpoint the rebuild of RAID set @rs_name: everything below
+ * @sector is in sync. Formats supporting it keep the checkpoint in
+ * their metadata, so that activation resumes the rebuild from there.
+ *
+ * Return 1 if the checkpoint got written.
+ */
+int
+dso_rebuild_checkpoint(struct lib_context *lc, const char *rs_name,
+		       uint64_t sector)
+{
+	struct raid_set *rs;
+	struct handler_info info = { .data.u64 = sector };
+
+	if (!(rs = find_set(lc, NULL, rs_name, FIND_ALL)))
+		LOG_ERR(lc, 0, "RAID set \"%s\" not found", rs_name);
+
+	if (OPT_TEST(lc))
+		return 1;
+
+	return _rebuild_checkpoint(lc, rs, &info);
+}
@@ -154,6 +154,8 @@ add_dev_to_raid(struct lib_context *lc, struct raid_set *rs,
 				list_for_each_entry(tmp, &rs->devs, devs) {
 					write_dev(lc, tmp, 0);
 				}
+
+				commit_set(lc, rs);
 			} else {
 				log_print(lc, "metadata fmt update failed\n");
 				goto err;
@@ -411,6 +413,11 @@ del_dev_in_raid1(struct lib_context *lc, struct raid_set *rs,
 	if (!ret)
 		goto err;
 
+	/* Make sure it hits the disk before any of the others. */
+	ret = dev_sync(lc, rd->di, 1);
+	if (!ret)
+		goto err;
+
 	/* Write metadatas of every device in the set */
 	list_for_each_entry(tmp, &rs->devs, devs) {
 		if (tmp == rd)
@@ -428,6 +435,10 @@ del_dev_in_raid1(struct lib_context *lc, struct raid_set *rs,
 			goto err;
 	}
 
+	ret = commit_set(lc, rs);
+	if (!ret)
+		goto err;
+
 	/* Reconfigure device mapper */
 	rs->status |= s_inconsistent;
 	rs->status |= s_nosync;
@@ -754,8 +765,11 @@ add_spare_dev_to_raid(struct lib_context *lc, struct raid_set *rs)
 			"metadata creation is not supported in \"%s\" format",
 			fmt_hand->name);
 	} else {
-		if ((ret = fmt_hand->create(lc, rs)))
+		if ((ret = fmt_hand->create(lc, rs))) {
 			ret = write_set_spare(lc, rs);
+			if (!commit_set(lc, rs))
+				ret = 0;
+		}
 
 		if (!ret)
 			log_print(lc, "metadata fmt update failed\n");
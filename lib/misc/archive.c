@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2004-2010  Heinz Mauelshagen, Red Hat GmbH.
+ *                          All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * Metadata dump archive (--dump_archive) writing and read back.
+ *
+ * Data gets written as it's being filed, the index is kept
+ * in memory until archive_close() appends it and the trailer.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "internal.h"
+#include "misc/archive.h"
+
+#if	BYTE_ORDER != LITTLE_ENDIAN
+#  define	DM_BYTEORDER_SWAB
+#endif
+#include	<datastruct/byteorder.h>
+
+/* Archive being written. */
+struct archive {
+	int fd;			/* -1 after errors. */
+	uint64_t pos;		/* Bytes written so far. */
+	unsigned int entries;
+	unsigned int size;	/* # of index entries allocated. */
+	struct archive_entry *index;
+};
+
+#define	ARCHIVE(lc)	((struct archive *) (lc)->dump)
+#define	ALIGNMENT	8
+
+static int
+write_all(int fd, const void *buf, size_t size)
+{
+	ssize_t r;
+	const uint8_t *p = buf;
+
+	while (size) {
+		if ((r = write(fd, p, size)) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return 0;
+		}
+
+		p += r;
+		size -= r;
+	}
+
+	return 1;
+}
+
+static int
+archive_write(struct lib_context *lc, const void *buf, size_t size)
+{
+	if (write_all(ARCHIVE(lc)->fd, buf, size)) {
+		ARCHIVE(lc)->pos += size;
+		return 1;
+	}
+
+	log_err(lc, "writing archive %s[%s]",
+		OPT_STR_DUMP_ARCHIVE(lc), strerror(errno));
+	if (ARCHIVE(lc)->fd != STDOUT_FILENO)
+		close(ARCHIVE(lc)->fd);
+
+	ARCHIVE(lc)->fd = -1;
+	return 0;
+}
+
+/*
+ * Create the archive on first use. With "-" as the archive name, it goes
+ * to standard output and the regular output gets redirected to stderr.
+ */
+static struct archive *
+archive_open(struct lib_context *lc)
+{
+	const char *path = OPT_STR_DUMP_ARCHIVE(lc);
+	struct archive *a;
+
+	if (ARCHIVE(lc))
+		return ARCHIVE(lc);
+
+	if (!(a = lc->dump = dbg_malloc(sizeof(*a)))) {
+		log_alloc_err(lc, __func__);
+		return NULL;
+	}
+
+	if (!strcmp(path, "-")) {
+		fflush(stdout);
+		if ((a->fd = dup(STDOUT_FILENO)) > -1)
+			dup2(STDERR_FILENO, STDOUT_FILENO);
+	} else
+		a->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, lc->mode);
+
+	if (a->fd < 0)
+		log_err(lc, "creating archive %s[%s]", path, strerror(errno));
+	else {
+		log_notice(lc, "writing metadata archive \"%s\"", path);
+		archive_write(lc, ARCHIVE_MAGIC, ARCHIVE_MAGIC_SIZE);
+	}
+
+	return a;
+}
+
+/* File data of @type with the index entry named after device @path. */
+int
+archive_add(struct lib_context *lc, const char *handler, char *path,
+	    enum archive_type type, void *data, size_t size, uint64_t offset)
+{
+	static const uint8_t pad[ALIGNMENT];
+	struct archive *a;
+	struct archive_entry *e;
+
+	if (!(a = archive_open(lc)) || a->fd < 0)
+		return 0;
+
+	if (a->entries == a->size) {
+		unsigned int n = a->size ? 2 * a->size : 64;
+
+		if (!(e = dbg_realloc(a->index, n * sizeof(*e))))
+			return log_alloc_err(lc, __func__);
+
+		a->index = e;
+		a->size = n;
+	}
+
+	e = a->index + a->entries;
+	memset(e, 0, sizeof(*e));
+	e->data = a->pos;
+	e->size = size;
+	e->offset = offset;
+	e->type = type;
+	strncpy(e->handler, handler, sizeof(e->handler) - 1);
+	strncpy(e->name, get_basename(lc, path), sizeof(e->name) - 1);
+
+	if (size &&
+	    (!archive_write(lc, data, size) ||
+	     !archive_write(lc, pad, round_up(size, ALIGNMENT) - size)))
+		return 0;
+
+	CVT64(e->data);
+	CVT64(e->size);
+	CVT64(e->offset);
+	CVT32(e->type);
+	a->entries++;
+	return 1;
+}
+
+/* Append index and trailer and release the archive. */
+int
+archive_close(struct lib_context *lc)
+{
+	int ret = 0;
+	struct archive *a = ARCHIVE(lc);
+	struct archive_trailer t = {
+		.index = a ? a->pos : 0,
+		.entries = a ? a->entries : 0,
+		.magic = ARCHIVE_MAGIC,
+	};
+
+	if (!a)
+		return 1;
+
+	CVT64(t.index);
+	CVT64(t.entries);
+	if (a->fd > -1 &&
+	    archive_write(lc, a->index, a->entries * sizeof(*a->index)) &&
+	    archive_write(lc, &t, sizeof(t))) {
+		if (a->fd == STDOUT_FILENO || !close(a->fd))
+			ret = 1;
+		else
+			log_err(lc, "closing archive %s[%s]",
+				OPT_STR_DUMP_ARCHIVE(lc), strerror(errno));
+	}
+
+	if (a->index)
+		dbg_free(a->index);
+
+	dbg_free(a);
+	lc->dump = NULL;
+	return ret;
+}
+
+/* Map an archive read-only after checking its structure. */
+void *
+archive_map(struct lib_context *lc, const char *path, size_t *len)
+{
+	int fd;
+	void *map;
+	struct stat st;
+	struct archive_trailer *t;
+	uint64_t index, entries, end;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		LOG_ERR(lc, NULL, "opening archive %s", path);
+
+	if (fstat(fd, &st) ||
+	    st.st_size < ARCHIVE_MAGIC_SIZE + sizeof(*t) ||
+	    (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+			fd, 0)) == MAP_FAILED) {
+		close(fd);
+		LOG_ERR(lc, NULL, "mapping archive %s", path);
+	}
+
+	close(fd);
+	t = (struct archive_trailer *)
+	    ((uint8_t *) map + st.st_size - sizeof(*t));
+	index = t->index;
+	entries = t->entries;
+	CVT64(index);
+	CVT64(entries);
+	end = st.st_size - sizeof(*t);
+
+	if (memcmp(map, ARCHIVE_MAGIC, ARCHIVE_MAGIC_SIZE) ||
+	    memcmp(t->magic, ARCHIVE_MAGIC, ARCHIVE_MAGIC_SIZE) ||
+	    index < ARCHIVE_MAGIC_SIZE || index > end ||
+	    entries > (end - index) / sizeof(struct archive_entry)) {
+		munmap(map, st.st_size);
+		LOG_ERR(lc, NULL, "invalid archive %s", path);
+	}
+
+	*len = st.st_size;
+	return map;
+}
+
+/* Call @f for each index entry of a mapped archive. */
+int
+archive_for_each(struct lib_context *lc, void *map, size_t len,
+		 int (*f) (struct lib_context *lc,
+			   struct archive_rec *rec, void *arg),
+		 void *arg)
+{
+	uint64_t i, index, entries, data, size;
+	struct archive_trailer *t = (struct archive_trailer *)
+				    ((uint8_t *) map + len - sizeof(*t));
+	struct archive_entry *e;
+	struct archive_rec rec;
+
+	index = t->index;
+	entries = t->entries;
+	CVT64(index);
+	CVT64(entries);
+
+	for (e = (struct archive_entry *) ((uint8_t *) map + index), i = 0;
+	     i < entries; e++, i++) {
+		data = e->data;
+		size = e->size;
+		CVT64(data);
+		CVT64(size);
+
+		/* Data has to precede the index. */
+		if (data > index || size > index - data ||
+		    !memchr(e->handler, 0, sizeof(e->handler)) ||
+		    !memchr(e->name, 0, sizeof(e->name)))
+			LOG_ERR(lc, 0, "invalid archive index entry %" PRIu64,
+				i);
+
+		rec.type = e->type;
+		rec.offset = e->offset;
+		CVT32(rec.type);
+		CVT64(rec.offset);
+		rec.handler = e->handler;
+		rec.name = e->name;
+		rec.data = (uint8_t *) map + data;
+		rec.size = size;
+
+		if (!f(lc, &rec, arg))
+			return 0;
+	}
+
+	return 1;
+}
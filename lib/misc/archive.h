@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2004-2010  Heinz Mauelshagen, Red Hat GmbH.
+ *                          All rights reserved.
+ *
+ * See file LICENSE at the top of this source tree for license information.
+ */
+
+/*
+ * Metadata dump archive.
+ *
+ * Layout (numbers little endian):
+ *
+ *	header | data (8 byte aligned) | index entries | trailer
+ *
+ * The index goes last, so that an archive can be written
+ * sequentially in one go (eg, to a pipe).
+ */
+
+#ifndef	_ARCHIVE_H_
+#define	_ARCHIVE_H_
+
+#define	ARCHIVE_MAGIC	"DMRAIDA1"
+#define	ARCHIVE_MAGIC_SIZE	8
+
+enum archive_type {
+	AR_METADATA = 1,	/* Metadata area at offset on device. */
+	AR_SIZE,		/* Device size in sectors in offset. */
+	AR_SERIAL,		/* Device serial number. */
+};
+
+struct archive_entry {
+	uint64_t data;		/* Archive offset of the data. */
+	uint64_t size;		/* Data size in bytes. */
+	uint64_t offset;	/* Byte offset on device or size. */
+	uint32_t type;		/* enum archive_type. */
+	uint32_t reserved;
+	char handler[16];	/* Format handler name. */
+	char name[64];		/* Device name (eg, "sda"). */
+} __attribute__ ((packed));
+
+struct archive_trailer {
+	uint64_t index;		/* Archive offset of the index. */
+	uint64_t entries;	/* # of index entries. */
+	char magic[ARCHIVE_MAGIC_SIZE];
+} __attribute__ ((packed));
+
+/* Index entry in CPU byte order handed to archive_for_each() callbacks. */
+struct archive_rec {
+	enum archive_type type;
+	const char *handler;
+	const char *name;
+	uint64_t offset;
+	const void *data;
+	size_t size;
+};
+
+int archive_add(struct lib_context *lc, const char *handler, char *path,
+		enum archive_type type, void *data, size_t size,
+		uint64_t offset);
+int archive_close(struct lib_context *lc);
+void *archive_map(struct lib_context *lc, const char *path, size_t *len);
+int archive_for_each(struct lib_context *lc, void *map, size_t len,
+		     int (*f) (struct lib_context *lc,
+			       struct archive_rec *rec, void *arg),
+		     void *arg);
+
+#endif
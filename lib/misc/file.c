@@ -5,6 +5,7 @@
  * See file LICENSE at the top of this source tree for license information.
  */
 
+#include <sys/ioctl.h>
 #include "internal.h"
 
 /* Create directory recusively. */
@@ -86,6 +87,269 @@ rw_file(struct lib_context *lc, const char *who, int flags,
 	return ret;
 }
 
+/*
+ * Device I/O.
+ *
+ * Block devices get opened once and the file descriptor is kept
+ * in the dev_info for the life of the library context, so that
+ * metadata format handlers reading multiple metadata areas don't
+ * pay for an open/close pair per area.
+ *
+ * The functions below go through the I/O backend of the library
+ * context. The blockdev_*() ones implement the block device backend.
+ */
+#ifdef __KLIBC__
+#define	DMRAID_PREAD	pread
+#define	DMRAID_PWRITE	pwrite
+#else
+#define	DMRAID_PREAD	pread64
+#define	DMRAID_PWRITE	pwrite64
+#endif
+
+/* Retrieve block sizes to align O_DIRECT transfers to. */
+static void
+dev_block_sizes(struct dev_info *di, int fd)
+{
+	unsigned int lbs = 0, pbs = 0;
+
+	if (ioctl(fd, BLKSSZGET, &lbs) || lbs < DMRAID_SECTOR_SIZE)
+		lbs = DMRAID_SECTOR_SIZE;
+
+	if (ioctl(fd, BLKPBSZGET, &pbs) || pbs < lbs || pbs % lbs)
+		pbs = lbs;
+
+	di->lbs = lbs;
+	di->pbs = pbs;
+}
+
+/*
+ * Open the device for read (O_RDONLY) or read/write (O_RDWR) access.
+ *
+ * A read-only descriptor gets upgraded on the first write request.
+ * Descriptors aren't inherited by child processes (O_CLOEXEC).
+ *
+ * With --direct_io, the device is opened O_DIRECT to keep metadata
+ * probing from evicting page cache and writes are O_DSYNC, hence
+ * durable on return without an fsync() of the whole device.
+ * Devices refusing O_DIRECT fall back to buffered I/O.
+ */
+int
+blockdev_open(struct lib_context *lc, struct dev_info *di, int flags)
+{
+	int fd = -1, direct = 0;
+
+	flags = (flags & O_ACCMODE) == O_RDONLY ? O_RDONLY : O_RDWR;
+	if (di->fd > -1 &&
+	    (flags == O_RDONLY || (di->fd_flags & O_ACCMODE) == O_RDWR))
+		return 1;
+
+	if (OPT_DIRECT_IO(lc)) {
+		direct = O_DIRECT | (flags == O_RDWR ? O_DSYNC : 0);
+		if ((fd = open(di->path,
+			       flags | direct | O_CLOEXEC)) == -1) {
+			if (errno != EINVAL)
+				return 0;
+
+			log_dbg(lc, "%s: no O_DIRECT support; using buffered "
+				"I/O", di->path);
+			direct = 0;
+		}
+	}
+
+	if (fd == -1 && (fd = open(di->path, flags | O_CLOEXEC)) == -1)
+		return 0;
+
+	if (direct)
+		dev_block_sizes(di, fd);
+
+	blockdev_close(lc, di);
+	di->fd = fd;
+	di->fd_flags = flags | direct;
+	return 1;
+}
+
+/* Close the device file descriptor. */
+void
+blockdev_close(struct lib_context *lc, struct dev_info *di)
+{
+	if (di->fd > -1) {
+		close(di->fd);
+		di->fd = -1;
+	}
+}
+
+/*
+ * Return a file descriptor on the device open for read (O_RDONLY)
+ * or read/write (O_RDWR) access or -1 on error, which includes
+ * backends without file descriptors (eg, replay).
+ */
+int
+dev_fd(struct lib_context *lc, struct dev_info *di, int flags)
+{
+	return lc->io->open(lc, di, flags) ? di->fd : -1;
+}
+
+void
+dev_close(struct lib_context *lc, struct dev_info *di)
+{
+	lc->io->close(lc, di);
+}
+
+/*
+ * Ask the kernel to read an area of the device into the page
+ * cache asynchronously, so that a later dev_read() doesn't block
+ * for the whole device round trip.
+ */
+void
+dev_prefetch(struct lib_context *lc, struct dev_info *di,
+	     loff_t offset, size_t size)
+{
+#ifndef __KLIBC__
+	int fd;
+
+	if ((fd = dev_fd(lc, di, O_RDONLY)) > -1 &&
+	    !(di->fd_flags & O_DIRECT))
+		posix_fadvise(fd, offset, size, POSIX_FADV_WILLNEED);
+#endif
+}
+
+/*
+ * O_DIRECT transfer through a bounce buffer covering the
+ * physical block aligned window around [offset, offset + size).
+ *
+ * Unaligned writes read the window in first in order to
+ * preserve the data surrounding the metadata.
+ */
+static ssize_t
+rw_direct(int fd, int write, struct dev_info *di,
+	  void *buffer, size_t size, loff_t offset)
+{
+	ssize_t r = -1;
+	size_t len;
+	uint64_t start = round_down(offset, di->pbs),
+		 end = round_up(offset + size, di->pbs);
+	char *bounce;
+
+	/* Devices needn't be a multiple of the physical block size. */
+	if (di->sectors && end > di->sectors * DMRAID_SECTOR_SIZE)
+		end = round_up(offset + size, di->lbs);
+
+	len = end - start;
+	if (posix_memalign((void **) &bounce, di->pbs, len)) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (write) {
+		if ((start != offset || len != size) &&
+		    (r = DMRAID_PREAD(fd, bounce, len, start)) != len)
+			goto out;
+
+		memcpy(bounce + (offset - start), buffer, size);
+		r = DMRAID_PWRITE(fd, bounce, len, start);
+	} else if ((r = DMRAID_PREAD(fd, bounce, len, start)) == len)
+		memcpy(buffer, bounce + (offset - start), size);
+
+out:
+	free(bounce);
+	return r == len ? size : (r < 0 ? r : 0);
+}
+
+ssize_t
+blockdev_read(struct lib_context *lc, struct dev_info *di,
+	      void *buffer, size_t size, loff_t offset)
+{
+	return (di->fd_flags & O_DIRECT) ?
+	       rw_direct(di->fd, 0, di, buffer, size, offset) :
+	       DMRAID_PREAD(di->fd, buffer, size, offset);
+}
+
+ssize_t
+blockdev_write(struct lib_context *lc, struct dev_info *di,
+	       void *buffer, size_t size, loff_t offset)
+{
+	return (di->fd_flags & O_DIRECT) ?
+	       rw_direct(di->fd, 1, di, buffer, size, offset) :
+	       DMRAID_PWRITE(di->fd, buffer, size, offset);
+}
+
+static int
+rw_dev(struct lib_context *lc, const char *who, int flags,
+       struct dev_info *di, void *buffer, size_t size, loff_t offset)
+{
+	int write = (flags & O_ACCMODE) != O_RDONLY;
+	ssize_t r;
+
+	if (!lc->io->open(lc, di, flags))
+		LOG_ERR(lc, 0, "opening \"%s\"", di->path);
+
+	if (write) {
+		lc->io_stats.writes++;
+		r = lc->io->write(lc, di, buffer, size, offset);
+	} else {
+		lc->io_stats.reads++;
+		r = lc->io->read(lc, di, buffer, size, offset);
+	}
+
+	if (r > 0)
+		lc->io_stats.bytes += r;
+
+	if (r != size)
+		LOG_ERR(lc, 0, "%s: %sing %s at %" PRIu64 "[%s]",
+			who, write ? "writ" : "read",
+			di->path, (uint64_t) offset,
+			r < 0 ? strerror(errno) : "short transfer");
+
+	return 1;
+}
+
+int
+dev_read(struct lib_context *lc, const char *who, struct dev_info *di,
+	 void *buffer, size_t size, loff_t offset)
+{
+	return rw_dev(lc, who, O_RDONLY, di, buffer, size, offset);
+}
+
+int
+dev_write(struct lib_context *lc, const char *who, struct dev_info *di,
+	  void *buffer, size_t size, loff_t offset)
+{
+	int ret = rw_dev(lc, who, O_RDWR, di, buffer, size, offset);
+
+	/* O_DSYNC writes are stable already. */
+	if (ret && !(di->fd_flags & O_DSYNC))
+		di->dirty = 1;
+
+	return ret;
+}
+
+/*
+ * Flush metadata written to a device to stable storage.
+ *
+ * Without @wait, writeback just gets started, so that callers can
+ * kick off all devices of a set before waiting for any of them,
+ * hence paying one device latency rather than one per device.
+ */
+int
+dev_sync(struct lib_context *lc, struct dev_info *di, int wait)
+{
+	if (!di->dirty || di->fd < 0)
+		return 1;
+
+	if (!wait) {
+#ifndef __KLIBC__
+		sync_file_range(di->fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+		return 1;
+	}
+
+	di->dirty = 0;
+	if (fsync(di->fd))
+		LOG_ERR(lc, 0, "flushing %s[%s]", di->path, strerror(errno));
+
+	return 1;
+}
+
 int
 read_file(struct lib_context *lc, const char *who, char *path,
 	  void *buffer, size_t size, loff_t offset)
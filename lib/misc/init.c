@@ -6,6 +6,8 @@
  */
 
 #include "internal.h"
+#include "activate/devmapper.h"
+#include "misc/archive.h"
 
 extern int dso;
 
@@ -33,9 +35,13 @@ libdmraid_init(int argc, char **argv)
 void
 libdmraid_exit(struct lib_context *lc)
 {
+	archive_close(lc);	/* Complete any metadata dump archive. */
 	free_raid_set(lc, NULL);	/* Free all RAID sets. */
 	free_raid_dev(lc, NULL);	/* Free all RAID devices. */
 	free_dev_info(lc, NULL);	/* Free all disk infos. */
+	dev_io_exit(lc);	/* Release I/O backend resources. */
+	dm_exit(lc);		/* Release device-mapper backend resources. */
 	unregister_format_handlers(lc);	/* Unregister all format handlers. */
+	sysfs_exit(lc);		/* Release cached sysfs resources. */
 	free_lib_context(lc);	/* Release library context. */
 }
@@ -134,6 +134,18 @@ init_paths(struct lib_context *lc, void *arg)
 	lc->path.error = "/dev/zero";
 }
 
+static void
+init_sysfs(struct lib_context *lc, void *arg)
+{
+	lc->sysfs.block_fd = -1;
+}
+
+static void
+init_io(struct lib_context *lc, void *arg)
+{
+	lc->io = &blockdev_io;
+}
+
 /* FIXME: add lib flavour info (e.g., DEBUG). */
 static void
 init_version(struct lib_context *lc, void *arg)
@@ -160,6 +172,8 @@ struct init_fn {
 	{ init_lists},
 	{ init_mode},
 	{ init_paths},
+	{ init_sysfs},
+	{ init_io},
 	{ init_version},
 };
 
@@ -12,11 +12,22 @@
 #include "dbg_malloc.h"
 #include "log/log.h"
 
+/* Not updated atomically; good enough for statistics. */
+static unsigned long allocations;
+
+unsigned long
+dbg_allocations(void)
+{
+	return allocations;
+}
+
 static void *
 __dbg_malloc(size_t size, int init)
 {
 	void *ret = malloc(size);
 
+	allocations++;
+
 	if (init && ret)
 		memset(ret, 0, size);
 
@@ -43,6 +54,7 @@ _dbg_realloc(void *ptr, size_t size, struct lib_context *lc,
 {
 	void *ret = realloc(ptr, size);
 
+	allocations++;
 	log_dbg(lc, "%s: dbg_realloc(0x%x, %zu) at line %u returned 0x%x",
 		(char *) who, (unsigned long) ptr, size, line,
 		(unsigned long) ret);
@@ -95,6 +107,7 @@ _dbg_malloc(size_t size)
 void *
 _dbg_realloc(void *ptr, size_t size)
 {
+	allocations++;
 	return realloc(ptr, size);
 }
 
@@ -48,4 +48,7 @@ void _dbg_free(void *ptr);
 
 #endif /* #ifdef DEBUG_MALLOC */
 
+/* # of allocations so far (for --stats). */
+unsigned long dbg_allocations(void);
+
 #endif
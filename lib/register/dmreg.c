@@ -46,6 +46,7 @@
 #define SYS_DM_PATH "/sys/block/dm-"
 #define SYS_DM_DEV "/dev"
 #define SYS_DM_SLAVES_DIR "/slaves"
+#define DM_CHECKPOINT_TIMEOUT 60 /* Seconds between rebuild checkpoints. */
 
 /* Command line option counters for CLI processing. */
 enum option_type { OPT_a, OPT_h, OPT_m, OPT_r, OPT_u, OPT_V, OPT_SUM, OPT_MAX };
@@ -251,10 +252,16 @@ enum register_type { EVENTS_REGISTER, EVENTS_UNREGISTER };
 static int _dm_set_events(enum register_type type, char *dev_name, char *dso)
 {
 	int ret = 0;
+	/* Periodic timeouts let the DSO checkpoint rebuilds. */
 	struct dm_event_handler *dmevh =
-		_create_dm_event_handler(dev_name, dso, DM_EVENT_ALL_ERRORS);
+		_create_dm_event_handler(dev_name, dso,
+					 DM_EVENT_ALL_ERRORS | DM_EVENT_TIMEOUT);
 
 	if (dmevh) {
+		if (type == EVENTS_REGISTER)
+			dm_event_handler_set_timeout(dmevh,
+						     DM_CHECKPOINT_TIMEOUT);
+
 		ret = (type == EVENTS_REGISTER) ?
 		      dm_event_register_handler(dmevh) :
 		      dm_event_unregister_handler(dmevh);
@@ -333,10 +340,11 @@ static int _dm_raid_state(char *dev_name)
 {	
 	int i, errors = 0;
 	uint64_t start, length;
-	char *next = NULL, *params, *status = NULL, *target_type = NULL;
+	char *next = NULL, *params, *target_type = NULL;
 	/* Get device status. */
 	struct dm_task *dmt = dm_task_create(DM_DEVICE_STATUS);
 	struct dm_info info;
+	struct dm_status st;
 
 	if (!dmt ||
 	    !dm_task_set_name(dmt, dev_name) ||
@@ -354,32 +362,14 @@ static int _dm_raid_state(char *dev_name)
 		if (!target_type) {
 			syslog(LOG_INFO, "  %s mapping lost.\n", dev_name);
 			errors++;
-		}
-		
-		/*
-		 * Find the substring with the 'A|D|S|R|U[A|D...]' to
-		 * signify if a RAID device device isn't active.
-		 */
-		if ((status = strstr(params, " A")) ||
-		    (status = strstr(params, " D")) ||
-		    (status = strstr(params, " S")) ||
-		    (status = strstr(params, " R")) ||
-		    (status = strstr(params, " U"))) {
-			/* Advance the pointer to the first status character */
-			while (isspace(*status))
-				status++;
-
-			/* Check for bad device. */
-			for (i = 0; status[i] && !isspace(status[i]); i++) {
-				/* Skip past raid45 target chars. */
-				if (status[i] != 'p' &&
-				    status[i] != 'i' &&
-				    status[i] != 'A')
+		} else if (dm_status_parse(target_type, params, &st)) {
+			/* Count RAID devices not alive (dead, out of sync...). */
+			for (i = 0; i < st.num_devs; i++) {
+				if (st.devs[i].health != DM_HEALTH_ALIVE)
 					errors++;
 			}
 		} else
-			 /* The substirng of '1 A' did not exist in the param 
-			  * string, this means that:
+			 /* The status could not be parsed, this means that:
 			  *	1) The kernel driver patches for status
 			  *	   are not installed
 			  *	2) Or that the first device of the RAID
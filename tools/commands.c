@@ -38,14 +38,27 @@ static char const *short_opts = "a:bc::C:dDEf:ghiIlM:"
 #endif
 	"pP:rR:s::S::tvVxZ";
 
+/* Values of long only options without an action flag of their own. */
+enum long_only_options {
+	DIRECT_IO = 0x100,	/* Beyond any option character. */
+	REPLAY,
+	DUMP_ARCHIVE,
+	STATS,
+	DM_MOCK,
+	REBUILD_BANDWIDTH,
+};
+
 #ifdef HAVE_GETOPTLONG
 static struct option long_opts[] = {
 	{"activate", required_argument, NULL, 'a'},
 	{"block_devices", no_argument, NULL, 'b'},
 	{"create", required_argument, NULL, 'C'},
 	{"debug", no_argument, NULL, 'd'},
+	{"direct_io", no_argument, NULL, DIRECT_IO},	/* long only. */
 	{"display_columns", optional_argument, NULL, 'c'},
 	{"display_group", no_argument, NULL, 'g'},
+	{"dm_mock", optional_argument, NULL, DM_MOCK},	/* long only. */
+	{"dump_archive", required_argument, NULL, DUMP_ARCHIVE},/* long only. */
 	{"dump_metadata", no_argument, NULL, 'D'},
 	{"erase_metadata", no_argument, NULL, 'E'},
 	{"format", required_argument, NULL, 'f'},
@@ -61,11 +74,15 @@ static struct option long_opts[] = {
 	{"partchar", required_argument, NULL, 'P'},
 	{"raid_devices", no_argument, NULL, 'r'},
 	{"rebuild", required_argument, NULL, 'R'},
+	{"rebuild_bandwidth", required_argument, NULL, REBUILD_BANDWIDTH},
+							/* long only. */
 	{"remove", no_argument, NULL, 'x'},
+	{"replay", required_argument, NULL, REPLAY},	/* long only. */
 	{"rm_partitions", no_argument, NULL, 'Z'},
 	{"sets", optional_argument, NULL, 's'},
 	{"separator", required_argument, NULL, SEPARATOR},	/* long only. */
 	{"spare", optional_argument, NULL, 'S'},
+	{"stats", no_argument, NULL, STATS},	/* long only. */
 	{"test", no_argument, NULL, 't'},
 	{"verbose", no_argument, NULL, 'v'},
 	{"version", no_argument, NULL, 'V'},
@@ -212,6 +229,63 @@ check_part_separator(struct lib_context *lc, struct actions *a)
 	return lc_stralloc_opt(lc, LC_PARTCHAR, optarg) ? 1 : 0;
 }
 
+static int set_action(struct lib_context *lc, int o);
+
+/*
+ * Store name of the archive to dump metadata into ("-" for stdout)
+ * and act like -D otherwise.
+ */
+static int
+check_dump_archive(struct lib_context *lc, struct actions *a)
+{
+	if (!lc_stralloc_opt(lc, a->arg, optarg))
+		return 0;
+
+	lc_inc_opt(lc, a->arg);
+	optarg = NULL;
+	return set_action(lc, 'D');
+}
+
+/*
+ * Store directory to replay devices from.
+ *
+ * There's nothing to lock against on replayed devices.
+ */
+static int
+check_replay(struct lib_context *lc, struct actions *a)
+{
+	lc_inc_opt(lc, LC_IGNORELOCKING);
+	lc_inc_opt(lc, a->arg);
+	return lc_stralloc_opt(lc, a->arg, optarg) ? 1 : 0;
+}
+
+/*
+ * Store optional device-mapper mock arguments.
+ *
+ * Mapped devices in memory can't be monitored by dmeventd.
+ */
+static int
+check_dm_mock(struct lib_context *lc, struct actions *a)
+{
+	lc_inc_opt(lc, LC_IGNOREMONITORING);
+	lc_inc_opt(lc, a->arg);
+	return !optarg || lc_stralloc_opt(lc, a->arg, optarg) ? 1 : 0;
+}
+
+/* Store recovery bandwidth share in percent. */
+static int
+check_rebuild_bandwidth(struct lib_context *lc, struct actions *a)
+{
+	char *end;
+	unsigned long percent = strtoul(optarg, &end, 10);
+
+	if (*end || end == optarg || !percent || percent > 100)
+		LOG_ERR(lc, 0, "invalid rebuild bandwidth \"%s\" "
+			"(1-100 percent)", optarg);
+
+	lc_inc_opt(lc, a->arg);
+	return lc_stralloc_opt(lc, a->arg, optarg) ? 1 : 0;
+}
 
 /* Display help information */
 static int
@@ -221,12 +295,16 @@ help(struct lib_context *lc, struct actions *a)
 
 	log_print(lc, "%s: Device-Mapper Software RAID tool\n", c);
 	log_print(lc,
-		  "* = [-d|--debug]... [-v|--verbose]... [-i|--ignorelocking]\n");
+		  "* = [-d|--debug]... [-v|--verbose]... [-i|--ignorelocking]"
+		  " [--direct_io]\n"
+		  "    [--replay {DIRECTORY|ARCHIVE}] [--dm_mock[=SPEC]] "
+		  "[--stats]\n");
 	log_print(lc,
 		  "%s\t{-a|--activate} {y|n|yes|no} *\n"
 		  "\t[-f|--format FORMAT[,FORMAT...]]\n"
 		  "\t[-I|--ignoremonitoring]\n"
 		  "\t[-P|--partchar CHAR]\n" "\t[-p|--no_partitions]\n"
+		  "\t[--rebuild_bandwidth PERCENT]\n"
 		  "\t[--separator SEPARATOR]\n" "\t[-t|--test]\n"
 		  "\t[-Z|--rm_partitions] [RAID-set...]\n", c);
 	log_print(lc,
@@ -242,7 +320,7 @@ help(struct lib_context *lc, struct actions *a)
 #  endif
 	log_print(lc, "%s\t{-r|--raid_devices} *\n"
 		  "\t[-c|--display_columns][FIELD[,FIELD...]]...\n"
-		  "\t[-D|--dump_metadata]\n"
+		  "\t[-D|--dump_metadata] [--dump_archive FILE]\n"
 		  "\t[-f|--format FORMAT[,FORMAT...]]\n"
 		  "\t[--separator SEPARATOR]\n" "\t[device-path...]\n", c);
 	log_print(lc, "%s\t{-r|--raid_devices} *\n"
@@ -260,7 +338,8 @@ help(struct lib_context *lc, struct actions *a)
 		  "\t[--str[i[de]] [0-9]...[kK][bB]]\n"
 		  "\t{--disk[s] \"device-path[, device-path...\"}\n", c);
 	log_print(lc, "%s\t{-x|--remove RAID-set} \n");
-	log_print(lc, "%s\t{-R|--rebuild} RAID-set [drive_name]\n", c);
+	log_print(lc, "%s\t{-R|--rebuild} RAID-set [drive_name]\n"
+		  "\t[--rebuild_bandwidth PERCENT]\n", c);
 	log_print(lc, "%s\t[{-f|--format FORMAT}]\n"
 		  "\t{-S|--spare [RAID-set]} \n"
 		  "\t{-M|--media \"device-path\"}\n", c);
@@ -338,6 +417,16 @@ static struct actions actions[] = {
 	 LC_DUMP,
 	 },
 
+	/* Dump metadata into one archive. */
+	{DUMP_ARCHIVE,
+	 UNDEF,
+	 UNDEF,
+	 ALL_FLAGS,
+	 ARGS,
+	 check_dump_archive,
+	 LC_DUMP_ARCHIVE,
+	 },
+
 	/* Erase metadata option. */
 	{'E',
 	 DMERASE,
@@ -512,6 +601,56 @@ static struct actions actions[] = {
 	 0,
 	 },
 
+	/* Metadata I/O bypassing the page cache. */
+	{DIRECT_IO,
+	 UNDEF,
+	 UNDEF,
+	 ALL_FLAGS,
+	 ARGS,
+	 _lc_inc_opt,
+	 LC_DIRECT_IO,
+	 },
+
+	/* Devices from metadata recorded with -D or device images. */
+	{REPLAY,
+	 UNDEF,
+	 UNDEF,
+	 ALL_FLAGS,
+	 ARGS,
+	 check_replay,
+	 LC_REPLAY,
+	 },
+
+	/* Mapped devices in memory. */
+	{DM_MOCK,
+	 UNDEF,
+	 UNDEF,
+	 ALL_FLAGS,
+	 ARGS,
+	 check_dm_mock,
+	 LC_DM_MOCK,
+	 },
+
+	/* Recovery bandwidth share of RAID sets. */
+	{REBUILD_BANDWIDTH,
+	 UNDEF,
+	 UNDEF,
+	 ALL_FLAGS,
+	 ARGS,
+	 check_rebuild_bandwidth,
+	 LC_REBUILD_BANDWIDTH,
+	 },
+
+	/* Statistics per processing phase. */
+	{STATS,
+	 UNDEF,
+	 UNDEF,
+	 ALL_FLAGS,
+	 ARGS,
+	 _lc_inc_opt,
+	 LC_STATS,
+	 },
+
 	/* Test run option. */
 	{'t',
 	 TEST,
@@ -714,6 +853,13 @@ handle_args(struct lib_context *lc, int argc, char ***argv)
 			return 0;
 	}
 
+	/*
+	 * RAID sets on replayed devices can't be activated
+	 * in the kernel (just tested).
+	 */
+	if (OPT_REPLAY(lc) && !OPT_DM_MOCK(lc))
+		lc_inc_opt(lc, LC_TEST);
+
 	/* Force deactivation of stacked partition devices. */
 	/* FIXME: remove partiton code in favour of kpartx ? */
 	if (DEACTIVATE & action)